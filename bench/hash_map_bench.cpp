@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <unordered_map>
+#ifdef BDTREE_HAVE_SPARSEHASH
+#include <google/dense_hash_map>
+#endif
+#include "flat_hash_map.hpp"
+#include "ratings_io.hpp"
+#include "types.hpp"
+
+/*
+ * FlatHashMap against google::dense_hash_map (std::unordered_map when sparsehash is not found by
+ * CMake, see bench/CMakeLists.txt) on the accesses of the trees to their hash maps:
+ * "ids" looks up and inserts the external ids of every rating, as IdMap::insert while loading,
+ * "bounds" fills a map of the bounds of every item and looks it up for every candidate, as
+ * the node bounds of ABDTree, and "relevance" builds the relevance map of every user and looks
+ * up the top items of many rankings in it, as RankIndex::evaluate_user (misses insert a 0, as
+ * the operator[] of the metrics does).
+ */
+
+template<typename K, typename V>
+using FlatMap = FlatHashMap<K, V>;
+
+#ifdef BDTREE_HAVE_SPARSEHASH
+template<typename K, typename V>
+struct OtherMap : public google::dense_hash_map<K, V>{
+    OtherMap() : google::dense_hash_map<K, V>(){
+        this->set_empty_key(-1);
+    }
+    explicit OtherMap(const std::size_t n) : google::dense_hash_map<K, V>(n){
+        this->set_empty_key(-1);
+    }
+};
+const char *other_name = "dense";
+#else
+template<typename K, typename V>
+using OtherMap = std::unordered_map<K, V>;
+const char *other_name = "unordered";
+#endif
+
+void print_usage(){
+    std::cout << "HASH MAP BENCHMARK" << std::endl
+              << "Usage: ./hash_map_bench <training-file> [rankings] [repeats]" << std::endl
+              << "The relevance maps are probed with the top 10 items of each ranking (default 100), repeats defaults to 3." << std::endl;
+}
+
+template<template<typename, typename> class Map>
+double ids(const std::vector<Rating> &ratings){
+    Map<id_type, dense_id_t> item_ids, user_ids;
+    for(const auto &rat : ratings){
+        if(item_ids.find(rat._item_id) == item_ids.end())
+            item_ids.insert(std::make_pair(rat._item_id, static_cast<dense_id_t>(item_ids.size())));
+        if(user_ids.find(rat._user_id) == user_ids.end())
+            user_ids.insert(std::make_pair(rat._user_id, static_cast<dense_id_t>(user_ids.size())));
+    }
+    double checksum{.0};
+    for(const auto &rat : ratings)
+        checksum += item_ids.find(rat._item_id)->second + user_ids.find(rat._user_id)->second;
+    return checksum;
+}
+
+template<template<typename, typename> class Map>
+double bounds(const std::vector<id_type> &items, const std::vector<id_type> &candidates){
+    Map<id_type, std::pair<std::size_t, std::size_t>> bounds(items.size());
+    for(std::size_t idx{0u}; idx < items.size(); ++idx)
+        bounds.insert(std::make_pair(items[idx], std::make_pair(idx, 2 * idx)));
+    double checksum{.0};
+    for(const auto cand : candidates)
+        if(bounds.count(cand) > 0)
+            checksum += bounds[cand].second - bounds[cand].first;
+    return checksum;
+}
+
+template<template<typename, typename> class Map>
+double relevance(const std::vector<Rating> &ratings, const std::vector<id_type> &ranking, const std::size_t num_rankings){
+    Map<id_type, Map<id_type, double>> relevances;
+    for(const auto &rat : ratings)
+        relevances[rat._user_id].insert(std::make_pair(rat._item_id, rat._value));
+    double checksum{.0};
+    for(auto &entry : relevances)
+        for(std::size_t first{0u}; first < num_rankings && first + 10u <= ranking.size(); ++first)
+            for(auto it = ranking.begin() + first; it != ranking.begin() + first + 10u; ++it)
+                checksum += entry.second[*it];
+    return checksum;
+}
+
+template<typename Fn>
+double best_ms(const unsigned repeats, double &checksum, Fn fn){
+    double best{-1};
+    for(unsigned r{0u}; r < repeats; ++r){
+        const auto start = std::chrono::steady_clock::now();
+        checksum = fn();
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if(best < 0 || ms < best) best = ms;
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 2 || std::string(argv[1]) == "help"){
+        print_usage();
+        return 1;
+    }
+    std::string training_file(argv[1]);
+    std::size_t num_rankings = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 100u;
+    unsigned repeats = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 3u;
+
+    std::vector<Rating> ratings;
+    auto source = open_ratings(training_file, 1u);
+    source->for_each_block([&ratings](const Rating *first, const Rating *last){
+        ratings.insert(ratings.end(), first, last);
+    });
+    // items by decreasing popularity, the candidates are all the items in order of appearance
+    std::unordered_map<id_type, std::size_t> counts;
+    std::vector<id_type> candidates;
+    for(const auto &rat : ratings)
+        if(counts[rat._item_id]++ == 0u)
+            candidates.push_back(rat._item_id);
+    std::vector<id_type> ranking(candidates);
+    std::stable_sort(ranking.begin(), ranking.end(), [&counts](const id_type lhs, const id_type rhs){
+        return counts[lhs] > counts[rhs];
+    });
+    std::vector<id_type> items(ranking);
+    std::sort(items.begin(), items.end());
+    std::cout << ratings.size() << " ratings, " << items.size() << " items" << std::endl;
+
+    std::cout << "map\tids (s)\tbounds (s)\trelevance (s)" << std::endl;
+    double flat_sum[3], other_sum[3];
+    const double flat_ms[3] = {
+        best_ms(repeats, flat_sum[0], [&]{return ids<FlatMap>(ratings);}),
+        best_ms(repeats, flat_sum[1], [&]{return bounds<FlatMap>(items, candidates);}),
+        best_ms(repeats, flat_sum[2], [&]{return relevance<FlatMap>(ratings, ranking, num_rankings);})
+    };
+    const double other_ms[3] = {
+        best_ms(repeats, other_sum[0], [&]{return ids<OtherMap>(ratings);}),
+        best_ms(repeats, other_sum[1], [&]{return bounds<OtherMap>(items, candidates);}),
+        best_ms(repeats, other_sum[2], [&]{return relevance<OtherMap>(ratings, ranking, num_rankings);})
+    };
+    if(!std::equal(flat_sum, flat_sum + 3, other_sum)){
+        std::cerr << "The maps disagree." << std::endl;
+        return 1;
+    }
+    std::cout << "flat\t" << flat_ms[0] / 1000.0 << "\t" << flat_ms[1] / 1000.0 << "\t" << flat_ms[2] / 1000.0 << std::endl;
+    std::cout << other_name << "\t" << other_ms[0] / 1000.0 << "\t" << other_ms[1] / 1000.0 << "\t" << other_ms[2] / 1000.0 << std::endl;
+    return 0;
+}
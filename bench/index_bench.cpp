@@ -0,0 +1,153 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <numeric>
+#include "abd_index.hpp"
+#include "csr_index.hpp"
+#include "id_map.hpp"
+#include "ratings_io.hpp"
+#include "stats.hpp"
+
+/*
+ * Split search on the item and user indices of ABDTree, with the map-based ABDIndex and with CSRIndex.
+ * Every candidate splitter walks its item entry and looks up the entries of its users, as in
+ * ABDTree::split_quality at the root: "lookups" only reads the scores, "split" also updates the stats.
+ */
+
+void print_usage(){
+    std::cout << "INDEX BENCHMARK" << std::endl
+              << "Usage: ./index_bench <training-file> [candidates] [repeats] [threads]" << std::endl
+              << "The most popular items are used as the candidate splitters (default 100, 0 for all), repeats defaults to 3." << std::endl;
+}
+
+template<typename Index>
+struct IndexPair{
+    Index _items, _users;
+};
+
+template<typename Index>
+void fill(IndexPair<Index> &indices,
+          const std::vector<dense_id_t> &item_dense,
+          const std::vector<dense_id_t> &user_dense,
+          const std::vector<Rating> &ratings,
+          const std::vector<std::size_t> &item_counts,
+          const std::vector<std::size_t> &user_counts){
+    for(dense_id_t item{0u}; item < item_counts.size(); ++item)
+        indices._items.reserve(item, item_counts[item]);
+    for(dense_id_t user{0u}; user < user_counts.size(); ++user)
+        indices._users.reserve(user, user_counts[user]);
+    for(std::size_t r{0u}; r < ratings.size(); ++r){
+        indices._items.insert(item_dense[r], ScoreUnbiased{user_dense[r], ratings[r]._value, ratings[r]._value});
+        indices._users.insert(user_dense[r], ScoreUnbiased{item_dense[r], ratings[r]._value, ratings[r]._value});
+    }
+    indices._items.sort_all();
+    indices._users.sort_all();
+}
+
+template<typename Index>
+double lookups(const IndexPair<Index> &indices, const std::vector<id_type> &candidates){
+    double checksum{.0};
+    for(const auto cand : candidates){
+        const auto &item_entry = indices._items.at(cand);
+        for(auto it = item_entry.cbegin(); it != item_entry.cend(); ++it){
+            const auto &user_entry = indices._users.at(it->_id);
+            for(auto us = user_entry.cbegin(); us != user_entry.cend(); ++us)
+                checksum += us->_rating_unbiased;
+        }
+    }
+    return checksum;
+}
+
+template<typename Index>
+double split_search(const IndexPair<Index> &indices, const std::vector<id_type> &candidates){
+    double checksum{.0};
+    std::vector<StatMap<id_type, ABDStats>> g_stats(2);
+    for(const auto cand : candidates){
+        for(auto &stats : g_stats)
+            stats.clear();
+        const auto &item_entry = indices._items.at(cand);
+        for(auto it = item_entry.cbegin(); it != item_entry.cend(); ++it)
+            indices._users.update_stats(g_stats[it->_rating >= 4 ? 0 : 1], it->_id);
+        for(const auto &stats : g_stats)
+            for(const auto &entry : stats)
+                checksum += entry.second.squared_error();
+    }
+    return checksum;
+}
+
+template<typename Fn>
+double best_ms(const unsigned repeats, double &checksum, Fn fn){
+    double best{-1};
+    for(unsigned r{0u}; r < repeats; ++r){
+        const auto start = std::chrono::steady_clock::now();
+        checksum = fn();
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if(best < 0 || ms < best) best = ms;
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 2 || std::string(argv[1]) == "help"){
+        print_usage();
+        return 1;
+    }
+    std::string training_file(argv[1]);
+    std::size_t num_candidates = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 100u;
+    unsigned repeats = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 3u;
+    unsigned num_threads = argc > 4 ? std::strtoul(argv[4], nullptr, 10) : 1u;
+
+    // dense ids and entry sizes, shared by both indices
+    std::vector<Rating> ratings;
+    auto source = open_ratings(training_file, num_threads);
+    source->for_each_block([&](const Rating *first, const Rating *last){
+        ratings.insert(ratings.end(), first, last);
+    });
+    IdMap item_ids, user_ids;
+    std::vector<dense_id_t> item_dense(ratings.size()), user_dense(ratings.size());
+    for(std::size_t r{0u}; r < ratings.size(); ++r){
+        item_dense[r] = item_ids.insert(ratings[r]._item_id);
+        user_dense[r] = user_ids.insert(ratings[r]._user_id);
+    }
+    std::vector<std::size_t> item_counts(item_ids.size(), 0u), user_counts(user_ids.size(), 0u);
+    for(std::size_t r{0u}; r < ratings.size(); ++r){
+        ++item_counts[item_dense[r]];
+        ++user_counts[user_dense[r]];
+    }
+    std::vector<id_type> candidates(item_counts.size());
+    std::iota(candidates.begin(), candidates.end(), 0);
+    std::stable_sort(candidates.begin(), candidates.end(), [&](const id_type lhs, const id_type rhs){
+        return item_counts[lhs] > item_counts[rhs];
+    });
+    if(num_candidates > 0u && num_candidates < candidates.size())
+        candidates.resize(num_candidates);
+    std::cout << ratings.size() << " ratings, " << user_ids.size() << " users, " << item_ids.size()
+              << " items, " << candidates.size() << " candidate splitters" << std::endl;
+
+    IndexPair<ABDIndex<id_type, ABDStats>> map_indices;
+    IndexPair<CSRIndex<id_type, ABDStats>> csr_indices;
+    double map_sum{.0}, csr_sum{.0}, map_split_sum{.0}, csr_split_sum{.0};
+    const auto map_build_ms = best_ms(1u, map_sum, [&]{
+        fill(map_indices, item_dense, user_dense, ratings, item_counts, user_counts);
+        return .0;
+    });
+    const auto csr_build_ms = best_ms(1u, csr_sum, [&]{
+        fill(csr_indices, item_dense, user_dense, ratings, item_counts, user_counts);
+        return .0;
+    });
+    const auto map_ms = best_ms(repeats, map_sum, [&]{return lookups(map_indices, candidates);});
+    const auto csr_ms = best_ms(repeats, csr_sum, [&]{return lookups(csr_indices, candidates);});
+    const auto map_split_ms = best_ms(repeats, map_split_sum, [&]{return split_search(map_indices, candidates);});
+    const auto csr_split_ms = best_ms(repeats, csr_split_sum, [&]{return split_search(csr_indices, candidates);});
+    if(map_sum != csr_sum || map_split_sum != csr_split_sum){
+        std::cerr << "The indices disagree." << std::endl;
+        return 1;
+    }
+    std::cout << "index\tbuild (s)\tlookups (s)\tsplit (s)" << std::endl
+              << "map\t" << map_build_ms / 1000.0 << "\t" << map_ms / 1000.0 << "\t" << map_split_ms / 1000.0 << std::endl
+              << "csr\t" << csr_build_ms / 1000.0 << "\t" << csr_ms / 1000.0 << "\t" << csr_split_ms / 1000.0 << std::endl
+              << "speedup\t" << map_build_ms / csr_build_ms << "x\t"
+              << map_ms / csr_ms << "x\t" << map_split_ms / csr_split_ms << "x" << std::endl;
+    return 0;
+}
@@ -0,0 +1,175 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <numeric>
+#include "csr_index.hpp"
+#include "id_map.hpp"
+#include "memory_usage.hpp"
+#include "packed_index.hpp"
+#include "ratings_io.hpp"
+#include "stats.hpp"
+
+/*
+ * Memory against speed of the ABDTree indices as plain rows (CSRIndex) and as packed blocks
+ * (PackedIndex, BDTREE_PACKED_INDEX). "split" walks the item entry of every candidate splitter and
+ * updates the stats of the loved and hated groups with the entries of its users, as in
+ * ABDTree::split_quality at the root, "decode" reads the whole user index and "rearrange" moves
+ * the users with an even id in front of the others in every item entry, as ABDTree::split does.
+ */
+
+using item_rows_t = CSRIndex<id_type, ABDStats, ItemScore>;
+using user_rows_t = CSRIndex<id_type, ABDStats, UserScore>;
+using item_packed_t = PackedIndex<id_type, ABDStats, ItemScore>;
+using user_packed_t = PackedIndex<id_type, ABDStats, UserScore>;
+
+void print_usage(){
+    std::cout << "PACKED INDEX BENCHMARK" << std::endl
+              << "Usage: ./packed_bench <training-file> [candidates] [repeats] [threads]" << std::endl
+              << "The most popular items are used as the candidate splitters (default 100, 0 for all), repeats defaults to 3." << std::endl;
+}
+
+template<typename ItemIndex, typename UserIndex>
+double split_search(const ItemIndex &items, const UserIndex &users, const std::vector<id_type> &candidates){
+    double checksum{.0};
+    std::vector<StatMap<id_type, ABDStats>> g_stats(2);
+    for(const auto cand : candidates){
+        for(auto &stats : g_stats)
+            stats.clear();
+        items.for_each(cand, 0u, items.num_scores(cand), [&](const ItemScore &score){
+            users.update_stats(g_stats[score._rating >= 4 ? 0 : 1], score._id);
+        });
+        for(const auto &stats : g_stats)
+            checksum += stats.squared_error();
+    }
+    return checksum;
+}
+
+template<typename Index>
+double decode(const Index &users){
+    double checksum{.0};
+    for(std::size_t user{0u}; user < users.size(); ++user)
+        users.for_each(user, 0u, users.num_scores(user), [&checksum](const UserScore &score){
+            checksum += score._id + score._rating_unbiased;
+        });
+    return checksum;
+}
+
+template<typename Index>
+double rearrange(Index &items){
+    items.rearrange([&items](const id_type item){return item_rows_t::bound_t(0u, items.num_scores(item));},
+                    [](__attribute__((unused)) const id_type item, typename Index::range_iterator first, typename Index::range_iterator last){
+        std::stable_partition(first, last, [](const ItemScore &score){return score._id % 2 == 0;});
+    });
+    return .0;
+}
+
+// the item entries must agree after rearrange
+template<typename Index>
+double positions(const Index &items){
+    double checksum{.0};
+    for(std::size_t item{0u}; item < items.size(); ++item){
+        std::size_t pos{0u};
+        items.for_each(item, 0u, items.num_scores(item), [&](const ItemScore &score){
+            checksum += (++pos) * (score._id + score._rating);
+        });
+    }
+    return checksum;
+}
+
+template<typename Fn>
+double best_ms(const unsigned repeats, double &checksum, Fn fn){
+    double best{-1};
+    for(unsigned r{0u}; r < repeats; ++r){
+        const auto start = std::chrono::steady_clock::now();
+        checksum = fn();
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if(best < 0 || ms < best) best = ms;
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 2 || std::string(argv[1]) == "help"){
+        print_usage();
+        return 1;
+    }
+    std::string training_file(argv[1]);
+    std::size_t num_candidates = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 100u;
+    unsigned repeats = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 3u;
+    unsigned num_threads = argc > 4 ? std::strtoul(argv[4], nullptr, 10) : 1u;
+
+    // the rows are built as in ABDTree::init, with the unbiased ratings of a lambda of 7
+    item_rows_t item_rows;
+    user_rows_t user_rows;
+    IdMap item_ids, user_ids;
+    double global_mean{.0};
+    auto source = open_ratings(training_file, num_threads);
+    source->for_each_block([&](const Rating *first, const Rating *last){
+        for(auto rat = first; rat != last; ++rat){
+            const auto item = item_ids.insert(rat->_item_id);
+            const auto user = user_ids.insert(rat->_user_id);
+            item_rows.insert(item, ItemScore{user, rat->_value});
+            user_rows.insert(user, UserScore{item, rat->_value, rat->_value});
+            global_mean += rat->_value;
+        }
+    });
+    item_rows.sort_all();
+    user_rows.sort_all();
+    global_mean /= item_rows.num_scores();
+    std::vector<double> biases;
+    for(auto entry : user_rows){
+        double bu{7 * global_mean};
+        for(const auto &score : entry.second)
+            bu += score._rating;
+        bu /= entry.second.size() + 7;
+        for(auto &score : entry.second)
+            score._rating_unbiased -= bu;
+        biases.push_back(bu);
+    }
+    std::vector<id_type> candidates(item_rows.size());
+    std::iota(candidates.begin(), candidates.end(), 0);
+    std::stable_sort(candidates.begin(), candidates.end(), [&](const id_type lhs, const id_type rhs){
+        return item_rows.num_scores(lhs) > item_rows.num_scores(rhs);
+    });
+    if(num_candidates > 0u && num_candidates < candidates.size())
+        candidates.resize(num_candidates);
+    std::cout << item_rows.num_scores() << " ratings, " << user_rows.size() << " users, " << item_rows.size()
+              << " items, " << candidates.size() << " candidate splitters" << std::endl;
+
+    double rows_sum{.0}, packed_sum{.0};
+    item_packed_t item_packed;
+    user_packed_t user_packed;
+    const auto pack_ms = best_ms(1u, packed_sum, [&]{
+        item_packed = item_packed_t(item_rows);
+        user_packed = user_packed_t(user_rows, biases, false);
+        return .0;
+    });
+    std::cout << "index\titems (MB)\tusers (MB)\tbytes/rating\tpack (s)\tsplit (s)\tdecode (Mratings/s)\trearrange (s)" << std::endl;
+    const auto report = [&](const std::string &name, const std::size_t item_bytes, const std::size_t user_bytes,
+            const double build_ms, const double split_ms, const double decode_ms, const double rearrange_ms){
+        std::cout << name << "\t" << to_mb(item_bytes) << "\t" << to_mb(user_bytes) << "\t"
+                  << (item_bytes + user_bytes) / static_cast<double>(item_rows.num_scores()) << "\t"
+                  << build_ms / 1000.0 << "\t" << split_ms / 1000.0 << "\t"
+                  << user_rows.num_scores() / decode_ms / 1000.0 << "\t" << rearrange_ms / 1000.0 << std::endl;
+    };
+
+    double split_rows{.0}, split_packed{.0};
+    const auto rows_split_ms = best_ms(repeats, split_rows, [&]{return split_search(item_rows, user_rows, candidates);});
+    const auto packed_split_ms = best_ms(repeats, split_packed, [&]{return split_search(item_packed, user_packed, candidates);});
+    const auto rows_decode_ms = best_ms(repeats, rows_sum, [&]{return decode(user_rows);});
+    const auto packed_decode_ms = best_ms(repeats, packed_sum, [&]{return decode(user_packed);});
+    if(split_rows != split_packed || rows_sum != packed_sum){
+        std::cerr << "The indices disagree." << std::endl;
+        return 1;
+    }
+    const auto rows_rearrange_ms = best_ms(1u, rows_sum, [&]{return rearrange(item_rows);});
+    const auto packed_rearrange_ms = best_ms(1u, packed_sum, [&]{return rearrange(item_packed);});
+    if(positions(item_rows) != positions(item_packed)){
+        std::cerr << "The indices disagree after rearrange." << std::endl;
+        return 1;
+    }
+    report("rows", item_rows.memory_bytes(), user_rows.memory_bytes(), 0, rows_split_ms, rows_decode_ms, rows_rearrange_ms);
+    report("packed", item_packed.memory_bytes(), user_packed.memory_bytes(), pack_ms, packed_split_ms, packed_decode_ms, packed_rearrange_ms);
+    return 0;
+}
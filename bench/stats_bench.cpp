@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "stats.hpp"
+#include "types.hpp"
+
+/*
+ * Throughput of the column kernels of the dense stat maps at each instruction set level, in
+ * millions of slots per second, against the stats stored as (key, stats) pairs.
+ * "squared error" and "subtract" run over all the slots, "squared error (keys)" gathers the
+ * slots of a sorted key list and "nonzero keys" collects the keys of the used slots.
+ */
+
+using namespace stats_kernels;
+
+void print_usage(){
+    std::cout << "STATS KERNELS BENCHMARK" << std::endl
+              << "Usage: ./stats_bench [slots] [fill] [repeats]" << std::endl
+              << "slots defaults to 20000 (about the items of a node), fill to .5 (the share of the slots in use), repeats to 200." << std::endl;
+}
+
+struct Columns{
+    std::vector<double> _sum_unbiased, _sum2_unbiased;
+    std::vector<int> _n;
+    std::vector<id_type> _keys;
+    std::vector<std::pair<id_type, ABDStats>> _pairs;
+};
+
+Columns make_columns(const std::size_t num_slots, const double fill){
+    std::mt19937 mt{42};
+    std::uniform_real_distribution<double> used(0, 1), rating(-2, 2);
+    Columns columns{std::vector<double>(num_slots, .0), std::vector<double>(num_slots, .0),
+                    std::vector<int>(num_slots, 0), {}, {}};
+    for(std::size_t slot{0u}; slot < num_slots; ++slot){
+        if(used(mt) >= fill) continue;
+        ABDStats stats;
+        for(int r = 1 + mt() % 20; r > 0; --r)
+            stats.update(ScoreUnbiased(slot, 3, rating(mt)));
+        columns._sum_unbiased[slot] = stats._sum_unbiased;
+        columns._sum2_unbiased[slot] = stats._sum2_unbiased;
+        columns._n[slot] = stats._n;
+        columns._keys.push_back(slot);
+        columns._pairs.emplace_back(slot, stats);
+    }
+    return columns;
+}
+
+// best time of a kernel over the repeats, in ms
+template<typename Fn>
+double best_ms(const unsigned repeats, Fn fn){
+    double best{-1};
+    for(unsigned r{0u}; r < repeats; ++r){
+        const auto start = std::chrono::steady_clock::now();
+        fn();
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if(best < 0 || ms < best) best = ms;
+    }
+    return best;
+}
+
+void print_rate(const std::string &kernel, const std::string &level, const std::size_t items, const double ms){
+    std::cout << kernel << "\t" << level << "\t" << items / ms / 1e3 << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc > 1 && std::string(argv[1]) == "help"){
+        print_usage();
+        return 1;
+    }
+    const std::size_t num_slots = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 20000u;
+    const double fill = argc > 2 ? std::strtod(argv[2], nullptr) : .5;
+    const unsigned repeats = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 200u;
+
+    auto columns = make_columns(num_slots, fill);
+    std::cout << num_slots << " slots, " << columns._keys.size() << " in use, best of " << repeats
+              << " runs, cpu supports " << level_name(supported_level()) << std::endl
+              << "kernel\tlevel\tMslots/s" << std::endl;
+
+    volatile double sink{.0};
+    const auto pairs_ms = best_ms(repeats, [&]{
+        double sq{.0};
+        for(const auto &entry : columns._pairs)
+            sq += entry.second.squared_error();
+        sink = sq;
+    });
+    print_rate("squared error (keys)", "pairs", columns._keys.size(), pairs_ms);
+
+    std::vector<double> dst(num_slots), src(num_slots, .5);
+    std::vector<id_type> keys(num_slots);
+    for(const auto level : {SimdLevel::scalar, SimdLevel::avx2, SimdLevel::avx512}){
+        if(level > supported_level()) continue;
+        double checksum{.0};
+        const auto sq_ms = best_ms(repeats, [&]{
+            checksum = squared_error(columns._sum_unbiased.data(), columns._sum2_unbiased.data(),
+                                     columns._n.data(), num_slots, level);
+        });
+        print_rate("squared error", level_name(level), num_slots, sq_ms);
+        const auto keys_ms = best_ms(repeats, [&]{
+            sink = squared_error(columns._sum_unbiased.data(), columns._sum2_unbiased.data(),
+                                 columns._n.data(), columns._keys.data(), columns._keys.size(), level);
+        });
+        print_rate("squared error (keys)", level_name(level), columns._keys.size(), keys_ms);
+        const auto sub_ms = best_ms(repeats, [&]{
+            subtract(dst.data(), src.data(), num_slots, level);
+        });
+        print_rate("subtract", level_name(level), num_slots, sub_ms);
+        const auto nz_ms = best_ms(repeats, [&]{
+            sink = nonzero_keys(columns._n.data(), num_slots, keys.data(), level);
+        });
+        print_rate("nonzero keys", level_name(level), num_slots, nz_ms);
+        std::cout << "\tchecksum " << checksum << std::endl;
+    }
+    return 0;
+}
@@ -3,11 +3,11 @@
 
 from .dtreelib import *
 
-def ErrorTree(bu_reg=7, h_smooth=100, depth_max=6, ratings_min=200000, top_pop=0, num_threads=1, randomize=False, rand_coeff=10, cache_enabled=True):
-    return ErrorTreePy(bu_reg, h_smooth, depth_max, ratings_min, top_pop, num_threads, randomize, rand_coeff, cache_enabled)
+def ErrorTree(bu_reg=7, h_smooth=100, depth_max=6, ratings_min=200000, top_pop=0, num_threads=1, randomize=False, rand_coeff=10, cache_enabled=True, id_order='external'):
+    return ErrorTreePy(bu_reg, h_smooth, depth_max, ratings_min, top_pop, num_threads, randomize, rand_coeff, cache_enabled, id_order)
 
-def RankNDCGTree(bu_reg=7, h_smooth=100, depth_max=6, ratings_min=200000, top_pop=0, num_threads=1, randomize=False, rand_coeff=10, cache_enabled=True):
-    return RankNDCGTreePy(bu_reg, h_smooth, depth_max, ratings_min, top_pop, num_threads, randomize, rand_coeff, cache_enabled)
+def RankNDCGTree(bu_reg=7, h_smooth=100, depth_max=6, ratings_min=200000, top_pop=0, num_threads=1, randomize=False, rand_coeff=10, cache_enabled=True, id_order='external'):
+    return RankNDCGTreePy(bu_reg, h_smooth, depth_max, ratings_min, top_pop, num_threads, randomize, rand_coeff, cache_enabled, id_order)
 
 def ErrorTreeTraverser(tree):
     return ErrorTreeTraverserPy(tree)
@@ -0,0 +1,64 @@
+import argparse
+import re
+
+# compares the trees and the metrics of bdtree_error/bdtree_rank runs built with different
+# stats precisions (BDTREE_STATS) against a reference run, usually the double build
+
+SPLITTER_RE = re.compile(r'\[NODE (\d+)\]: Splitter found in \S+ sec\.\s+Id: (\d+)\s+Quality: (\S+)')
+
+
+def read_splitters(log_fpath):
+    splitters = []
+    with open(log_fpath, 'r') as infile:
+        for line in infile:
+            m = SPLITTER_RE.search(line)
+            if m:
+                splitters.append((int(m.group(1)), int(m.group(2)), float(m.group(3))))
+    return splitters
+
+
+def read_metrics(out_fpath):
+    metrics = {}
+    with open(out_fpath, 'r') as infile:
+        for line in infile:
+            name, _, values = line.strip().partition('=')
+            values = values.strip('[]')
+            metrics[name] = [float(v) for v in values.split(',')] if values else []
+    return metrics
+
+
+def compare(ref, run):
+    ref_splitters, ref_metrics = ref
+    splitters, metrics = run
+    # nodes are numbered in order of creation, so ids only match up to the first different split
+    same, first_diff = 0, None
+    for (ref_node, ref_id, _), (node, splitter_id, _) in zip(ref_splitters, splitters):
+        if ref_node != node or ref_id != splitter_id:
+            first_diff = ref_node
+            break
+        same += 1
+    if first_diff is None and len(ref_splitters) != len(splitters):
+        first_diff = ref_splitters[same][0] if same < len(ref_splitters) else splitters[same][0]
+    rel_q = max([abs(q - ref_q) / max(abs(ref_q), 1e-12)
+                 for (_, _, ref_q), (_, _, q) in zip(ref_splitters[:same], splitters[:same])] or [0.])
+    print('  splitters: %d/%d equal%s' % (same, len(ref_splitters),
+                                          '' if first_diff is None else ', first difference at node %d' % first_diff))
+    print('  max relative split quality error: %.3g' % rel_q)
+    for name, ref_values in sorted(ref_metrics.items()):
+        values = metrics.get(name, [])
+        diffs = [abs(a - b) for a, b in zip(ref_values, values)]
+        print('  %s: max abs diff %.3g over %d levels%s' % (name, max(diffs or [0.]), len(diffs),
+                                                           '' if len(values) == len(ref_values) else ' (depth differs)'))
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Accuracy of reduced precision builds against a reference build.')
+    parser.add_argument('reference', nargs=2, metavar=('LOG', 'OUT'), help='log and outfile of the reference run')
+    parser.add_argument('runs', nargs='+', help='log and outfile of each run to compare')
+    args = parser.parse_args()
+    if len(args.runs) % 2 != 0:
+        parser.error('runs must be given as LOG OUT pairs')
+    ref = (read_splitters(args.reference[0]), read_metrics(args.reference[1]))
+    for log_fpath, out_fpath in zip(args.runs[::2], args.runs[1::2]):
+        print('%s vs %s' % (log_fpath, args.reference[0]))
+        compare(ref, (read_splitters(log_fpath), read_metrics(out_fpath)))
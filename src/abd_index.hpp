@@ -4,10 +4,10 @@
 #include <vector>
 #include "stats.hpp"
 
-template<typename Key, typename Stat>
+template<typename Key, typename Stat, typename Score = typename Stat::score_t>
 class ABDIndex{
 public:
-    using score_t = typename Stat::score_t;
+    using score_t = Score;
     using entry_t = std::vector<score_t>;
 protected:
     std::map<Key, entry_t> _index;
@@ -50,6 +50,10 @@ public:
         _index[key].push_back(score);
     }
 
+    void reserve(const Key &key, const std::size_t n){
+        _index[key].reserve(n);
+    }
+
     // return the -sorted- key vector
     std::vector<Key> keys(){
         return extract_keys(_index);
@@ -75,7 +79,7 @@ public:
     void update_stats(StatMap<Key, Stat> &stats, const Key key) const{
         if(_index.count(key) > 0){
             for(const auto &score : _index.at(key))
-                stats[score._id].update(score);
+                stats.update(score._id, score);
         }
     }
 
@@ -2,10 +2,18 @@
 #define ABD_TREE_HPP
 #include <unordered_map>
 #include <unordered_set>
+#include "array_pool.hpp"
 #include "aux.hpp"
-#include "abd_index.hpp"
+#include "csr_index.hpp"
 #include "d_tree.hpp"
+#include "id_map.hpp"
+#include "id_order.hpp"
+#include "mapped_index.hpp"
+#include "memory_usage.hpp"
+#include "packed_index.hpp"
+#include "snapshot.hpp"
 #include "stats.hpp"
+#include "stopwatch.hpp"
 #include "types.hpp"
 
 struct ABDNode{
@@ -22,14 +30,14 @@ struct ABDNode{
             std::size_t num_users,
             std::size_t num_ratings,
             std::size_t top_pop,
-            const stat_map_t &stats,
-            const std::vector<id_type> &candidates):
+            stat_map_t stats,
+            std::vector<id_type> candidates):
         _parent{parent}, _children{},
         _id{id}, _splitter_id{splitter_id}, _is_unknown{is_unknown}, _is_leaf{is_leaf},
         _level{level}, _quality{quality}, _split_quality{split_quality},
         _num_users{num_users}, _num_ratings{num_ratings}, _top_pop{top_pop},
-        _stats{std::unique_ptr<stat_map_t>(new stat_map_t{stats})},
-        _candidates{std::unique_ptr<std::vector<id_type>>(new std::vector<id_type>(candidates))},
+        _stats{std::unique_ptr<stat_map_t>(new stat_map_t{stats.take_compact()})},
+        _candidates{std::make_shared<const std::vector<id_type>>(std::move(candidates))},
         _users{nullptr}{ }
 
     ABDNode(id_type id,
@@ -37,7 +45,7 @@ struct ABDNode{
             std::size_t num_ratings,
             std::size_t num_users,
             std::size_t top_pop,
-            const stat_map_t &stats):
+            stat_map_t stats):
         ABDNode(nullptr,
                 id,
                 -1,
@@ -49,7 +57,7 @@ struct ABDNode{
                 num_users,
                 num_ratings,
                 top_pop,
-                stats,
+                std::move(stats),
                 std::vector<id_type>{}){}
 
     ABDNode() : ABDNode(-1, -1, -1, -1, 0, stat_map_t{}){}
@@ -85,23 +93,24 @@ struct ABDNode{
 
     }
 
-    bool has_prediction(const id_type &item_id) const{
+    // NOTE: predictions and scores are indexed by internal item id
+    bool has_prediction(const dense_id_t item_id) const{
         if(_predictions == nullptr)
             throw std::runtime_error("Predictions have not been cached. Rebuild the tree with cache_enabled=true.");
-        return _predictions->count(item_id) > 0;
+        return item_id < _predictions->size();
     }
 
-    double prediction(const id_type &item_id) const{
+    double prediction(const dense_id_t item_id) const{
         if(_predictions == nullptr)
             throw std::runtime_error("Predictions have not been cached. Rebuild the tree with cache_enabled=true.");
         return _predictions->at(item_id);
     }
 
-    double score(const id_type &item_id) const{
+    double score(const dense_id_t item_id) const{
         if(_scores == nullptr)
             throw std::runtime_error("Scores have not been cached. Rebuild the tree with cache_enabled=true.");
-        if(_scores->count(item_id) > 0)
-            return _scores->at(item_id);
+        if(item_id < _scores->size())
+            return (*_scores)[item_id];
         else
             return std::numeric_limits<double>::lowest();
     }
@@ -144,7 +153,7 @@ struct ABDNode{
         _stats.reset(nullptr);
         _predictions.reset(nullptr);
         _scores.reset(nullptr);
-        _candidates.reset(nullptr);
+        _candidates.reset();
         _users.reset(nullptr);
         for(auto &child : _children)
             child->free_cache();
@@ -163,46 +172,35 @@ struct ABDNode{
     std::size_t _num_ratings;
     std::size_t _top_pop;
     std::unique_ptr<stat_map_t> _stats;
-    std::unique_ptr<std::map<id_type, double>> _predictions;
-    std::unique_ptr<std::map<id_type, double>> _scores;
-    std::unique_ptr<std::vector<id_type>> _candidates;
+    std::unique_ptr<std::vector<double>> _predictions;
+    std::unique_ptr<std::vector<double>> _scores;
+    // shared by the children of a node, which start from the candidates of their parent
+    std::shared_ptr<const std::vector<id_type>> _candidates;
     std::unique_ptr<group_t> _users;
 
 
 };
 
 void ABDNode::cache_scores(const double h_smooth){
-    _predictions = std::unique_ptr<std::map<id_type, double> >(new std::map<id_type, double>{});
-    _scores = std::unique_ptr<std::map<id_type, double> >(new std::map<id_type, double>{});
     if(_parent != nullptr){
-        // user average prediction
-        auto it_hint = _predictions->end();
-        for(const auto &p_pred : (*_parent->_predictions)){
-            if(_stats->count(p_pred.first) > 0){
-                it_hint = _predictions->emplace_hint(it_hint, p_pred.first, _stats->at(p_pred.first).pred(p_pred.second, h_smooth));
-            }else{
-                it_hint = _predictions->emplace_hint(it_hint, p_pred.first, p_pred.second);
-            }
-        }
-        // user unbiased average prediction
-        // i.e., average deviation from the user average prediction
-        it_hint = _scores->end();
-        for(const auto &p_score : (*_parent->_scores)){
-            if(_stats->count(p_score.first) > 0){
-                it_hint = _scores->emplace_hint(it_hint, p_score.first, _stats->at(p_score.first).score(p_score.second, h_smooth));
-            }else{
-                it_hint = _scores->emplace_hint(it_hint, p_score.first, p_score.second);
-            }
-        }
-    }else{
-        //root node
-        auto it_hint = _predictions->end();
+        // items with no ratings in this node inherit the parent's values
+        _predictions = std::unique_ptr<std::vector<double>>(new std::vector<double>(*_parent->_predictions));
+        _scores = std::unique_ptr<std::vector<double>>(new std::vector<double>(*_parent->_scores));
         for(const auto &s : (*this->_stats)){
-            it_hint = _predictions->emplace_hint(it_hint, s.first, s.second.pred());
+            // user average prediction
+            (*_predictions)[s.first] = s.second.pred((*_parent->_predictions)[s.first], h_smooth);
+            // user unbiased average prediction
+            // i.e., average deviation from the user average prediction
+            (*_scores)[s.first] = s.second.score((*_parent->_scores)[s.first], h_smooth);
         }
-        it_hint = _scores->end();
+    }else{
+        //root node: every item has at least one rating
+        const std::size_t num_items = _stats->empty() ? 0u : std::prev(_stats->cend())->first + 1;
+        _predictions = std::unique_ptr<std::vector<double>>(new std::vector<double>(num_items));
+        _scores = std::unique_ptr<std::vector<double>>(new std::vector<double>(num_items));
         for(const auto &s : (*this->_stats)){
-            it_hint = _scores->emplace_hint(it_hint, s.first, s.second.score());
+            (*_predictions)[s.first] = s.second.pred();
+            (*_scores)[s.first] = s.second.score();
         }
     }
 }
@@ -214,10 +212,26 @@ void ABDNode::cache_scores(const double h_smooth){
 
 class ABDTree : public DTree<ABDNode>{
 protected:
-    using index_t = ABDIndex<id_type, ABDStats>;
-    using bound_t = typename index_t::bound_t;
-    using bound_map_t = hash_map_t<id_type, bound_t>;
+    // the indices are built as plain rows, with BDTREE_PACKED_INDEX and BDTREE_MAPPED_INDEX they
+    // are built from external sorts instead, as packed blocks or as mapped scratch files
+    using item_rows_t = CSRIndex<id_type, ABDStats, ItemScore>;
+    using user_rows_t = CSRIndex<id_type, ABDStats, UserScore>;
+#if defined(BDTREE_PACKED_INDEX) && defined(BDTREE_MAPPED_INDEX)
+#error "BDTREE_PACKED_INDEX and BDTREE_MAPPED_INDEX cannot be set together"
+#elif defined(BDTREE_PACKED_INDEX)
+    using item_index_t = PackedIndex<id_type, ABDStats, ItemScore>;
+    using user_index_t = PackedIndex<id_type, ABDStats, UserScore>;
+#elif defined(BDTREE_MAPPED_INDEX)
+    using item_index_t = MappedIndex<id_type, ABDStats, ItemScore>;
+    using user_index_t = MappedIndex<id_type, ABDStats, UserScore>;
+#else
+    using item_index_t = item_rows_t;
+    using user_index_t = user_rows_t;
+#endif
+    using bound_t = typename item_index_t::bound_t;
     using stat_map_t = typename DTree<ABDNode>::stat_map_t;
+    // dense copy of the stats of a node, tagged with the node id
+    using node_stats_t = std::pair<id_type, stat_map_t>;
 public:
     using typename DTree<ABDNode>::node_ptr_t;
     using typename DTree<ABDNode>::node_cptr_t;
@@ -231,10 +245,20 @@ public:
             const bool randomize = false,
             const double rand_coeff = 10,
             const bool cache_enabled = true,
+            const IdOrder id_order = IdOrder::external,
             const BasicLogger &log = BasicLogger{std::cout}):
         DTree<ABDNode>(depth_max, ratings_min, num_threads, randomize, rand_coeff, log),
-        _item_index{nullptr}, _user_index{nullptr}, _node_bounds{nullptr},
-        _bu_reg{bu_reg}, _h_smooth{h_smooth}, _top_pop{top_pop}, _cache_enabled{cache_enabled}, _node_counter{0u}{}
+        _item_index{nullptr}, _user_index{nullptr}, _item_ids{nullptr}, _user_ids{nullptr}, _bound_pool{nullptr}, _label_pool{nullptr},
+        _node_bounds{nullptr}, _thread_labels{nullptr}, _partition_sw{}, _partition_bytes{0u},
+        _split_copied_bytes{0u}, _split_moved_bytes{0u}, _num_splits{0u}, _node_stats{nullptr},
+        _bu_reg{bu_reg}, _global_mean{.0}, _h_smooth{h_smooth}, _top_pop{top_pop}, _cache_enabled{cache_enabled}, _node_counter{0u},
+        _id_order{id_order}{
+#if defined(BDTREE_MAPPED_INDEX) || defined(BDTREE_PACKED_INDEX)
+        // the co-rating order needs the user rows, the sorted indices are sorted by popularity instead
+        if(_id_order == IdOrder::corating)
+            _id_order = IdOrder::popularity;
+#endif
+    }
 
     ~ABDTree(){
         std::cout << "~ABDTree()" << std::endl;
@@ -246,65 +270,151 @@ public:
     void build(const std::vector<id_type> &candidates);
     void init(const std::vector<Rating> &training_data, const std::vector<Rating> &validation_data) override;
     void init(const std::vector<Rating> &training_data) override;
-    bool traverse(node_ptr_t &node, const profile_t &answers) const override;
+    void init(const RatingSource &training_data) override;
+    bool traverse(node_ptr_t &node, const ProfileView &answers) const override;
+    // NOTE: snapshots can only be taken between init() and build()
+    bool save_snapshot(const std::string &filename, const uint64_t content_hash) const override;
+    bool load_snapshot(const std::string &filename, const uint64_t content_hash) override;
 
     profile_t predict(const node_cptr_t node,
                       const std::vector<id_type> &items) const override{
-        profile_t pred;
-        pred.set_empty_key(-1);
+        profile_t pred(items.size());
+        dense_id_t dense;
         for(const auto &item_id : items){
-            if(node->has_prediction(item_id))
-                pred.insert(std::make_pair(item_id, node->prediction(item_id)));
+            if(_item_ids->find(item_id, dense) && node->has_prediction(dense))
+                pred.insert(std::make_pair(item_id, node->prediction(dense)));
         }
         return pred;
     }
 
     std::vector<id_type> ranking(const node_cptr_t node,
                               const std::vector<id_type> &items) const override{
-        std::vector<id_type> rank(items);
-        std::sort(rank.begin(), rank.end(),
-                  [&](const id_type &lhs, const id_type &rhs){
-            return node->score(lhs) > node->score(rhs);
+        // items unknown to the tree are ranked last
+        std::vector<std::pair<id_type, double>> items_by_score;
+        items_by_score.reserve(items.size());
+        dense_id_t dense;
+        for(const auto &item_id : items)
+            items_by_score.emplace_back(item_id, _item_ids->find(item_id, dense) ?
+                                            node->score(dense) :
+                                            std::numeric_limits<double>::lowest());
+        std::sort(items_by_score.begin(), items_by_score.end(),
+                  [](const std::pair<id_type, double> &lhs, const std::pair<id_type, double> &rhs){
+            return lhs.second > rhs.second;
         });
+        std::vector<id_type> rank;
+        rank.reserve(items_by_score.size());
+        for(const auto &item : items_by_score)
+            rank.push_back(item.first);
         return rank;
     }
 
+    id_type external_item_id(const id_type item_id) const override{
+        return _item_ids->external(item_id);
+    }
+
     void release_temp() override{
         _root->free_cache();
     }
 
 protected:
-    void compute_biases(const double global_mean);
+    // fill the indices and the id maps with the training ratings, returns the number of ratings
+#if defined(BDTREE_MAPPED_INDEX) || defined(BDTREE_PACKED_INDEX)
+    std::size_t init_sorted_indices(const RatingSource &training_data);
+#else
+    std::size_t init_indices(const RatingSource &training_data);
+    // relabel the ids of the rows and of the id maps in the order of _id_order, and report the
+    // change of locality of the user lookups
+    void reorder_ids(item_rows_t &item_rows, user_rows_t &user_rows);
+#endif
+    // unbias the ratings of the user rows, returns the user biases
+    template<typename Rows>
+    std::vector<double> compute_biases(Rows &user_rows, const double global_mean) const;
+    void init_root(const std::size_t num_ratings, stat_map_t stats);
+    bool read_snapshot(const std::string &filename,
+                       const uint64_t content_hash,
+                       std::size_t &num_ratings,
+                       stat_map_t &root_stats);
     void compute_root_quality() override;
 
-    template<typename It>
-    std::vector<bound_t> sort_by_group(It left,
-                                       It right,
-                                       std::size_t start,
-                                       const std::vector<group_t> &groups);
+    // stable partition of a range of postings by the labels of their users, the users of the
+    // first group are moved to the front in place and the others wait in the chunks (reused
+    // across calls), unknown_label last; returns the bounds of the parts wrt the item index
+    template<typename It, typename Value>
+    static std::vector<bound_t> partition_by_label(It left,
+                                                   It right,
+                                                   std::size_t start,
+                                                   const uint8_t *labels,
+                                                   const std::size_t num_groups,
+                                                   std::vector<std::vector<Value>> &chunks);
     void split(node_ptr_t parent,
                const id_type splitter_id,
                const double splitter_quality,
                std::vector<group_t> &groups,
                std::vector<double> &g_qualities,
                std::vector<stat_map_t> &g_stats) override;
+    // partition the ranges of the candidates among the node and its siblings where they are not yet
+    void prepare_candidates(const node_cptr_t node, const std::vector<id_type> &candidates) override;
+    void partition_bounds(const node_cptr_t node, const std::vector<id_type> &items);
+    void release_node(node_ptr_t node) override;
     double split_quality(const node_cptr_t node,
                          const id_type splitter_id,
                          std::vector<group_t> &groups,
                          std::vector<double> &g_qualities,
                          std::vector<stat_map_t> &g_stats) const override;
     double squared_error(const stat_map_t &stats) const;
+    // fill the loved and hated groups of a splitter and their stats
+    void known_groups(const node_cptr_t node,
+                      const id_type splitter_id,
+                      std::vector<group_t> &groups,
+                      std::vector<stat_map_t> &group_stats) const;
+    // size the stats of the groups (+1 for the unknowns) and empty them, keeping their memory
+    // so that the maps of a thread are reused across the candidate splitters
+    static void reset_stats(std::vector<stat_map_t> &group_stats);
+    // the last group stats are set to the node stats minus the other groups'
     void unknown_stats(const node_cptr_t node,
                        std::vector<stat_map_t> &group_stats) const;
 protected:
-    std::unique_ptr<index_t> _item_index;
-    std::unique_ptr<index_t> _user_index;
-    std::unique_ptr<hash_map_t<id_type, bound_map_t>> _node_bounds;
+    std::unique_ptr<item_index_t> _item_index;
+    std::unique_ptr<user_index_t> _user_index;
+    // the indices, stats and cached scores use internal ids, the nodes' splitters keep the external ones
+    std::unique_ptr<IdMap> _item_ids;
+    std::unique_ptr<IdMap> _user_ids;
+    // the ranges of the nodes in the item index are partitioned lazily: a child gets the bounds
+    // of an item only once a node of its level evaluates it as a candidate, from the ranges of its
+    // parent and the labels of the users in the parent's split (unset_bound until then). The
+    // bounds are arrays by item id and the labels arrays by user id, drawn from the pools and kept
+    // by node id until the subtree of the node is built
+    struct node_bounds_t{
+        bound_t *_bounds;
+        uint8_t *_labels;
+        std::size_t _num_groups;
+    };
+    static constexpr std::size_t unset_bound = std::numeric_limits<std::size_t>::max();
+    // label of the users in none of the groups of a split, i.e. the unknown group
+    static constexpr uint8_t unknown_label = std::numeric_limits<uint8_t>::max();
+    std::unique_ptr<ArrayPool<bound_t>> _bound_pool;
+    std::unique_ptr<ArrayPool<uint8_t>> _label_pool;
+    std::unique_ptr<std::vector<node_bounds_t>> _node_bounds;
+    // labels of the users in the groups of the candidate being evaluated, one array per thread,
+    // set to unknown_label between the candidates
+    std::unique_ptr<std::vector<std::vector<uint8_t>>> _thread_labels;
+    // time spent partitioning, and the most bytes the chunks of partition_by_label held
+    stopwatch _partition_sw;
+    std::size_t _partition_bytes;
+    // bytes the splits copied into the children, and the bytes they moved or shared that were
+    // copied before (the stats, the candidates and the users of the children)
+    std::size_t _split_copied_bytes;
+    std::size_t _split_moved_bytes;
+    std::size_t _num_splits;
+    // the stats of the node being split as columns, one copy per thread
+    std::unique_ptr<std::vector<node_stats_t>> _node_stats;
     double _bu_reg;
+    double _global_mean;
     double _h_smooth;
     std::size_t _top_pop;
     bool _cache_enabled;
     unsigned _node_counter;
+    IdOrder _id_order;
 };
 
 void ABDTree::init(const std::vector<Rating> &training_data, __attribute__((unused)) const std::vector<Rating> &validation_data){
@@ -314,33 +424,319 @@ void ABDTree::init(const std::vector<Rating> &training_data, __attribute__((unus
 }
 
 void ABDTree::init(const std::vector<Rating> &training_data){
+    ABDTree::init(RatingVector(training_data));
+}
+
+void ABDTree::init(const RatingSource &training_data){
+    _item_ids = std::unique_ptr<IdMap>(new IdMap{});
+    _user_ids = std::unique_ptr<IdMap>(new IdMap{});
+#if defined(BDTREE_MAPPED_INDEX) || defined(BDTREE_PACKED_INDEX)
+    const auto num_ratings = init_sorted_indices(training_data);
+#else
+    const auto num_ratings = init_indices(training_data);
+#endif
+    init_root(num_ratings, _user_index->all_stats());
+}
+
+#if defined(BDTREE_MAPPED_INDEX) || defined(BDTREE_PACKED_INDEX)
+std::size_t ABDTree::init_sorted_indices(const RatingSource &training_data){
+    double global_mean{0};
+    std::size_t num_ratings{0u};
+    // the ratings go through two external sorts, by item and by user, that share the sort buffer
+    const auto dir = scratch_dir();
+    item_index_t::sorter_t item_sorter(dir, sort_buffer_bytes() / 2);
+    user_index_t::sorter_t user_sorter(dir, sort_buffer_bytes() / 2);
+    // ratings of each item and user, counted in the pass that assigns the internal ids
+    std::vector<std::size_t> item_counts, user_counts;
+#ifdef BDTREE_PACKED_INDEX
+    // the packed blocks need the distinct ratings and the user biases before they are packed, the
+    // ratings of each user are summed in the pass that pushes them
+    std::vector<item_index_t::value_t> values;
+    std::vector<double> user_sums;
+#endif
+    auto count = [&](const dense_id_t item, const dense_id_t user){
+        if(item == item_counts.size())  item_counts.push_back(0u);
+        if(user == user_counts.size())  user_counts.push_back(0u);
+        ++item_counts[item];
+        ++user_counts[user];
+    };
+    if(training_data.multi_pass()){
+        // assign the internal ids first, so that the records are sorted with their final ids
+        training_data.for_each_block([&](const Rating *first, const Rating *last){
+            for(auto rat = first; rat != last; ++rat)
+                count(_item_ids->insert(rat->_item_id), _user_ids->insert(rat->_user_id));
+        });
+        apply_permutation(item_counts, _item_ids->sort());
+        apply_permutation(user_counts, _user_ids->sort());
+        if(_id_order != IdOrder::external){
+            const auto user_pop = popularity_order(user_counts);
+            _item_ids->relabel(popularity_order(item_counts));
+            _user_ids->relabel(user_pop);
+            apply_permutation(user_counts, user_pop);
+        }
+    }
+    training_data.for_each_block([&](const Rating *first, const Rating *last){
+        for(auto rat = first; rat != last; ++rat){
+            const auto item = _item_ids->insert(rat->_item_id);
+            const auto user = _user_ids->insert(rat->_user_id);
+            if(!training_data.multi_pass())
+                count(item, user);
+            item_sorter.push(std::make_pair(item, ItemScore{user, rat->_value}));
+            user_sorter.push(std::make_pair(user, UserScore{item, rat->_value, rat->_value}));
+            global_mean += rat->_value;
+#ifdef BDTREE_PACKED_INDEX
+            // as stored in the scores
+            const item_index_t::value_t rating = rat->_value;
+            const auto value = std::lower_bound(values.begin(), values.end(), rating);
+            if(value == values.end() || *value != rating)
+                values.insert(value, rating);
+            if(user >= user_sums.size())
+                user_sums.resize(user + 1, .0);
+            user_sums[user] += rating;
+#endif
+        }
+        num_ratings += std::distance(first, last);
+    });
+    if(!training_data.multi_pass()){
+        // internal ids were assigned in order of appearance, the runs are relabeled and sorted again
+        auto item_perm = _item_ids->sort();
+        auto user_perm = _user_ids->sort();
+        apply_permutation(item_counts, item_perm);
+        apply_permutation(user_counts, user_perm);
+        if(_id_order != IdOrder::external){
+            const auto item_pop = popularity_order(item_counts), user_pop = popularity_order(user_counts);
+            _item_ids->relabel(item_pop);
+            _user_ids->relabel(user_pop);
+            apply_permutation(user_counts, user_pop);
+            for(auto &item : item_perm) item = item_pop[item];
+            for(auto &user : user_perm) user = user_pop[user];
+        }
+#ifdef BDTREE_PACKED_INDEX
+        apply_permutation(user_sums, user_perm);
+#endif
+        item_sorter.transform([&](item_index_t::record_t &record){
+            record.first = item_perm[record.first];
+            record.second._id = user_perm[record.second._id];
+        });
+        user_sorter.transform([&](user_index_t::record_t &record){
+            record.first = user_perm[record.first];
+            record.second._id = item_perm[record.second._id];
+        });
+    }
+    this->_log.log() << "Sorted runs: " << item_sorter.num_runs() << " (items), "
+                     << user_sorter.num_runs() << " (users) in " << dir << std::endl
+                     << "Id order: " << order_name(_id_order) << std::endl;
+    global_mean /= num_ratings;
+    _global_mean = global_mean;
+#ifdef BDTREE_PACKED_INDEX
+    // the user biases of compute_biases, the user index is never rearranged and is packed tight
+    std::vector<double> user_biases(user_sums.size());
+    for(dense_id_t user{0u}; user < user_biases.size(); ++user)
+        user_biases[user] = (user_sums[user] + _bu_reg * global_mean) / (user_counts[user] + _bu_reg);
+    _item_index = std::unique_ptr<item_index_t>(new item_index_t{item_sorter, _item_ids->size(), values});
+    _user_index = std::unique_ptr<user_index_t>(new user_index_t{user_sorter, _user_ids->size(), values, user_biases, false});
+#else
+    _item_index = std::unique_ptr<item_index_t>(new item_index_t{item_sorter, _item_ids->size(), dir});
+    _user_index = std::unique_ptr<user_index_t>(new user_index_t{user_sorter, _user_ids->size(), dir, true});
+    compute_biases(*_user_index, global_mean);
+#endif
+    return num_ratings;
+}
+#else
+std::size_t ABDTree::init_indices(const RatingSource &training_data){
     double global_mean{0};
-    _item_index = std::unique_ptr<index_t>(new index_t{});
-    _user_index = std::unique_ptr<index_t>(new index_t{});
-    for(const auto &rat : training_data){
-        _item_index->insert(rat._item_id, ScoreUnbiased{rat._user_id, rat._value, rat._value});
-        _user_index->insert(rat._user_id, ScoreUnbiased{rat._item_id, rat._value, rat._value});
-        global_mean += rat._value;
-    }
-    _item_index->sort_all();
-    _user_index->sort_all();
-    global_mean /= training_data.size();
-    compute_biases(global_mean);
+    std::size_t num_ratings{0u};
+    auto item_rows = std::unique_ptr<item_rows_t>(new item_rows_t{});
+    auto user_rows = std::unique_ptr<user_rows_t>(new user_rows_t{});
+    // ratings are streamed from the source straight into the indices
+    if(training_data.multi_pass()){
+        // assign the internal ids and count the ratings of each user and item first,
+        // to allocate the index entries exactly
+        std::vector<std::size_t> item_counts, user_counts;
+        training_data.for_each_block([&](const Rating *first, const Rating *last){
+            for(auto rat = first; rat != last; ++rat){
+                const auto item = _item_ids->insert(rat->_item_id);
+                const auto user = _user_ids->insert(rat->_user_id);
+                if(item == item_counts.size())  item_counts.push_back(0u);
+                if(user == user_counts.size())  user_counts.push_back(0u);
+                ++item_counts[item];
+                ++user_counts[user];
+            }
+        });
+        apply_permutation(item_counts, _item_ids->sort());
+        apply_permutation(user_counts, _user_ids->sort());
+        for(dense_id_t item{0u}; item < item_counts.size(); ++item)
+            item_rows->reserve(item, item_counts[item]);
+        for(dense_id_t user{0u}; user < user_counts.size(); ++user)
+            user_rows->reserve(user, user_counts[user]);
+    }
+    training_data.for_each_block([&](const Rating *first, const Rating *last){
+        for(auto rat = first; rat != last; ++rat){
+            const auto item = _item_ids->insert(rat->_item_id);
+            const auto user = _user_ids->insert(rat->_user_id);
+            item_rows->insert(item, ItemScore{user, rat->_value});
+            user_rows->insert(user, UserScore{item, rat->_value, rat->_value});
+            global_mean += rat->_value;
+        }
+        num_ratings += std::distance(first, last);
+    });
+    if(!training_data.multi_pass()){
+        item_rows->shrink_to_fit();
+        user_rows->shrink_to_fit();
+        // internal ids were assigned in order of appearance, make them follow the external ones
+        const auto item_perm = _item_ids->sort();
+        const auto user_perm = _user_ids->sort();
+        item_rows->relabel(item_perm, user_perm);
+        user_rows->relabel(user_perm, item_perm);
+    }
+    item_rows->sort_all();
+    user_rows->sort_all();
+    if(_id_order != IdOrder::external)
+        reorder_ids(*item_rows, *user_rows);
+    global_mean /= num_ratings;
+    _global_mean = global_mean;
+    compute_biases(*user_rows, global_mean);
+    _item_index = std::move(item_rows);
+    _user_index = std::move(user_rows);
+    return num_ratings;
+}
+
+void ABDTree::reorder_ids(item_rows_t &item_rows, user_rows_t &user_rows){
+    const auto before = LocalityProbe::run(item_rows, user_rows);
+    std::vector<std::size_t> item_counts(item_rows.size()), user_counts(user_rows.size());
+    for(dense_id_t item{0u}; item < item_counts.size(); ++item)
+        item_counts[item] = item_rows.num_scores(item);
+    for(dense_id_t user{0u}; user < user_counts.size(); ++user)
+        user_counts[user] = user_rows.num_scores(user);
+    const auto item_perm = popularity_order(item_counts);
+    const auto user_perm = _id_order == IdOrder::corating ?
+                corating_order(user_rows, item_perm) :
+                popularity_order(user_counts);
+    item_rows.relabel(item_perm, user_perm);
+    user_rows.relabel(user_perm, item_perm);
+    item_rows.sort_all();
+    user_rows.sort_all();
+    _item_ids->relabel(item_perm);
+    _user_ids->relabel(user_perm);
+    const auto after = LocalityProbe::run(item_rows, user_rows);
+    auto &log = this->_log.log() << "Id order: " << order_name(_id_order) << ", user lookups of the "
+                                 << LocalityProbe::num_candidates << " most popular splitters in "
+                                 << before._ms << " ms -> " << after._ms << " ms";
+    if(before._cache_misses > 0u)
+        log << ", " << before._cache_misses << " -> " << after._cache_misses << " cache misses ("
+            << 100.0 * (static_cast<double>(after._cache_misses) - before._cache_misses) / before._cache_misses << "%)";
+    else
+        log << " (no hardware cache counters)";
+    log << std::endl;
+}
+#endif
+
+void ABDTree::init_root(const std::size_t num_ratings, stat_map_t stats){
     this->_log.log() << "TRAINING:" << std::endl
                  << "Num. users: " << _user_index->size() << std::endl
-                 << "Num. items: " << _item_index->size() << std::endl;
+                 << "Num. items: " << _item_index->size() << std::endl
+                 << "Num. ratings: " << num_ratings << std::endl
+                 << "Index memory: " << to_mb(_item_index->memory_bytes() + _user_index->memory_bytes()) << " MB" << std::endl
+#ifdef BDTREE_MAPPED_INDEX
+                 << "Mapped index: " << to_mb(_item_index->mapped_bytes() + _user_index->mapped_bytes()) << " MB" << std::endl
+#endif
+                 << "Peak memory: " << to_mb(peak_memory_bytes()) << " MB" << std::endl;
     //initialize the root of the tree
     this->_root = std::unique_ptr<ABDNode>(new ABDNode(_node_counter++,
                                                        1,
-                                                       training_data.size(),
+                                                       num_ratings,
                                                        _user_index->size(),
                                                        _top_pop,
-                                                       _user_index->all_stats()));
+                                                       std::move(stats)));
     compute_root_quality();
 }
 
-void ABDTree::compute_biases(const double global_mean){
-    for(auto &entry : *_user_index){
+bool ABDTree::save_snapshot(const std::string &filename, const uint64_t content_hash) const{
+    if(_item_index == nullptr || _node_bounds != nullptr)
+        throw std::runtime_error("Snapshots can only be taken between init() and build().");
+    SnapshotHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::copy(SnapshotHeader::magic, SnapshotHeader::magic + sizeof(header._magic), header._magic);
+    header._version = SnapshotHeader::current_version;
+    header._item_score_bytes = sizeof(ItemScore);
+    header._user_score_bytes = sizeof(UserScore);
+    header._stats_bytes = sizeof(ABDStats);
+    header._block_size = item_index_t::block_size;
+    header._id_order = static_cast<uint32_t>(_id_order);
+    header._content_hash = content_hash;
+    header._bu_reg = _bu_reg;
+    header._global_mean = _global_mean;
+    header._num_ratings = this->_root->_num_ratings;
+    header._num_users = _user_ids->size();
+    header._num_items = _item_ids->size();
+
+    SnapshotWriter writer(filename);
+    writer.write(&header, 1u);
+    writer.write(_item_ids->externals().data(), _item_ids->size());
+    writer.write(_user_ids->externals().data(), _user_ids->size());
+    _item_index->write(writer);
+    _user_index->write(writer);
+    // root stats, every item has some
+    std::vector<ABDStats> root_stats;
+    root_stats.reserve(this->_root->_stats->size());
+    for(const auto &entry : *this->_root->_stats)
+        root_stats.push_back(entry.second);
+    assert(root_stats.size() == _item_ids->size());
+    writer.write(root_stats.data(), root_stats.size());
+    writer.close();
+    return true;
+}
+
+bool ABDTree::load_snapshot(const std::string &filename, const uint64_t content_hash){
+    std::size_t num_ratings;
+    stat_map_t root_stats;
+    if(!read_snapshot(filename, content_hash, num_ratings, root_stats))
+        return false;
+    init_root(num_ratings, std::move(root_stats));
+    return true;
+}
+
+bool ABDTree::read_snapshot(const std::string &filename,
+                            const uint64_t content_hash,
+                            std::size_t &num_ratings,
+                            stat_map_t &root_stats){
+    if(!std::ifstream(filename))
+        return false;
+    SnapshotReader reader(filename);
+    const auto &header = reader.header();
+    if(header._version != SnapshotHeader::current_version ||
+            header._item_score_bytes != sizeof(ItemScore) ||
+            header._user_score_bytes != sizeof(UserScore) ||
+            header._stats_bytes != sizeof(ABDStats) ||
+            header._block_size != item_index_t::block_size ||
+            header._id_order != static_cast<uint32_t>(_id_order) ||
+            header._content_hash != content_hash ||
+            header._bu_reg != _bu_reg)
+        return false;
+    num_ratings = header._num_ratings;
+    _global_mean = header._global_mean;
+    _item_ids = std::unique_ptr<IdMap>(new IdMap{});
+    _user_ids = std::unique_ptr<IdMap>(new IdMap{});
+    const auto item_ids = reader.read<id_type>(header._num_items);
+    _item_ids->assign(item_ids, item_ids + header._num_items);
+    const auto user_ids = reader.read<id_type>(header._num_users);
+    _user_ids->assign(user_ids, user_ids + header._num_users);
+    _item_index = std::unique_ptr<item_index_t>(new item_index_t{});
+    _item_index->read(reader, header._num_items, num_ratings);
+    _user_index = std::unique_ptr<user_index_t>(new user_index_t{});
+    _user_index->read(reader, header._num_users, num_ratings);
+    const auto stats = reader.read<ABDStats>(header._num_items);
+    root_stats.clear();
+    for(dense_id_t item{0u}; item < header._num_items; ++item)
+        root_stats.set(item, stats[item]);
+    return true;
+}
+
+template<typename Rows>
+std::vector<double> ABDTree::compute_biases(Rows &user_rows, const double global_mean) const{
+    std::vector<double> biases;
+    biases.reserve(user_rows.size());
+    for(auto &entry : user_rows){
         double bu{};
         // compute the bias for each user
         for(const auto &score : entry.second)
@@ -350,7 +746,9 @@ void ABDTree::compute_biases(const double global_mean){
         // the update the unbiased scores
         for(auto &score : entry.second)
             score._rating_unbiased -= bu;
+        biases.push_back(bu);
     }
+    return biases;
 }
 
 void ABDTree::compute_root_quality(){
@@ -358,39 +756,49 @@ void ABDTree::compute_root_quality(){
 }
 
 double ABDTree::squared_error(const stat_map_t &stats) const{
-    double sq{.0};
-    for(const auto &entry : stats)
-        sq += entry.second.squared_error();
-    return sq;
-
+    return stats.squared_error();
 }
 
 void ABDTree::build(){
-    build(_item_index->keys());
+    build(_item_ids->externals(_item_index->keys()));
 }
 
 void ABDTree::build(const std::vector<id_type> &candidates){
-    // compute the intersection between candidates and item_index keys
-    std::vector<id_type> candidates_sorted(candidates);
-    std::sort(candidates_sorted.begin(), candidates_sorted.end());
-    std::vector<id_type> item_index_keys = _item_index->keys();
-    std::vector<id_type> intersection(std::min(item_index_keys.size(), candidates_sorted.size()));
-    auto it = std::set_intersection(candidates_sorted.cbegin(), candidates_sorted.cend(),
-                                    item_index_keys.cbegin(), item_index_keys.cend(),
-                                    intersection.begin());
-    intersection.resize(it - intersection.begin());
+    // keep the candidates that appear in the item index, translated to internal ids
+    std::vector<id_type> intersection;
+    intersection.reserve(candidates.size());
+    dense_id_t dense;
+    for(const auto &cand : candidates)
+        if(_item_ids->find(cand, dense))
+            intersection.push_back(dense);
+    // in the order of the external ids, the ties between candidates do not depend on the id order
+    std::sort(intersection.begin(), intersection.end(), [this](const id_type lhs, const id_type rhs){
+        return _item_ids->external(lhs) < _item_ids->external(rhs);
+    });
+    intersection.erase(std::unique(intersection.begin(), intersection.end()), intersection.end());
 
     // assign candidates to the root node
-    this->_root->_candidates = std::unique_ptr<std::vector<id_type>>(new std::vector<id_type>(intersection));
+    this->_root->_candidates = std::make_shared<const std::vector<id_type>>(intersection);
+    // the postings of the other items are never read
+    std::sort(intersection.begin(), intersection.end());
+    if(intersection.size() < _item_index->size())
+        _item_index->retain_keys(intersection.cbegin(), intersection.cend());
 
     // compute root node's bounds
-    _node_bounds = std::unique_ptr<hash_map_t<id_type, bound_map_t>>(new hash_map_t<id_type, bound_map_t>{});
-    _node_bounds->set_empty_key(-1);
-    for(const auto &entry : *_item_index){
-        if(_node_bounds->count(this->_root->_id) == 0)
-            (*_node_bounds)[this->_root->_id].set_empty_key(-1);
-        (*_node_bounds)[this->_root->_id].insert(std::make_pair(entry.first, typename index_t::bound_t(0, entry.second.size())));
-    }
+    _bound_pool = std::unique_ptr<ArrayPool<bound_t>>(new ArrayPool<bound_t>(_item_index->size()));
+    _label_pool = std::unique_ptr<ArrayPool<uint8_t>>(new ArrayPool<uint8_t>(_user_index->size()));
+    _thread_labels = std::unique_ptr<std::vector<std::vector<uint8_t>>>(
+                new std::vector<std::vector<uint8_t>>(this->_num_threads, std::vector<uint8_t>(_user_index->size(), unknown_label)));
+    _partition_sw.reset();
+    _partition_bytes = 0u;
+    this->_scratch_sets = this->_searches = 0u;
+    _split_copied_bytes = _split_moved_bytes = _num_splits = 0u;
+    _node_bounds = std::unique_ptr<std::vector<node_bounds_t>>(new std::vector<node_bounds_t>(this->_root->_id + 1));
+    auto root_bounds = (*_node_bounds)[this->_root->_id]._bounds = _bound_pool->acquire();
+    for(std::size_t item{0u}; item < _item_index->size(); ++item)
+        root_bounds[item] = bound_t(0, _item_index->num_scores(item));
+    _node_stats = std::unique_ptr<std::vector<node_stats_t>>(
+                new std::vector<node_stats_t>(this->_num_threads, node_stats_t(-1, stat_map_t{})));
 
     // cache root's scores
     if(_cache_enabled)  this->_root->cache_scores(_h_smooth);
@@ -401,10 +809,30 @@ void ABDTree::build(const std::vector<id_type> &candidates){
             << "\tQuality: " << this->_root->_quality << std::endl;
 
     gdt_r(this->_root.get());
+    release_node(this->_root.get());
+    this->release_split_scratch();
+    this->_log.log() << "Node bounds: " << _bound_pool->allocated() << " arrays at most, "
+                     << to_mb(_bound_pool->memory_bytes() + _label_pool->memory_bytes()) << " MB with the labels"
+                     << (_bound_pool->huge() ? " (huge pages)" : "") << std::endl;
+    this->_log.log() << "Allocations: " << _bound_pool->allocated() + _label_pool->allocated() << " node arrays for "
+                     << _bound_pool->acquired() + _label_pool->acquired() << " acquired, in "
+                     << _bound_pool->slabs() + _label_pool->slabs() << " slabs; "
+                     << this->_scratch_sets << " sets of split stats for " << this->_searches << " splitter searches" << std::endl;
+    if(_num_splits > 0u)
+        this->_log.log() << "Split copies: " << _split_copied_bytes / 1024.0 / _num_splits << " KB per split, "
+                         << (_split_copied_bytes + _split_moved_bytes) / 1024.0 / _num_splits << " KB before moving the stats, "
+                         << "users and candidates (" << _num_splits << " splits)" << std::endl;
+    this->_log.log() << "Partitioned in " << _partition_sw.elapsed_ms() / 1000.0 << " s, "
+                     << to_mb(_partition_bytes) << " MB of temporaries at most" << std::endl;
     //free memory allocated for temporary indices
     _item_index.reset(nullptr);
     _user_index.reset(nullptr);
+    _user_ids.reset(nullptr);
     _node_bounds.reset(nullptr);
+    _bound_pool.reset(nullptr);
+    _label_pool.reset(nullptr);
+    _thread_labels.reset(nullptr);
+    _node_stats.reset(nullptr);
 
 }
 
@@ -415,7 +843,7 @@ void ABDTree::split(node_ptr_t parent,
                     std::vector<double> &g_qualities,
                     std::vector<stat_map_t> &g_stats){
     // update parent node
-    parent->_splitter_id = splitter_id;
+    parent->_splitter_id = _item_ids->external(splitter_id);
     parent->_split_quality = splitter_quality;
     parent->_is_leaf = false;
 
@@ -426,14 +854,19 @@ void ABDTree::split(node_ptr_t parent,
         node_ptr_t child = new ABDNode;
         child->_parent = parent;
         child->_id = _node_counter++;
-        child->_candidates = std::unique_ptr<std::vector<id_type>>(new std::vector<id_type>(*parent->_candidates));
+        child->_candidates = parent->_candidates;
+        _split_moved_bytes += parent->_candidates->size() * sizeof(id_type);
         child->_level = parent->_level + 1;
         child->_is_leaf = true;
         child->_num_ratings = 0u;
+        for(const auto &entry : g_stats[child_idx])
+            child->_num_ratings += entry.second._n;
         child->_quality = g_qualities[child_idx];
         child->_top_pop = parent->_top_pop;
-        // store child stats temporarely
-        child->_stats = std::unique_ptr<stat_map_t>(new stat_map_t{g_stats[child_idx]});
+        // store child stats temporarely, the dense maps are compacted
+        (g_stats[child_idx].is_dense() ? _split_copied_bytes : _split_moved_bytes) +=
+                g_stats[child_idx].size() * sizeof(stat_map_t::value_type);
+        child->_stats = std::unique_ptr<stat_map_t>(new stat_map_t{g_stats[child_idx].take_compact()});
         if(_cache_enabled)  child->cache_scores(_h_smooth);
         if(child_idx < groups.size()){
             child->_num_users = groups[child_idx].size();
@@ -444,21 +877,76 @@ void ABDTree::split(node_ptr_t parent,
         }
         children.push_back(std::unique_ptr<ABDNode>(child));
     }
-    // compute children boundaries
-    for(auto &entry : *_item_index){
-        const auto &item_bounds = (*_node_bounds)[parent->_id][entry.first];
-        auto it_left = entry.second.begin() + item_bounds._left;
-        auto it_right = entry.second.begin() + item_bounds._right;
-        const auto g_bounds = sort_by_group(it_left, it_right, item_bounds._left, groups);
-        for(std::size_t gidx{}; gidx < g_bounds.size(); ++gidx){
-            if(_node_bounds->count(children[gidx]->_id) == 0)
-                    (*_node_bounds)[children[gidx]->_id].set_empty_key(-1);
-            (*_node_bounds)[children[gidx]->_id][entry.first] = g_bounds[gidx];
-            children[gidx]->_num_ratings += g_bounds[gidx].size();
-        }
+    ++_num_splits;
+    // the children's bounds are set when their candidates need them, see partition_bounds
+    _node_bounds->resize(_node_counter);
+    auto &parent_split = (*_node_bounds)[parent->_id];
+    auto labels = parent_split._labels = _label_pool->acquire();
+    std::fill(labels, labels + _label_pool->length(), unknown_label);
+    for(std::size_t gidx{0u}; gidx < groups.size(); ++gidx)
+        for(const auto user : groups[gidx])
+            labels[user] = gidx;
+    parent_split._num_groups = groups.size();
+    for(const auto &child : children){
+        auto bounds = (*_node_bounds)[child->_id]._bounds = _bound_pool->acquire();
+        std::fill(bounds, bounds + _bound_pool->length(), bound_t(unset_bound, unset_bound));
     }
 }
 
+void ABDTree::prepare_candidates(const node_cptr_t node, const std::vector<id_type> &candidates){
+    std::vector<id_type> items(candidates);
+    std::sort(items.begin(), items.end());
+    partition_bounds(node, items);
+}
+
+void ABDTree::partition_bounds(const node_cptr_t node, const std::vector<id_type> &items){
+    const auto bounds = (*_node_bounds)[node->_id]._bounds;
+    std::vector<id_type> unset;
+    for(const auto item : items)
+        if(bounds[item]._left == unset_bound)
+            unset.push_back(item);
+    // the root has all its bounds
+    if(unset.empty()) return;
+    const auto parent = node->_parent;
+    partition_bounds(parent, unset);
+    const auto &parent_split = (*_node_bounds)[parent->_id];
+    // the siblings whose subtree is built have no bounds anymore
+    std::vector<bound_t*> child_bounds;
+    for(const auto &child : parent->_children)
+        child_bounds.push_back((*_node_bounds)[child->_id]._bounds);
+    // the items are partitioned in parallel, each thread with its own chunks, and each item writes
+    // its own slot of the children's bounds
+    std::vector<std::vector<std::vector<ItemScore>>> thread_chunks(this->_num_threads);
+    _partition_sw.start();
+    _item_index->rearrange(unset.cbegin(), unset.cend(), [&](const id_type item){return parent_split._bounds[item];},
+                           [&](const id_type item, item_index_t::range_iterator it_left, item_index_t::range_iterator it_right){
+        const auto g_bounds = partition_by_label(it_left, it_right, parent_split._bounds[item]._left,
+                                                 parent_split._labels, parent_split._num_groups,
+                                                 thread_chunks[omp_get_thread_num()]);
+        for(std::size_t gidx{}; gidx < g_bounds.size(); ++gidx)
+            if(child_bounds[gidx] != nullptr)
+                child_bounds[gidx][item] = g_bounds[gidx];
+    }, this->_num_threads);
+    _partition_sw.stop();
+    std::size_t chunk_bytes{0u};
+    for(const auto &chunks : thread_chunks)
+        for(const auto &chunk : chunks)
+            chunk_bytes += chunk.capacity() * sizeof(ItemScore);
+    _partition_bytes = std::max(_partition_bytes, chunk_bytes);
+}
+
+void ABDTree::release_node(node_ptr_t node){
+    if(_node_bounds == nullptr || _node_bounds->size() <= static_cast<std::size_t>(node->_id))
+        return;
+    auto &split = (*_node_bounds)[node->_id];
+    if(split._bounds != nullptr)
+        _bound_pool->release(split._bounds);
+    if(split._labels != nullptr)
+        _label_pool->release(split._labels);
+    split._bounds = nullptr;
+    split._labels = nullptr;
+}
+
 double ABDTree::split_quality(const node_cptr_t node,
                               const id_type splitter_id,
                               std::vector<group_t> &groups,
@@ -466,23 +954,9 @@ double ABDTree::split_quality(const node_cptr_t node,
                               std::vector<stat_map_t> &g_stats) const {
     groups.clear();
     g_qualities.clear();
-    g_stats.clear();
     groups.assign(2, group_t{});
-    g_stats.assign(2, stat_map_t());
-
-    auto it_left = _item_index->at(splitter_id).cbegin() + (*_node_bounds)[node->_id][splitter_id]._left;
-    auto it_right = _item_index->at(splitter_id).cbegin() + (*_node_bounds)[node->_id][splitter_id]._right;
-
-    for(auto it_score = it_left; it_score < it_right; ++it_score){
-        if(it_score->_rating >= 4){  // loved item
-            groups[0].push_back(it_score->_id);
-             _user_index->update_stats(g_stats[0], it_score->_id);
-
-        }else{  // hated item
-            groups[1].push_back(it_score->_id);
-            _user_index->update_stats(g_stats[1], it_score->_id);
-        }
-    }
+    reset_stats(g_stats);
+    known_groups(node, splitter_id, groups, g_stats);
     unknown_stats(node, g_stats);
     //compute the split error on the training data
     double split_quality{.0};
@@ -496,16 +970,15 @@ double ABDTree::split_quality(const node_cptr_t node,
 }
 
 bool ABDTree::traverse(node_ptr_t &node,
-                       const profile_t &answers) const {
-    auto &answers_non_const = const_cast<profile_t&>(answers);
+                       const ProfileView &answers) const {
     bool to_unknown = false;
     if(!node->is_leaf()){ // while not at leaf node
-        if(answers.count(node->_splitter_id) == 0){// unknown item
+        const double *rating = answers.find(node->_splitter_id);
+        if(rating == nullptr){// unknown item
             node = node->_children.back().get();
             to_unknown = true;
         }else{
-            double &rating = answers_non_const[node->_splitter_id];
-            if(rating >= 4)
+            if(*rating >= 4)
                 node = node->_children[0].get(); // loved
             else
                 node = node->_children[1].get(); // hated
@@ -518,82 +991,74 @@ bool ABDTree::traverse(node_ptr_t &node,
 
 // takes a range of a container of (id, rating) values
 // pre: elements in the range [left, right) must be sorted by "id" ascending
-// pre: vectors in groups must be sorted in ascending order
-template<typename It>
-std::vector<ABDTree::bound_t> ABDTree::sort_by_group(It left,
-                                                     It right,
-                                                     std::size_t start,
-                                                     const std::vector<group_t> &groups){
+// post: the parts are sorted by "id" ascending too
+template<typename It, typename Value>
+std::vector<ABDTree::bound_t> ABDTree::partition_by_label(It left,
+                                                          It right,
+                                                          std::size_t start,
+                                                          const uint8_t *labels,
+                                                          const std::size_t num_groups,
+                                                          std::vector<std::vector<Value>> &chunks){
     assert(is_ordered(left, right));
-    // store the sorted vector chunks in a temp vector (+1 for the unknowns)
-    std::vector<std::vector<typename It::value_type>> chunks;
-    chunks.reserve(groups.size()+1);
-    for(std::size_t gidx{0}; gidx < groups.size()+1; ++gidx){
-        chunks.push_back(std::vector<typename It::value_type>{});
-        chunks.back().reserve(std::distance(left, right));  // reserve more memory than actually needed..
-    }
-    // initialize iterators for each group
-    std::vector<group_t::const_iterator> it_groups;
-    it_groups.reserve(groups.size());
-    for(const auto &g : groups)
-        it_groups.push_back(g.cbegin());
-    // split the input range according to groups
-    bool unknown{true};
-    for(auto it = left; it != right; ++it, unknown = true){
-        for(std::size_t gidx{0}; gidx < groups.size(); ++gidx){
-            while(it_groups[gidx] < groups[gidx].cend() &&
-                  *it_groups[gidx] < it->_id)
-                ++it_groups[gidx];
-            if(it_groups[gidx] < groups[gidx].cend() &&
-                    *it_groups[gidx] == it->_id){
-                chunks[gidx].push_back(*it);
-                unknown = false;
-            }
-        }
-        if(unknown) chunks.back().push_back(*it);
+    // the other groups, then the unknowns
+    chunks.resize(num_groups);
+    for(auto &chunk : chunks)
+        chunk.clear();
+    auto out = left;
+    for(auto it = left; it != right; ++it){
+        const auto label = labels[it->_id];
+        if(label == 0u)
+            *out++ = *it;
+        else
+            chunks[label == unknown_label ? num_groups - 1 : label - 1u].push_back(*it);
     }
-    // recompose the range, now ordered, and generate the bounds wrt the item index
     std::vector<bound_t> bounds;
-    bounds.reserve(chunks.size());
-    auto it_start = left;
+    bounds.reserve(num_groups + 1);
+    bounds.push_back(bound_t(start, start + (out - left)));
+    start += out - left;
     for(const auto &chunk : chunks){
-        std::copy(chunk.cbegin(), chunk.cend(), it_start);
+        out = std::copy(chunk.cbegin(), chunk.cend(), out);
         bounds.push_back(bound_t(start, start + chunk.size()));
-        assert(is_ordered(it_start, it_start + chunk.size()));
-        it_start += chunk.size();
         start += chunk.size();
     }
     return bounds;
 }
 
+void ABDTree::known_groups(const node_cptr_t node,
+                           const id_type splitter_id,
+                           std::vector<group_t> &groups,
+                           std::vector<stat_map_t> &group_stats) const{
+    const auto &bounds = (*_node_bounds)[node->_id]._bounds[splitter_id];
+    id_type last_id{-1};
+    _item_index->for_each(splitter_id, bounds._left, bounds._right, [&](const ItemScore &score){
+        // a user who rated the splitter more than once goes to the group of its first score only:
+        // the groups must not overlap, and the scores of a user are sorted by rating, so the
+        // lowest rating decides whatever the order of the training data
+        if(score._id == last_id)
+            return;
+        last_id = score._id;
+        const std::size_t gidx = score._rating >= 4 ? 0u : 1u;  // loved or hated item
+        groups[gidx].push_back(score._id);
+        _user_index->update_stats(group_stats[gidx], score._id);
+    });
+}
+
+void ABDTree::reset_stats(std::vector<stat_map_t> &group_stats){
+    group_stats.resize(3);
+    for(auto &stats : group_stats)
+        stats.clear();
+}
+
 void ABDTree::unknown_stats(const node_cptr_t node,
                             std::vector<stat_map_t> &group_stats) const{
-    group_stats.push_back(ABDNode::stat_map_t());
-    // initialize the pointers to the current element for each stats
-    std::vector<decltype(node->_stats->cbegin())> it_stats;
-    it_stats.reserve(group_stats.size());
-    // const_iterator for emplace_hint on the stat_map for the unknown statistics
-    auto it_hint = group_stats.back().end();
-
-    for(const auto &s : group_stats)
-        it_stats.push_back(s.cbegin());
-    // pass over all the stats simultaneously and
-    // compute the stats for the unknown branch of the tree
-    for(const auto &parent_stats : (*node->_stats)){
-        // retrieve current node's stats
-        const auto &item = parent_stats.first;
-        auto unknown_stats = parent_stats.second;
-        // subtract groups' stats to get the value for the unknowns
-        for(std::size_t gidx{0}; gidx < it_stats.size(); ++gidx){
-            if(it_stats[gidx] != group_stats[gidx].cend()
-                    && it_stats[gidx]->first == item){
-                unknown_stats -= it_stats[gidx]->second;
-                ++it_stats[gidx];
-            }
-        }
-        if(unknown_stats._n > 0)
-            it_hint = group_stats.back().emplace_hint(it_hint, item, unknown_stats);
+    // the node stats are copied to columns once per thread, for all the candidates of the node
+    auto &node_stats = (*_node_stats)[omp_get_thread_num()];
+    if(node_stats.first != node->_id){
+        node_stats.second.assign_dense(*node->_stats);
+        node_stats.first = node->_id;
     }
+    // the node stats minus the stats of the other groups
+    group_stats.back().assign_difference(node_stats.second, group_stats.cbegin(), group_stats.cend() - 1);
 #ifdef DEBUG
     for(const auto &entry : node->_stats){
         assert(entry.second._sum ==
@@ -613,5 +1078,7 @@ void ABDTree::unknown_stats(const node_cptr_t node,
 }
 
 
+constexpr std::size_t ABDTree::unset_bound;
+constexpr uint8_t ABDTree::unknown_label;
 
 #endif // ABD_TREE_HPP
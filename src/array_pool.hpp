@@ -0,0 +1,136 @@
+#ifndef ARRAY_POOL_HPP
+#define ARRAY_POOL_HPP
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// back the pools with transparent huge pages, when the BDTREE_HUGE_PAGES environment variable is
+// set to anything but 0
+bool huge_pages(){
+    const char *env = std::getenv("BDTREE_HUGE_PAGES");
+    return env != nullptr && *env != '\0' && std::string(env) != "0";
+}
+
+/*
+ * Arrays of the same length, handed out by acquire() and given back by release(). The arrays are
+ * carved one after the other out of slabs mapped from the kernel, of 2 MB at least, and released
+ * arrays are reused first, so only as many arrays are allocated as are in use at once. The pool is an arena: it owns the
+ * slabs and unmaps them all when it is destroyed, whatever arrays are still acquired. With huge
+ * pages the slabs are aligned to and rounded up to 2 MB and advised as huge pages, so that an
+ * array spans a few TLB entries only. The content of an acquired array is left as it was, the
+ * caller writes all of it.
+ */
+template<typename T>
+class ArrayPool{
+    static_assert(std::is_trivially_destructible<T>::value, "The arrays of a pool are never destroyed");
+    static constexpr std::size_t slab_bytes = std::size_t{2} << 20;
+
+    struct slab_t{
+        void *_data;
+        std::size_t _bytes;
+    };
+
+    std::size_t _length;
+    bool _huge_pages;
+    // arrays of a slab, and the bytes mapped for it
+    std::size_t _slab_arrays;
+    std::size_t _slab_bytes;
+    std::vector<slab_t> _slabs;
+    // arrays carved out of the last slab
+    std::size_t _carved;
+    std::vector<T*> _free;
+    std::size_t _acquired;
+
+    void add_slab(){
+        // with huge pages 2 MB more are mapped, and unmapped around the aligned part
+        const std::size_t bytes = _slab_bytes + (_huge_pages ? slab_bytes : 0u);
+        void *mapped = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(mapped == MAP_FAILED)
+            throw std::runtime_error(std::string("Unable to map a slab of the array pool: ") + std::strerror(errno));
+        char *data = static_cast<char*>(mapped);
+        if(_huge_pages){
+            const auto address = reinterpret_cast<uintptr_t>(mapped);
+            data = reinterpret_cast<char*>((address + slab_bytes - 1) / slab_bytes * slab_bytes);
+            const std::size_t head = data - static_cast<char*>(mapped);
+            if(head > 0u)
+                ::munmap(mapped, head);
+            if(bytes - head > _slab_bytes)
+                ::munmap(data + _slab_bytes, bytes - head - _slab_bytes);
+#ifdef MADV_HUGEPAGE
+            ::madvise(data, _slab_bytes, MADV_HUGEPAGE);
+#endif
+        }
+        _slabs.push_back(slab_t{data, _slab_bytes});
+        _carved = 0u;
+    }
+
+    // the pages of a slab are only touched once its arrays are carved
+    T* carve(){
+        if(_slabs.empty() || _carved == _slab_arrays)
+            add_slab();
+        T *array = reinterpret_cast<T*>(_slabs.back()._data) + _carved++ * _length;
+        for(std::size_t pos{0u}; pos < _length; ++pos)
+            ::new (static_cast<void*>(array + pos)) T();
+        return array;
+    }
+
+public:
+    explicit ArrayPool(const std::size_t length, const bool huge = huge_pages()) :
+        _length{length}, _huge_pages{huge}, _slab_arrays{0u}, _slab_bytes{0u}, _slabs{}, _carved{0u}, _free{},
+        _acquired{0u}{
+        // a slab holds as many arrays as fit 2 MB, one at least
+        const std::size_t array_bytes = std::max<std::size_t>(_length, 1u) * sizeof(T);
+        _slab_arrays = std::max<std::size_t>(slab_bytes / array_bytes, 1u);
+        const std::size_t page = _huge_pages ? slab_bytes : static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        _slab_bytes = (_slab_arrays * array_bytes + page - 1) / page * page;
+    }
+    ArrayPool(const ArrayPool&) = delete;
+    ArrayPool& operator=(const ArrayPool&) = delete;
+    ~ArrayPool(){
+        for(const auto &slab : _slabs)
+            ::munmap(slab._data, slab._bytes);
+    }
+
+    std::size_t length() const      {return _length;}
+    bool huge() const               {return _huge_pages;}
+    // arrays allocated, i.e. the most arrays in use at once
+    std::size_t allocated() const   {
+        return _slabs.empty() ? 0u : (_slabs.size() - 1) * _slab_arrays + _carved;
+    }
+    // arrays handed out by acquire(), the ones beyond allocated() were reused
+    std::size_t acquired() const    {return _acquired;}
+    std::size_t in_use() const      {return allocated() - _free.size();}
+    std::size_t slabs() const       {return _slabs.size();}
+    // bytes of the arrays allocated, the slabs map up to 2 MB more that are never touched
+    std::size_t memory_bytes() const{
+        return allocated() * _length * sizeof(T);
+    }
+
+    T* acquire(){
+        ++_acquired;
+        if(_free.empty())
+            return carve();
+        const auto array = _free.back();
+        _free.pop_back();
+        return array;
+    }
+
+    void release(T *array){
+        _free.push_back(array);
+    }
+};
+
+template<typename T>
+constexpr std::size_t ArrayPool<T>::slab_bytes;
+
+#endif // ARRAY_POOL_HPP
@@ -2,10 +2,11 @@
 #define AUX_HPP
 #include <algorithm>
 #include <cmath>
+#include <iterator>
 #include <map>
 #include <unordered_map>
-#include <google/dense_hash_map>
 #include <vector>
+#include "types.hpp"
 
 constexpr bool almost_eq(double lhs, double rhs, double eps = 1e-12) {
     return std::abs(lhs - rhs) < eps;
@@ -32,7 +33,7 @@ std::vector<K> extract_keys(const std::unordered_map<K,V> &map){
 }
 
 template<typename K, typename V>
-std::vector<K> extract_keys(const google::dense_hash_map<K,V> &map){
+std::vector<K> extract_keys(const hash_map_t<K,V> &map){
     std::vector<K> keys;
     keys.reserve(map.size());
     std::for_each(map.begin(), map.end(),[&](const std::pair<K,V> &entry){
@@ -59,4 +60,9 @@ std::ostream& print_range(std::ostream &os, It begin, It end, const std::string
     return os;
 }
 
+template<typename Range>
+std::ostream& print_range(std::ostream &os, const Range &range, const std::string delim = ", "){
+    return print_range(os, std::begin(range), std::end(range), delim);
+}
+
 #endif // AUX_HPP
@@ -0,0 +1,322 @@
+#ifndef CSR_INDEX_HPP
+#define CSR_INDEX_HPP
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "abd_index.hpp"
+#include "stats.hpp"
+
+// the scores of a key in a CSRIndex, a range over the shared score array
+template<typename It>
+class ScoreRange{
+    It _first, _last;
+public:
+    ScoreRange(It first, It last) : _first{first}, _last{last}{}
+    ScoreRange() : _first{}, _last{}{}
+
+    std::size_t size() const    {return std::distance(_first, _last);}
+    bool empty() const          {return _first == _last;}
+    It begin() const            {return _first;}
+    It end() const              {return _last;}
+    It cbegin() const           {return _first;}
+    It cend() const             {return _last;}
+    decltype(*_first) operator[](const std::size_t pos) const   {return _first[pos];}
+};
+
+/*
+ * Compressed row variant of ABDIndex for dense keys 0..n-1: the scores of all the keys are
+ * stored back to back in a single array, those of key k in [offsets[k], offsets[k+1]).
+ * Lookups are O(1) and never leave the two arrays.
+ *
+ * Scores are inserted in place when the size of their key has been reserved beforehand
+ * (keys in increasing order), and staged otherwise. Staged scores are packed into the rows by
+ * shrink_to_fit(), relabel() and sort_all(), the index can be read after any of them.
+ */
+template<typename Key, typename Stat, typename Score = typename Stat::score_t>
+class CSRIndex{
+public:
+    using score_t = Score;
+    using entry_t = ScoreRange<typename std::vector<score_t>::iterator>;
+    using const_entry_t = ScoreRange<typename std::vector<score_t>::const_iterator>;
+    using bound_t = typename ABDIndex<Key, Stat, Score>::bound_t;
+    using range_iterator = typename std::vector<score_t>::iterator;
+    // scores are stored as they are, see PackedIndex for the packed layout
+    static constexpr std::size_t block_size = 0u;
+
+    // iterates over (key, scores) pairs in key order
+    template<typename Index, typename Entry>
+    class key_iterator : public std::iterator<std::forward_iterator_tag, std::pair<Key, Entry>>{
+        Index *_index;
+        Key _key;
+        std::pair<Key, Entry> _entry;
+    public:
+        key_iterator(Index *index, const Key key) : _index{index}, _key{key}, _entry{}{}
+        const std::pair<Key, Entry>& operator*(){
+            _entry = std::make_pair(_key, (*_index)[_key]);
+            return _entry;
+        }
+        const std::pair<Key, Entry>* operator->(){return &**this;}
+        key_iterator& operator++()    {++_key; return *this;}
+        friend bool operator ==(const key_iterator &lhs, const key_iterator &rhs){return lhs._key == rhs._key;}
+        friend bool operator !=(const key_iterator &lhs, const key_iterator &rhs){return lhs._key != rhs._key;}
+    };
+    using iterator = key_iterator<CSRIndex, entry_t>;
+    using const_iterator = key_iterator<const CSRIndex, const_entry_t>;
+protected:
+    std::vector<std::size_t> _offsets;
+    std::vector<score_t> _scores;
+    // end of the inserted scores of each reserved key
+    std::vector<std::size_t> _fill;
+    // scores of keys without a reservation
+    std::vector<std::pair<Key, score_t>> _pending;
+public:
+    CSRIndex() : _offsets(1, 0u), _scores{}, _fill{}, _pending{}{}
+    ~CSRIndex(){}
+
+    // accessors for some basic properties
+    std::size_t size() const                    {return _offsets.size() - 1;}
+    std::size_t num_scores() const              {return _offsets.back();}
+    std::size_t num_scores(const Key &key) const    {return _offsets[key + 1] - _offsets[key];}
+    const std::vector<std::size_t>& offsets() const {return _offsets;}
+    const std::vector<score_t>& scores() const  {return _scores;}
+    // bytes taken by the index
+    std::size_t memory_bytes() const{
+        return (_offsets.capacity() + _fill.capacity()) * sizeof(std::size_t) + _scores.capacity() * sizeof(score_t) +
+                _pending.capacity() * sizeof(std::pair<Key, score_t>);
+    }
+
+    entry_t operator[](const Key &key){
+        return entry_t(_scores.begin() + _offsets[key], _scores.begin() + _offsets[key + 1]);
+    }
+    const_entry_t operator[](const Key &key) const{
+        return const_entry_t(_scores.cbegin() + _offsets[key], _scores.cbegin() + _offsets[key + 1]);
+    }
+    entry_t at(const Key &key){
+        check_key(key);
+        return (*this)[key];
+    }
+    const_entry_t at(const Key &key) const{
+        check_key(key);
+        return (*this)[key];
+    }
+
+    iterator begin()                {return iterator(this, 0);}
+    iterator end()                  {return iterator(this, size());}
+    const_iterator begin() const    {return cbegin();}
+    const_iterator end() const      {return cend();}
+    const_iterator cbegin() const   {return const_iterator(this, 0);}
+    const_iterator cend() const     {return const_iterator(this, size());}
+
+    void insert(const Key &key, const score_t &score){
+        if(static_cast<std::size_t>(key) < size() && _fill[key] < _offsets[key + 1]){
+            if(_scores.size() < _offsets.back())
+                _scores.resize(_offsets.back());
+            _scores[_fill[key]++] = score;
+        }else{
+            _pending.emplace_back(key, score);
+        }
+    }
+
+    // set the entry of a key greater than all the keys in the index
+    template<typename It>
+    void append(const Key &key, It first, It last){
+        reserve(key, 0u);
+        _scores.resize(_offsets.back());
+        _scores.insert(_scores.end(), first, last);
+        _offsets.back() = _scores.size();
+        _fill.back() = _scores.size();
+    }
+
+    // replace the index with the rows of a compressed layout
+    template<typename OffsetIt, typename ScoreIt>
+    void assign(OffsetIt first_offset, OffsetIt last_offset, ScoreIt first_score){
+        _offsets.assign(first_offset, last_offset);
+        _scores.assign(first_score, first_score + _offsets.back());
+        _fill.assign(_offsets.cbegin() + 1, _offsets.cend());
+        _pending.clear();
+    }
+
+    // reserve room for the scores of a key greater than all the keys in the index
+    void reserve(const Key &key, const std::size_t n){
+        if(static_cast<std::size_t>(key) < size())
+            throw std::logic_error("Keys must be reserved in increasing order.");
+        while(size() < static_cast<std::size_t>(key)){
+            _offsets.push_back(_offsets.back());
+            _fill.push_back(_offsets.back());
+        }
+        _fill.push_back(_offsets.back());
+        _offsets.push_back(_offsets.back() + n);
+    }
+
+    // relabel the keys and the ids of the scores with two permutations of internal ids
+    void relabel(const std::vector<dense_id_t> &key_perm, const std::vector<dense_id_t> &id_perm){
+        pack();
+        std::vector<std::size_t> offsets(size() + 1, 0u);
+        for(std::size_t key{0u}; key < size(); ++key)
+            offsets[key_perm[key] + 1] = _offsets[key + 1] - _offsets[key];
+        for(std::size_t key{0u}; key < size(); ++key)
+            offsets[key + 1] += offsets[key];
+        std::vector<score_t> scores(_scores.size());
+        for(std::size_t key{0u}; key < size(); ++key){
+            auto out = scores.begin() + offsets[key_perm[key]];
+            for(auto pos = _offsets[key]; pos < _offsets[key + 1]; ++pos, ++out){
+                *out = _scores[pos];
+                out->_id = id_perm[out->_id];
+            }
+        }
+        _offsets.swap(offsets);
+        _scores.swap(scores);
+        _fill.assign(_offsets.cbegin() + 1, _offsets.cend());
+    }
+
+    // pack the staged scores and release the unused capacity
+    void shrink_to_fit(){
+        pack();
+        _offsets.shrink_to_fit();
+        _scores.shrink_to_fit();
+        _fill.shrink_to_fit();
+    }
+
+    // return the -sorted- key vector
+    std::vector<Key> keys() const{
+        std::vector<Key> keys(size());
+        for(std::size_t key{0u}; key < size(); ++key)
+            keys[key] = key;
+        return keys;
+    }
+
+    void sort_all(){
+        pack();
+        for(std::size_t key{0u}; key < size(); ++key)
+            sort_entry(key);
+    }
+
+    void sort_entry(const Key &key){
+        auto entry = at(key);
+        std::stable_sort(entry.begin(), entry.end());
+    }
+
+    // calls fn on the scores of a key in the positions [first, last)
+    template<typename Fn>
+    void for_each(const Key &key, const std::size_t first, const std::size_t last, Fn fn) const{
+        for(auto pos = _offsets[key] + first; pos < _offsets[key] + last; ++pos)
+            fn(_scores[pos]);
+    }
+
+    // reorders the scores of each key within a range, key by key: range(key) gives the positions
+    // of the range as a bound_t and fn(key, first, last) may permute the scores in [first, last)
+    template<typename RangeFn, typename Fn>
+    void rearrange(RangeFn range, Fn fn){
+        for(std::size_t key{0u}; key < size(); ++key){
+            const bound_t bounds = range(key);
+            fn(key, _scores.begin() + _offsets[key] + bounds._left, _scores.begin() + _offsets[key] + bounds._right);
+        }
+    }
+    // as rearrange, for the keys in [first_key, last_key) only (distinct); with more threads fn
+    // is called on several keys at once, it must only touch the range and the state of its key
+    template<typename KeyIt, typename RangeFn, typename Fn>
+    void rearrange(KeyIt first_key, KeyIt last_key, RangeFn range, Fn fn, const unsigned num_threads = 1u){
+        const long num_keys = std::distance(first_key, last_key);
+    #pragma omp parallel for schedule(dynamic, 16) num_threads(num_threads)
+        for(long idx = 0; idx < num_keys; ++idx){
+            const auto key = first_key[idx];
+            const bound_t bounds = range(key);
+            fn(key, _scores.begin() + _offsets[key] + bounds._left, _scores.begin() + _offsets[key] + bounds._right);
+        }
+    }
+
+    // drop the scores of the keys not in [first_key, last_key) (sorted), the keys stay with no scores
+    template<typename KeyIt>
+    void retain_keys(KeyIt first_key, KeyIt last_key){
+        pack();
+        std::vector<std::size_t> offsets(size() + 1, 0u);
+        std::size_t end{0u};
+        for(std::size_t key{0u}; key < size(); ++key){
+            if(first_key != last_key && static_cast<std::size_t>(*first_key) == key){
+                // the rows only move towards the front
+                if(end < _offsets[key])
+                    std::copy(_scores.cbegin() + _offsets[key], _scores.cbegin() + _offsets[key + 1], _scores.begin() + end);
+                end += num_scores(key);
+                ++first_key;
+            }
+            offsets[key + 1] = end;
+        }
+        _offsets.swap(offsets);
+        _scores.resize(end);
+        _scores.shrink_to_fit();
+        _fill.assign(_offsets.cbegin() + 1, _offsets.cend());
+    }
+
+    // the index is stored as offsets + scores
+    template<typename Writer>
+    void write(Writer &writer) const{
+        const std::vector<uint64_t> offsets(_offsets.cbegin(), _offsets.cend());
+        writer.write(offsets.data(), offsets.size());
+        writer.write(_scores.data(), num_scores());
+    }
+    template<typename Reader>
+    void read(Reader &reader, const std::size_t num_keys, const std::size_t num_scores){
+        const auto offsets = reader.template read<uint64_t>(num_keys + 1);
+        assign(offsets, offsets + num_keys + 1, reader.template read<score_t>(num_scores));
+    }
+
+    StatMap<Key, Stat> all_stats() const{
+        StatMap<Key, Stat>  stats{};
+        for(std::size_t key{0u}; key < size(); ++key)
+            update_stats(stats, key);
+        return stats;
+    }
+
+    // updates the stats with all the values associated to a given key
+    void update_stats(StatMap<Key, Stat> &stats, const Key key) const{
+        if(static_cast<std::size_t>(key) < size()){
+            for(auto pos = _offsets[key]; pos < _offsets[key + 1]; ++pos)
+                stats.update(_scores[pos]._id, _scores[pos]);
+        }
+    }
+
+private:
+    void check_key(const Key &key) const{
+        if(key < 0 || static_cast<std::size_t>(key) >= size())
+            throw std::out_of_range("Key " + std::to_string(key) + " not in index");
+    }
+
+    // move the staged scores into the rows, dropping unfilled reservations
+    // scores of the same key keep their order of insertion
+    void pack(){
+        bool packed{_pending.empty()};
+        for(std::size_t key{0u}; packed && key < size(); ++key)
+            packed = _fill[key] == _offsets[key + 1];
+        if(packed) return;
+        std::size_t num_keys{size()};
+        for(const auto &pending : _pending)
+            num_keys = std::max<std::size_t>(num_keys, pending.first + 1);
+        std::vector<std::size_t> offsets(num_keys + 1, 0u);
+        for(std::size_t key{0u}; key < size(); ++key)
+            offsets[key + 1] = _fill[key] - _offsets[key];
+        for(const auto &pending : _pending)
+            ++offsets[pending.first + 1];
+        for(std::size_t key{0u}; key < num_keys; ++key)
+            offsets[key + 1] += offsets[key];
+        std::vector<score_t> scores(offsets.back());
+        std::vector<std::size_t> next(offsets.cbegin(), offsets.cend() - 1);
+        for(std::size_t key{0u}; key < size(); ++key)
+            next[key] = std::copy(_scores.cbegin() + _offsets[key], _scores.cbegin() + _fill[key],
+                                  scores.begin() + next[key]) - scores.begin();
+        for(const auto &pending : _pending)
+            scores[next[pending.first]++] = pending.second;
+        _offsets.swap(offsets);
+        _scores.swap(scores);
+        _fill.assign(_offsets.cbegin() + 1, _offsets.cend());
+        std::vector<std::pair<Key, score_t>>().swap(_pending);
+    }
+};
+
+template<typename Key, typename Stat, typename Score>
+constexpr std::size_t CSRIndex<Key, Stat, Score>::block_size;
+
+#endif // CSR_INDEX_HPP
@@ -9,6 +9,7 @@
 #include "stats.hpp"
 #include "types.hpp"
 #include "stopwatch.hpp"
+#include "user_profiles.hpp"
 #include "../util/basic_log.hpp"
 template<typename N>
 class DTree{
@@ -27,7 +28,7 @@ public:
         _root{nullptr}, _mt{nullptr},
         _depth_max{depth_max}, _ratings_min{ratings_min}, _num_threads{num_threads},
         _randomize{randomize}, _rand_coeff{rand_coeff},
-        _log{log}{}
+        _log{log}, _split_scratch{nullptr}, _scratch_sets{0u}, _searches{0u}{}
 
 
 
@@ -35,6 +36,7 @@ public:
         std::cout << "~DTree()" << std::endl;
     }
     virtual void build() = 0;
+    virtual void init(const RatingSource &training_data) = 0;
     virtual void init(const std::vector<Rating> &training_data) = 0;
     virtual void init(const std::vector<Rating> &training_data, const std::vector<Rating> &validation_data) = 0;
     void gdt_r(node_ptr_t node);
@@ -47,10 +49,26 @@ public:
 
     // move the node pointer to the next node of the tree according to user's answers
     // return true if a rating is added by the strategy (i.e., the unknown branch is NOT taken)
-    virtual bool traverse(node_ptr_t &node, const profile_t &answers) const = 0;
+    virtual bool traverse(node_ptr_t &node, const ProfileView &answers) const = 0;
 
     virtual void release_temp() = 0;
 
+    // snapshots of the initialized tree, keyed by the content hash of the training data
+    // both return false if the tree does not support them, load_snapshot also if the snapshot does not match
+    virtual bool save_snapshot(__attribute__((unused)) const std::string &filename,
+                               __attribute__((unused)) const uint64_t content_hash) const{
+        return false;
+    }
+    virtual bool load_snapshot(__attribute__((unused)) const std::string &filename,
+                               __attribute__((unused)) const uint64_t content_hash){
+        return false;
+    }
+
+    // the id of an item as known outside the tree, for trees that relabel items internally
+    virtual id_type external_item_id(const id_type item_id) const{
+        return item_id;
+    }
+
     node_ptr_t root()           {return _root.get();}
     node_ptr_t root() const     {return _root.get();}
     unsigned depth_max() const  {return _depth_max;}
@@ -75,10 +93,37 @@ protected:
                                  std::vector<group_t> &groups,
                                  std::vector<double> &g_qualities,
                                  std::vector<stat_map_t> &g_stats) const = 0;
+    // called before the candidates of a node are evaluated
+    virtual void prepare_candidates(__attribute__((unused)) const node_cptr_t node,
+                                    __attribute__((unused)) const std::vector<id_type> &candidates){}
+    // called once the subtree of a node is built, to free what only its split needed
+    virtual void release_node(__attribute__((unused)) node_ptr_t node){}
     void rnd_init(){
         std::random_device rd;
         _mt = std::unique_ptr<std::mt19937>(new std::mt19937(rd()));
     }
+    // scratch of the candidates evaluated by a thread, kept across the nodes of a build so that the
+    // groups and the stat maps keep their memory; the best set of the chosen candidate goes to split
+    struct split_scratch_t{
+        std::vector<group_t> _groups, _best_groups;
+        std::vector<double> _qualities, _best_qualities;
+        std::vector<stat_map_t> _stats, _best_stats;
+        // sets of stat maps this thread had to allocate
+        std::size_t _sets{0u};
+    };
+    // the scratch of every thread, allocated by the first search of a build
+    std::vector<split_scratch_t>& split_scratch(){
+        if(_split_scratch == nullptr)
+            _split_scratch = std::unique_ptr<std::vector<split_scratch_t>>(new std::vector<split_scratch_t>(_num_threads));
+        return *_split_scratch;
+    }
+    // frees the scratch at the end of a build, keeping the count of its allocations
+    void release_split_scratch(){
+        if(_split_scratch != nullptr)
+            for(const auto &scratch : *_split_scratch)
+                _scratch_sets += scratch._sets;
+        _split_scratch.reset(nullptr);
+    }
 protected:
     std::unique_ptr<N> _root;
     std::unique_ptr<std::mt19937> _mt;
@@ -88,6 +133,10 @@ protected:
     bool _randomize;
     double _rand_coeff;
     BasicLogger _log;
+    std::unique_ptr<std::vector<split_scratch_t>> _split_scratch;
+    // stat map sets allocated by the released scratch, and splitter searches run
+    std::size_t _scratch_sets;
+    std::size_t _searches;
 
 };
 
@@ -118,7 +167,7 @@ void DTree<N>::gdt_r(node_ptr_t node){
     find_splitter(node, splitter, quality, groups, g_qualities, g_stats);
     sw.stop();
     _log.node(node->_id, node->_level) << "Splitter found in " << sw.elapsed_ms() / 1000.0 << " sec."
-                                       << "\tId: " << splitter
+                                       << "\tId: " << external_item_id(splitter)
                                        << "\tQuality: " << quality << std::endl;
 
     if(quality <= node->_quality){
@@ -133,6 +182,7 @@ void DTree<N>::gdt_r(node_ptr_t node){
                 << "\tQuality: " << child->_quality << std::endl;
         //recursive call
         gdt_r(child.get());
+        release_node(child.get());
     }
 
 }
@@ -146,26 +196,30 @@ void DTree<N>::find_splitter(const node_cptr_t node,
                              std::vector<stat_map_t> &g_stats){
     const auto &candidates = node->candidates();
     if(candidates.empty()) return;
+    prepare_candidates(node, candidates);
+    ++_searches;
+    // scratch of the candidates run by each thread: variables private to the thread would be
+    // copied into every task, and the stat maps could not keep their memory across candidates
+    auto &thread_scratch = split_scratch();
 
     if(!_randomize){    // pick the best quality candidate
-        std::vector<std::vector<group_t>> cand_groups{_num_threads};
-        std::vector<std::vector<double>> cand_g_qualities{_num_threads};
-        std::vector<std::vector<stat_map_t>> cand_g_stats{_num_threads};
         std::vector<std::pair<id_type, double>> cand_best_qualities{_num_threads, std::make_pair(id_type{},
                                                                                               std::numeric_limits<double>::lowest())};
 
         // compute the qualiy of each candidate in parallel
     #pragma omp parallel num_threads(_num_threads)
         {
-            std::vector<group_t> c_groups;
-            std::vector<double> c_qualities;
-            std::vector<stat_map_t> c_stats;
     #pragma omp single nowait
             {
                 for(auto it_cand = candidates.cbegin(); it_cand != candidates.cend(); ++it_cand){
     #pragma omp task firstprivate(it_cand)
                     {
                         unsigned thread_id = omp_get_thread_num();
+                        auto &scratch = thread_scratch[thread_id];
+                        auto &c_groups = scratch._groups;
+                        auto &c_qualities = scratch._qualities;
+                        auto &c_stats = scratch._stats;
+                        if(c_stats.empty()) ++scratch._sets;
                         double cand_quality = split_quality(node,
                                                             *it_cand,
                                                             c_groups,
@@ -174,9 +228,9 @@ void DTree<N>::find_splitter(const node_cptr_t node,
                         if(cand_quality > cand_best_qualities[thread_id].second){
                             cand_best_qualities[thread_id].first = *it_cand;
                             cand_best_qualities[thread_id].second = cand_quality;
-                            cand_groups[thread_id].swap(c_groups);
-                            cand_g_qualities[thread_id].swap(c_qualities);
-                            cand_g_stats[thread_id].swap(c_stats);
+                            scratch._best_groups.swap(c_groups);
+                            scratch._best_qualities.swap(c_qualities);
+                            scratch._best_stats.swap(c_stats);
                         }
                     }
                 }
@@ -191,9 +245,9 @@ void DTree<N>::find_splitter(const node_cptr_t node,
         const auto best_thread = std::distance(cand_best_qualities.cbegin(), it_best);
         splitter = it_best->first;
         quality = it_best->second;
-        groups.swap(cand_groups[best_thread]);
-        g_qualities.swap(cand_g_qualities[best_thread]);
-        g_stats.swap(cand_g_stats[best_thread]);
+        groups.swap(thread_scratch[best_thread]._best_groups);
+        g_qualities.swap(thread_scratch[best_thread]._best_qualities);
+        g_stats.swap(thread_scratch[best_thread]._best_stats);
     }else{
         // pick a candidate with probability proportianal to his enhancement in quality
         //to reduce the memory footprint, we store just the candidate qualities, then recompute the groups just for the chosen one
@@ -203,14 +257,17 @@ void DTree<N>::find_splitter(const node_cptr_t node,
         // compute the qualiy of each candidate in parallel
     #pragma omp parallel num_threads(_num_threads)
         {
-            std::vector<group_t> c_groups;
-            std::vector<double> c_qualities;
-            std::vector<stat_map_t> c_stats;
     #pragma omp single
             {
                 for(auto it_cand = candidates.cbegin(); it_cand != candidates.cend(); ++it_cand){
     #pragma omp task firstprivate(it_cand)
                     {
+                        const unsigned thread_id = omp_get_thread_num();
+                        auto &scratch = thread_scratch[thread_id];
+                        auto &c_groups = scratch._groups;
+                        auto &c_qualities = scratch._qualities;
+                        auto &c_stats = scratch._stats;
+                        if(c_stats.empty()) ++scratch._sets;
                         const auto cand_idx = std::distance(candidates.cbegin(), it_cand);
                         cand_qualities[cand_idx] =
                                 std::make_pair(*it_cand,
@@ -1,122 +1,253 @@
 #ifndef EVALUATION_HPP
 #define EVALUATION_HPP
-#include <fstream>
-#include <sstream>
-#include <unordered_set>
+#include <future>
+#include <type_traits>
 #include "aux.hpp"
 #include "d_tree.hpp"
 #include "metrics.hpp"
+#include "ratings_io.hpp"
+#include "snapshot.hpp"
+#include "stopwatch.hpp"
+#include "user_profiles.hpp"
 
-using user_profiles_t = std::map<id_type, profile_t>;
-
-double build_profiles(const std::string &filename, user_profiles_t &profiles){
-    std::ifstream ifs(filename);
-    std::string line;
-    double sum{};
-    std::size_t n{};
-    while(std::getline(ifs, line)){
-        std::istringstream iss(line);
-        std::size_t user_id, item_id;
-        double rating;
-        iss >> user_id;
-        iss >> item_id;
-        iss >> rating;
-        if(profiles.count(user_id) == 0)
-            profiles[user_id].set_empty_key(-1);
-        profiles[user_id][item_id] = rating;
-        sum += rating;
-        ++n;
+using user_profiles_t = UserProfiles;
+
+// load the profiles with the same loaders used for the training data
+// returns the average rating
+double build_profiles(const std::string &filename, user_profiles_t &profiles, const unsigned num_threads = 1){
+    return profiles.assign(*open_ratings(filename, num_threads));
+}
+
+
+// load the answer and evaluation profiles on a background thread, e.g. while the tree is built
+// the future holds the loading time in ms, the profiles must not be touched before it is ready
+std::future<long long> build_profiles_async(const std::string &ans_file,
+                                            user_profiles_t &answers,
+                                            const std::string &eval_file,
+                                            user_profiles_t &eval,
+                                            const unsigned num_threads = 1){
+    return std::async(std::launch::async, [=, &answers, &eval]{
+        stopwatch sw;
+        sw.reset(); sw.start();
+        build_profiles(ans_file, answers, num_threads);
+        build_profiles(eval_file, eval, num_threads);
+        return sw.elapsed_ms();
+    });
+}
+
+// wait for the profiles, reporting how much of their loading was hidden behind other work
+void wait_profiles(std::future<long long> &loading){
+    stopwatch sw;
+    sw.reset(); sw.start();
+    const auto load_ms = loading.get();
+    const auto wait_ms = sw.elapsed_ms();
+    std::cout << "Profiles loaded in " << load_ms / 1000.0 << " s. (waited "
+              << wait_ms / 1000.0 << " s., " << std::max(load_ms - wait_ms, 0ll) / 1000.0
+              << " s. saved by overlapping with the build)" << std::endl;
+}
+
+// initialize the tree with the training data
+// with a snapshot directory, the prepared indices are loaded from the snapshot of the training file
+// when there is one, and saved after the initialization otherwise
+template<typename T>
+void init_training(T &dtree,
+                   const std::string &training_file,
+                   const double bu_reg,
+                   const unsigned num_threads,
+                   const std::string &snapshot_dir = ""){
+    stopwatch sw;
+    sw.reset(); sw.start();
+    std::string snapshot;
+    uint64_t hash{0u};
+    if(!snapshot_dir.empty()){
+        hash = content_hash(training_file, num_threads);
+        snapshot = snapshot_path(snapshot_dir, hash, bu_reg);
+        if(dtree.load_snapshot(snapshot, hash)){
+            std::cout << "Snapshot " << snapshot << " loaded in " << sw.elapsed_ms() / 1000.0 << " s." << std::endl;
+            return;
+        }
     }
-    return sum / n;
+    ParseStats parse_stats;
+    dtree.init(*open_ratings(training_file, num_threads, &parse_stats));
+    std::cout << "Training data loaded in " << parse_stats._elapsed_ms / 1000.0 << " s. ("
+              << parse_stats._ratings << " ratings, " << parse_stats.mb_per_sec() << " MB/s)" << std::endl;
+    if(!snapshot.empty() && dtree.save_snapshot(snapshot, hash))
+        std::cout << "Snapshot saved to " << snapshot << std::endl;
 }
 
+/*
+ * Per-level averages of a metric over the evaluated users.
+ * Every user adds its metric at each level of its path down the tree, so users can be fed
+ * one at a time, in any order and from any source of profiles.
+ */
+template<typename T>
+class LevelAccumulator{
+protected:
+    using tree_t = typename std::remove_reference<T>::type;
+
+    std::vector<double> _sums;
+    std::vector<int> _counts;
+public:
+    explicit LevelAccumulator(const tree_t &dtree) : _sums(dtree.depth_max(), .0), _counts(dtree.depth_max(), 0){}
+    virtual ~LevelAccumulator(){}
 
+    virtual void add_user(const tree_t &dtree, const ProfileView &answers, const ProfileView &test) = 0;
+
+    // the averages up to the first level no user reached
+    std::vector<double> result() const{
+        std::vector<double> metric_avg(_sums.size());
+        std::transform(_sums.begin(), _sums.end(),
+                       _counts.begin(), metric_avg.begin(),
+                       [this](const double &sum, const int &count){return count > 0 ? average(sum, count) : -1;});
+        // remove trailing elements
+        auto it = metric_avg.begin();
+        while(it != metric_avg.end() && *it != -1) ++it;
+        metric_avg.resize(std::distance(metric_avg.begin(), it));
+        return metric_avg;
+    }
+
+protected:
+    virtual double average(const double sum, const int count) const{
+        return sum / count;
+    }
+};
+
+// number of ratings added to the answers at each split
 template<typename T>
-std::vector<double> added_ratings(const T &dtree,
-                                   user_profiles_t &answers,
-                                   user_profiles_t &eval){
-    std::vector<double> metric_avg(dtree.depth_max(), .0);
-    std::vector<int> counts(dtree.depth_max(), 0);
-    for(const auto &ans : answers){
-        if(eval.count(ans.first) > 0){
-            unsigned level{0u};
-            auto node = dtree.root();
-            while(!node->is_leaf()){
-                int added = dtree.traverse(node, ans.second);
-                metric_avg[level] += static_cast<double>(added);
-                ++counts[level];
-                ++level;
-            }
+class AddedRatingsAcc : public LevelAccumulator<T>{
+    using typename LevelAccumulator<T>::tree_t;
+public:
+    using LevelAccumulator<T>::LevelAccumulator;
+
+    void add_user(const tree_t &dtree, const ProfileView &answers, const ProfileView &test __attribute__((unused))) override{
+        unsigned level{0u};
+        auto node = dtree.root();
+        while(!node->is_leaf()){
+            int added = dtree.traverse(node, answers);
+            this->_sums[level] += static_cast<double>(added);
+            ++this->_counts[level];
+            ++level;
+        }
+    }
+};
+
+template<typename T>
+class RmseAcc : public LevelAccumulator<T>{
+    using typename LevelAccumulator<T>::tree_t;
+public:
+    using LevelAccumulator<T>::LevelAccumulator;
+
+    void add_user(const tree_t &dtree, const ProfileView &answers, const ProfileView &test) override{
+        const auto test_ids = test.items();
+        unsigned level{0u};
+        auto node = dtree.root();
+        while(node != nullptr){
+            profile_t predicted = dtree.predict(node, test_ids);
+            std::pair<double, int> result = SqErr<>::eval(predicted, test);
+            this->_sums[level] += result.first;
+            this->_counts[level] += result.second;
+            dtree.traverse(node, answers);
+            ++level;
+        }
+    }
+
+protected:
+    double average(const double sum, const int count) const override{
+        return std::sqrt(sum / count);
+    }
+};
+
+template<typename T, typename Metric>
+class RankingAcc : public LevelAccumulator<T>{
+    using typename LevelAccumulator<T>::tree_t;
+public:
+    using LevelAccumulator<T>::LevelAccumulator;
+
+    void add_user(const tree_t &dtree, const ProfileView &answers, const ProfileView &test) override{
+        const auto test_ids = test.items();
+        unsigned level{0u};
+        auto node = dtree.root();
+        while(node != nullptr){
+            this->_sums[level] += Metric::eval(dtree.ranking(node, test_ids), test);
+            ++this->_counts[level];
+            dtree.traverse(node, answers);
+            ++level;
+        }
+    }
+};
+
+// feed the users with both answers and evaluation profiles to the accumulators, by increasing user id
+template<typename T>
+void evaluate_users(const T &dtree,
+                    const user_profiles_t &answers,
+                    const user_profiles_t &eval,
+                    const std::vector<LevelAccumulator<T>*> &metrics){
+    for(std::size_t uidx{0u}; uidx < answers.size(); ++uidx){
+        const auto eidx = eval.find(answers.user(uidx));
+        if(eidx != user_profiles_t::npos){
+            const auto ans = answers.profile(uidx);
+            const auto test = eval.profile(eidx);
+            for(auto metric : metrics)
+                metric->add_user(dtree, ans, test);
         }
     }
-    std::transform(metric_avg.begin(), metric_avg.end(),
-                   counts.begin(), metric_avg.begin(),
-                   [](const double &sum, const int &count){return count > 0 ? sum / count : -1;});
-    // remove trailing elements
-    auto it = metric_avg.begin();
-    while(it != metric_avg.end() && *it != -1) ++it;
-    metric_avg.resize(std::distance(metric_avg.begin(), it));
-    return metric_avg;
 }
 
+// same as evaluate_users, with the profiles read one user at a time from answer and evaluation
+// files sorted by user id: memory is bounded by the largest profile instead of the whole files
+// returns the number of evaluated users, throws UnsortedRatingsError if a file is not sorted
 template<typename T>
-std::vector<double> evaluate_rmse(const T &dtree,
-                                     user_profiles_t &answers,
-                                     user_profiles_t &eval){
-    std::vector<double> metric_avg(dtree.depth_max(), .0);
-    std::vector<int> counts(dtree.depth_max(), 0);
-    for(const auto &ans : answers){
-        if(eval.count(ans.first) > 0){
-            auto test_ids = extract_keys(eval.at(ans.first));
-            unsigned level{0u};
-            auto node = dtree.root();
-            while(node != nullptr){
-                profile_t predicted = dtree.predict(node, test_ids);
-                std::pair<double, int> result = SqErr<>::eval(predicted, eval.at(ans.first));
-                metric_avg[level] += result.first;
-                counts[level] += result.second;
-                dtree.traverse(node, ans.second);
-                ++level;
-            }
+std::size_t evaluate_users_streaming(const T &dtree,
+                                     const std::string &ans_file,
+                                     const std::string &eval_file,
+                                     const std::vector<LevelAccumulator<T>*> &metrics,
+                                     const unsigned num_threads = 1){
+    auto ans_source = open_ratings(ans_file, num_threads);
+    auto eval_source = open_ratings(eval_file, num_threads);
+    ProfileStream answers(*ans_source, ans_file), eval(*eval_source, eval_file);
+    std::size_t num_users{0u};
+    bool more_answers = answers.next(), more_eval = eval.next();
+    while(more_answers && more_eval){
+        if(answers.user() < eval.user()){
+            more_answers = answers.next();
+        }else if(eval.user() < answers.user()){
+            more_eval = eval.next();
+        }else{
+            for(auto metric : metrics)
+                metric->add_user(dtree, answers.profile(), eval.profile());
+            ++num_users;
+            more_answers = answers.next();
+            more_eval = eval.next();
         }
     }
-    std::transform(metric_avg.begin(), metric_avg.end(),
-                   counts.begin(), metric_avg.begin(),
-                   [](const double &sum, const int &count){return count > 0 ? std::sqrt(sum / count) : -1;});
-    // remove trailing elements
-    auto it = metric_avg.begin();
-    while(it != metric_avg.end() && *it != -1) ++it;
-    metric_avg.resize(std::distance(metric_avg.begin(), it));
-    return metric_avg;
+    return num_users;
+}
+
+template<typename T>
+std::vector<double> added_ratings(const T &dtree,
+                                   const user_profiles_t &answers,
+                                   const user_profiles_t &eval){
+    AddedRatingsAcc<T> added(dtree);
+    evaluate_users<T>(dtree, answers, eval, {&added});
+    return added.result();
+}
+
+template<typename T>
+std::vector<double> evaluate_rmse(const T &dtree,
+                                     const user_profiles_t &answers,
+                                     const user_profiles_t &eval){
+    RmseAcc<T> rmse(dtree);
+    evaluate_users<T>(dtree, answers, eval, {&rmse});
+    return rmse.result();
 }
 
 template<typename T, typename Metric, int RelTh = 4>
 std::vector<double> evaluate_ranking(const T &dtree,
-                                     user_profiles_t &answers,
-                                     user_profiles_t &eval){
-    std::vector<double> metric_avg(dtree.depth_max(), .0);
-    std::vector<int> counts(dtree.depth_max(), 0);
-    for(const auto &ans : answers){
-        if(eval.count(ans.first) > 0){
-            auto test_ids = extract_keys(eval.at(ans.first));
-            unsigned level{0u};
-            auto node = dtree.root();
-            while(node != nullptr){
-                metric_avg[level] += Metric::eval(dtree.ranking(node, test_ids), eval.at(ans.first));
-                ++counts[level];
-                dtree.traverse(node, ans.second);
-                ++level;
-            }
-        }
-    }
-    std::transform(metric_avg.begin(), metric_avg.end(),
-                   counts.begin(), metric_avg.begin(),
-                   [](const double &sum, const int &count){return count > 0 ? sum / count : -1;});
-    // remove trailing elements
-    auto it = metric_avg.begin();
-    while(it != metric_avg.end() && *it != -1) ++it;
-    metric_avg.resize(std::distance(metric_avg.begin(), it));
-    return metric_avg;
+                                     const user_profiles_t &answers,
+                                     const user_profiles_t &eval){
+    RankingAcc<T, Metric> ranking(dtree);
+    evaluate_users<T>(dtree, answers, eval, {&ranking});
+    return ranking.result();
 }
 
 #endif // EVALUATION_HPP
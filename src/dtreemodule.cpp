@@ -9,6 +9,14 @@
 
 namespace py = boost::python;
 
+// the IdOrder of a name, a ValueError in Python if there is none
+IdOrder parse_id_order(const std::string &name){
+    IdOrder order;
+    if(!find_id_order(name, order))
+        throw std::invalid_argument("Unknown id order: " + name + " (external, popularity or corating).");
+    return order;
+}
+
 constexpr int N = 10;
 using NDCGIndex = RankIndex<id_type, NDCG<N>>;
  
@@ -22,8 +30,10 @@ public:
                 const unsigned num_threads = 1,
                 const bool randomize = false,
                 const double rand_coeff = 10,
-                const bool cache_enabled = true) :
-        ABDTree(bu_reg, h_smooth, depth_max, ratings_min, top_pop, num_threads, randomize, rand_coeff, cache_enabled){}
+                const bool cache_enabled = true,
+                const std::string &id_order = "external") :
+        ABDTree(bu_reg, h_smooth, depth_max, ratings_min, top_pop, num_threads, randomize, rand_coeff, cache_enabled,
+                parse_id_order(id_order)){}
 
     void init_py(const py::list &training){
         std::vector<Rating> training_data;
@@ -74,8 +84,10 @@ public:
                const unsigned num_threads = 1,
                const bool randomize = false,
                const double rand_coeff = 10,
-               const bool cache_enabled = true) :
-        RankTree<R>(bu_reg, h_smooth, depth_max, ratings_min, top_pop, num_threads, randomize, rand_coeff, cache_enabled){}
+               const bool cache_enabled = true,
+               const std::string &id_order = "external") :
+        RankTree<R>(bu_reg, h_smooth, depth_max, ratings_min, top_pop, num_threads, randomize, rand_coeff, cache_enabled,
+                    parse_id_order(id_order)){}
 
     void init_py(const py::list &training){
         std::vector<Rating> training_data;
@@ -171,8 +183,8 @@ void expose_Traverser(const std::string &classname){
 
 BOOST_PYTHON_MODULE(dtreelib)
 {
-  expose_tree_methods(py::class_<ErrorTreePy, boost::noncopyable>("ErrorTreePy", py::init<double, double, unsigned, std::size_t, std::size_t, unsigned, bool, double, bool>()));
-  expose_tree_methods(py::class_<RankTreePy<NDCGIndex>, boost::noncopyable>("RankNDCGTreePy", py::init<double, double, unsigned, std::size_t, std::size_t, unsigned, bool, double, bool>()));
+  expose_tree_methods(py::class_<ErrorTreePy, boost::noncopyable>("ErrorTreePy", py::init<double, double, unsigned, std::size_t, std::size_t, unsigned, bool, double, bool, std::string>()));
+  expose_tree_methods(py::class_<RankTreePy<NDCGIndex>, boost::noncopyable>("RankNDCGTreePy", py::init<double, double, unsigned, std::size_t, std::size_t, unsigned, bool, double, bool, std::string>()));
   expose_Traverser<ErrorTreePy>("ErrorTreeTraverserPy");
   expose_Traverser<RankTreePy<NDCGIndex>>("RankNDCGTreeTraverserPy");
 }
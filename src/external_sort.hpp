@@ -0,0 +1,143 @@
+#ifndef EXTERNAL_SORT_HPP
+#define EXTERNAL_SORT_HPP
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+#include "mapped_file.hpp"
+
+/*
+ * External merge sort of trivially copyable records: the records are gathered in a buffer of a
+ * fixed size, which is sorted and appended to a scratch file as a run whenever it is full, and
+ * merge() streams the runs back in order with a buffer of its own for each of them.
+ * At most about buffer_bytes are held in memory at any time.
+ */
+template<typename Record, typename Compare = std::less<Record>>
+class ExternalSorter{
+    ScratchFile _file;
+    std::size_t _buffer_records;
+    std::vector<Record> _buffer;
+    // first record and number of records of each run in the scratch file
+    std::vector<std::pair<std::size_t, std::size_t>> _runs;
+    std::size_t _size;
+    Compare _compare;
+public:
+    // records are read back in chunks of at least this many per run
+    static constexpr std::size_t min_chunk = 1024u;
+
+    ExternalSorter(const std::string &dir, const std::size_t buffer_bytes, const Compare &compare = Compare{}) :
+        _file{dir}, _buffer_records{std::max<std::size_t>(buffer_bytes / sizeof(Record), min_chunk)},
+        _buffer{}, _runs{}, _size{0u}, _compare(compare){}
+
+    std::size_t size() const        {return _size;}
+    std::size_t num_runs() const    {return _runs.size() + (_buffer.empty() ? 0u : 1u);}
+
+    void push(const Record &record){
+        if(_buffer.size() == _buffer_records)
+            spill();
+        if(_buffer.capacity() < _buffer_records)
+            _buffer.reserve(_buffer_records);
+        _buffer.push_back(record);
+        ++_size;
+    }
+
+    // applies fn to all the records pushed so far, e.g. to relabel their ids, run by run
+    template<typename Fn>
+    void transform(Fn fn){
+        for(auto &record : _buffer)
+            fn(record);
+        for(const auto &run : _runs){
+            std::vector<Record> records(run.second);
+            _file.read(records.data(), run.second * sizeof(Record), run.first * sizeof(Record));
+            for(auto &record : records)
+                fn(record);
+            std::sort(records.begin(), records.end(), _compare);
+            _file.write(records.data(), run.second * sizeof(Record), run.first * sizeof(Record));
+        }
+    }
+
+    // calls fn on all the records in order, the sorter is left empty
+    template<typename Fn>
+    void merge(Fn fn){
+        if(_runs.empty()){
+            std::sort(_buffer.begin(), _buffer.end(), _compare);
+            for(const auto &record : _buffer)
+                fn(record);
+        }else{
+            if(!_buffer.empty())
+                spill();
+            std::vector<Record>().swap(_buffer);
+            merge_runs(fn);
+        }
+        std::vector<Record>().swap(_buffer);
+        _runs.clear();
+        _size = 0u;
+        _file.resize(0u);
+    }
+
+private:
+    void spill(){
+        std::sort(_buffer.begin(), _buffer.end(), _compare);
+        const std::size_t first = _runs.empty() ? 0u : _runs.back().first + _runs.back().second;
+        _file.write(_buffer.data(), _buffer.size() * sizeof(Record), first * sizeof(Record));
+        _runs.emplace_back(first, _buffer.size());
+        _buffer.clear();
+    }
+
+    // a run being merged: the records [_pos, _chunk.size()) of its chunk are next, then the
+    // ones from _next up to _end in the scratch file
+    struct Cursor{
+        std::vector<Record> _chunk;
+        std::size_t _pos, _next, _end;
+    };
+
+    template<typename Fn>
+    void merge_runs(Fn fn){
+        const std::size_t chunk = std::max(_buffer_records / _runs.size(), min_chunk);
+        std::vector<Cursor> cursors(_runs.size());
+        for(std::size_t run{0u}; run < _runs.size(); ++run){
+            cursors[run]._next = _runs[run].first;
+            cursors[run]._end = _runs[run].first + _runs[run].second;
+            refill(cursors[run], chunk);
+        }
+        // runs by their next record, ties go to the earlier run
+        auto later = [&](const std::size_t lhs, const std::size_t rhs){
+            const auto &l = cursors[lhs]._chunk[cursors[lhs]._pos];
+            const auto &r = cursors[rhs]._chunk[cursors[rhs]._pos];
+            return _compare(r, l) || (!_compare(l, r) && lhs > rhs);
+        };
+        std::priority_queue<std::size_t, std::vector<std::size_t>, decltype(later)> heap(later);
+        for(std::size_t run{0u}; run < cursors.size(); ++run)
+            if(!cursors[run]._chunk.empty())
+                heap.push(run);
+        while(!heap.empty()){
+            const auto run = heap.top();
+            heap.pop();
+            auto &cursor = cursors[run];
+            fn(cursor._chunk[cursor._pos]);
+            if(++cursor._pos == cursor._chunk.size())
+                refill(cursor, chunk);
+            if(!cursor._chunk.empty())
+                heap.push(run);
+        }
+    }
+
+    void refill(Cursor &cursor, const std::size_t chunk){
+        const std::size_t n = std::min(chunk, cursor._end - cursor._next);
+        cursor._chunk.resize(n);
+        if(n == 0u){
+            std::vector<Record>().swap(cursor._chunk);
+            return;
+        }
+        _file.read(cursor._chunk.data(), n * sizeof(Record), cursor._next * sizeof(Record));
+        cursor._next += n;
+        cursor._pos = 0u;
+    }
+};
+
+template<typename Record, typename Compare>
+constexpr std::size_t ExternalSorter<Record, Compare>::min_chunk;
+
+#endif // EXTERNAL_SORT_HPP
@@ -0,0 +1,379 @@
+#ifndef FLAT_HASH_MAP_HPP
+#define FLAT_HASH_MAP_HPP
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+ * Open-addressing hash map laid out as in the SwissTable family: the slots are a flat array
+ * and a control byte per slot holds 7 bits of the hash of its key, or marks it as empty or
+ * deleted. A lookup probes the control bytes in groups of 16 (one SSE2 compare, byte by byte
+ * elsewhere) and only reads the slots whose byte matches, a miss usually ends at the first
+ * group. Groups are probed in triangular order, the table is at most 7/8 full and doubles when
+ * it would get fuller.
+ * No key value is reserved, and the table can be sized for the expected number of keys on
+ * construction or with reserve().
+ */
+namespace flat_hash_detail{
+
+using ctrl_t = int8_t;
+constexpr ctrl_t empty = -128;
+constexpr ctrl_t deleted = -2;
+// after the last control byte, stops the iterations
+constexpr ctrl_t sentinel = -1;
+constexpr std::size_t group_width = 16u;
+
+// bit i is set for the matching control bytes among the 16 of a group
+struct Group{
+#if defined(__SSE2__)
+    __m128i _ctrl;
+    explicit Group(const ctrl_t *pos) : _ctrl{_mm_loadu_si128(reinterpret_cast<const __m128i*>(pos))}{}
+    uint32_t match(const ctrl_t h2) const{
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), _ctrl));
+    }
+    uint32_t match_empty() const{
+        return match(empty);
+    }
+    uint32_t match_empty_or_deleted() const{
+        return _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(sentinel), _ctrl));
+    }
+#else
+    ctrl_t _ctrl[group_width];
+    explicit Group(const ctrl_t *pos){
+        std::memcpy(_ctrl, pos, group_width);
+    }
+    uint32_t match(const ctrl_t h2) const{
+        uint32_t bits{0u};
+        for(std::size_t i{0u}; i < group_width; ++i)
+            bits |= static_cast<uint32_t>(_ctrl[i] == h2) << i;
+        return bits;
+    }
+    uint32_t match_empty() const{
+        return match(empty);
+    }
+    uint32_t match_empty_or_deleted() const{
+        uint32_t bits{0u};
+        for(std::size_t i{0u}; i < group_width; ++i)
+            bits |= static_cast<uint32_t>(_ctrl[i] < sentinel) << i;
+        return bits;
+    }
+#endif
+};
+
+}
+
+// std::hash is the identity for integers, its bits are mixed so that both the position (high
+// bits) and the control byte (low 7 bits) depend on the whole key
+template<typename K>
+struct FlatHash{
+    std::size_t operator()(const K &key) const{
+        uint64_t h = std::hash<K>()(key);
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 33;
+        return h;
+    }
+};
+
+template<typename K, typename V, typename Hash = FlatHash<K>, typename Equal = std::equal_to<K>>
+class FlatHashMap{
+    using ctrl_t = flat_hash_detail::ctrl_t;
+public:
+    using key_type = K;
+    using mapped_type = V;
+    using value_type = std::pair<const K, V>;
+    using size_type = std::size_t;
+
+    template<typename Value>
+    class basic_iterator : public std::iterator<std::forward_iterator_tag, Value>{
+        friend class FlatHashMap;
+        const ctrl_t *_ctrl;
+        Value *_slot;
+        basic_iterator(const ctrl_t *ctrl, Value *slot) : _ctrl{ctrl}, _slot{slot}{}
+        void skip_free(){
+            while(*_ctrl < flat_hash_detail::sentinel){
+                ++_ctrl;
+                ++_slot;
+            }
+        }
+    public:
+        basic_iterator() : _ctrl{nullptr}, _slot{nullptr}{}
+        // iterators convert to const_iterators
+        template<typename Other>
+        basic_iterator(const basic_iterator<Other> &other) : _ctrl{other._ctrl}, _slot{other._slot}{}
+
+        Value& operator*() const    {return *_slot;}
+        Value* operator->() const   {return _slot;}
+        basic_iterator& operator++(){
+            ++_ctrl;
+            ++_slot;
+            skip_free();
+            return *this;
+        }
+        basic_iterator operator++(int){
+            auto it = *this;
+            ++*this;
+            return it;
+        }
+        friend bool operator ==(const basic_iterator &lhs, const basic_iterator &rhs){return lhs._ctrl == rhs._ctrl;}
+        friend bool operator !=(const basic_iterator &lhs, const basic_iterator &rhs){return lhs._ctrl != rhs._ctrl;}
+        template<typename> friend class basic_iterator;
+    };
+    using iterator = basic_iterator<value_type>;
+    using const_iterator = basic_iterator<const value_type>;
+
+    FlatHashMap() : _ctrl{nullptr}, _slots{nullptr}, _capacity{0u}, _size{0u}, _growth_left{0u},
+        _hash{}, _equal{}{}
+    // sized for n keys
+    explicit FlatHashMap(const size_type n) : FlatHashMap(){
+        reserve(n);
+    }
+    FlatHashMap(std::initializer_list<value_type> init) : FlatHashMap(init.size()){
+        for(const auto &entry : init)
+            insert(entry);
+    }
+    FlatHashMap(const FlatHashMap &other) : FlatHashMap(other.size()){
+        for(const auto &entry : other)
+            insert(entry);
+    }
+    FlatHashMap(FlatHashMap &&other) : FlatHashMap(){
+        swap(other);
+    }
+    FlatHashMap& operator=(FlatHashMap other){
+        swap(other);
+        return *this;
+    }
+    ~FlatHashMap(){
+        destroy();
+    }
+
+    void swap(FlatHashMap &other){
+        std::swap(_ctrl, other._ctrl);
+        std::swap(_slots, other._slots);
+        std::swap(_capacity, other._capacity);
+        std::swap(_size, other._size);
+        std::swap(_growth_left, other._growth_left);
+    }
+
+    size_type size() const          {return _size;}
+    bool empty() const              {return _size == 0u;}
+    size_type bucket_count() const  {return _capacity;}
+
+    iterator begin(){
+        if(_capacity == 0u) return end();
+        iterator it(_ctrl, _slots);
+        it.skip_free();
+        return it;
+    }
+    iterator end()                  {return iterator(_ctrl + _capacity, _slots + _capacity);}
+    const_iterator begin() const    {return cbegin();}
+    const_iterator end() const      {return cend();}
+    const_iterator cbegin() const{
+        if(_capacity == 0u) return cend();
+        const_iterator it(_ctrl, _slots);
+        it.skip_free();
+        return it;
+    }
+    const_iterator cend() const     {return const_iterator(_ctrl + _capacity, _slots + _capacity);}
+
+    // make room for n keys without growing
+    void reserve(const size_type n){
+        const auto capacity = capacity_for(n);
+        if(capacity > _capacity)
+            rehash(capacity);
+    }
+    // same as reserve, as in google::dense_hash_map
+    void resize(const size_type n){
+        reserve(n);
+    }
+
+    void clear(){
+        for(size_type idx{0u}; idx < _capacity; ++idx)
+            if(is_full(_ctrl[idx]))
+                _slots[idx].~value_type();
+        if(_capacity > 0u)
+            std::memset(_ctrl, flat_hash_detail::empty, _capacity);
+        _size = 0u;
+        _growth_left = max_load(_capacity);
+    }
+
+    iterator find(const K &key){
+        const auto idx = find_index(key);
+        return idx == npos ? end() : iterator(_ctrl + idx, _slots + idx);
+    }
+    const_iterator find(const K &key) const{
+        const auto idx = find_index(key);
+        return idx == npos ? cend() : const_iterator(_ctrl + idx, _slots + idx);
+    }
+    size_type count(const K &key) const{
+        return find_index(key) == npos ? 0u : 1u;
+    }
+    V& at(const K &key){
+        const auto idx = find_index(key);
+        if(idx == npos)
+            throw std::out_of_range("Key not in map");
+        return _slots[idx].second;
+    }
+    const V& at(const K &key) const{
+        return const_cast<FlatHashMap*>(this)->at(key);
+    }
+
+    V& operator[](const K &key){
+        const auto slot = prepare_insert(key);
+        if(slot.second)
+            new (_slots + slot.first) value_type(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple());
+        return _slots[slot.first].second;
+    }
+
+    // inserts a (key, value) pair, unless the key is in the map already
+    template<typename P>
+    std::pair<iterator, bool> insert(P &&entry){
+        const auto slot = prepare_insert(entry.first);
+        if(slot.second)
+            new (_slots + slot.first) value_type(std::forward<P>(entry));
+        return std::make_pair(iterator(_ctrl + slot.first, _slots + slot.first), slot.second);
+    }
+
+    size_type erase(const K &key){
+        const auto idx = find_index(key);
+        if(idx == npos)
+            return 0u;
+        erase_index(idx);
+        return 1u;
+    }
+    void erase(const_iterator it){
+        erase_index(it._ctrl - _ctrl);
+    }
+
+private:
+    static constexpr size_type npos = static_cast<size_type>(-1);
+
+    static bool is_full(const ctrl_t ctrl)  {return ctrl >= 0;}
+    static size_type max_load(const size_type capacity)  {return capacity - capacity / 8u;}
+    // smallest power of two, of at least a group, that holds n keys
+    static size_type capacity_for(const size_type n){
+        if(n == 0u) return 0u;
+        size_type capacity{flat_hash_detail::group_width};
+        while(max_load(capacity) < n)
+            capacity *= 2u;
+        return capacity;
+    }
+
+    size_type hash(const K &key) const  {return _hash(key);}
+    static ctrl_t h2(const size_type hash)  {return static_cast<ctrl_t>(hash & 0x7Fu);}
+    size_type first_group(const size_type hash) const{
+        return (hash >> 7) & (_capacity - 1u) & ~(flat_hash_detail::group_width - 1u);
+    }
+
+    size_type find_index(const K &key) const{
+        if(_size == 0u) return npos;
+        const auto h = hash(key);
+        const auto mask = _capacity - 1u;
+        auto pos = first_group(h);
+        for(size_type step{flat_hash_detail::group_width}; ; step += flat_hash_detail::group_width){
+            const flat_hash_detail::Group group(_ctrl + pos);
+            for(auto bits = group.match(h2(h)); bits != 0u; bits &= bits - 1u){
+                const auto idx = pos + __builtin_ctz(bits);
+                if(_equal(_slots[idx].first, key))
+                    return idx;
+            }
+            if(group.match_empty() != 0u)
+                return npos;
+            pos = (pos + step) & mask;
+        }
+    }
+
+    // first empty or deleted slot on the probe sequence of a hash
+    size_type find_free(const size_type hash) const{
+        const auto mask = _capacity - 1u;
+        auto pos = first_group(hash);
+        for(size_type step{flat_hash_detail::group_width}; ; step += flat_hash_detail::group_width){
+            const auto bits = flat_hash_detail::Group(_ctrl + pos).match_empty_or_deleted();
+            if(bits != 0u)
+                return pos + __builtin_ctz(bits);
+            pos = (pos + step) & mask;
+        }
+    }
+
+    // slot of a key, and true if the slot is new and its value must be constructed
+    std::pair<size_type, bool> prepare_insert(const K &key){
+        const auto idx = find_index(key);
+        if(idx != npos)
+            return std::make_pair(idx, false);
+        const auto h = hash(key);
+        auto target = _capacity > 0u ? find_free(h) : npos;
+        if(target == npos || (_growth_left == 0u && _ctrl[target] != flat_hash_detail::deleted)){
+            // grow, or only drop the deleted slots when they take at least half of the load
+            rehash(_size + 1u > max_load(_capacity) / 2u ? capacity_for(_size + 1u) * 2u : _capacity);
+            target = find_free(h);
+        }
+        if(_ctrl[target] == flat_hash_detail::empty)
+            --_growth_left;
+        _ctrl[target] = h2(h);
+        ++_size;
+        return std::make_pair(target, true);
+    }
+
+    void erase_index(const size_type idx){
+        _slots[idx].~value_type();
+        _ctrl[idx] = flat_hash_detail::deleted;
+        --_size;
+    }
+
+    void rehash(const size_type capacity){
+        auto ctrl = std::allocator<ctrl_t>().allocate(capacity + 1u);
+        std::memset(ctrl, flat_hash_detail::empty, capacity);
+        ctrl[capacity] = flat_hash_detail::sentinel;
+        auto slots = std::allocator<value_type>().allocate(capacity);
+        std::swap(ctrl, _ctrl);
+        std::swap(slots, _slots);
+        const auto old_capacity = _capacity;
+        _capacity = capacity;
+        for(size_type idx{0u}; idx < old_capacity; ++idx){
+            if(!is_full(ctrl[idx])) continue;
+            const auto h = hash(slots[idx].first);
+            const auto target = find_free(h);
+            _ctrl[target] = h2(h);
+            new (_slots + target) value_type(std::move(slots[idx]));
+            slots[idx].~value_type();
+        }
+        _growth_left = max_load(_capacity) - _size;
+        if(old_capacity > 0u){
+            std::allocator<ctrl_t>().deallocate(ctrl, old_capacity + 1u);
+            std::allocator<value_type>().deallocate(slots, old_capacity);
+        }
+    }
+
+    void destroy(){
+        if(_capacity == 0u) return;
+        for(size_type idx{0u}; idx < _capacity; ++idx)
+            if(is_full(_ctrl[idx]))
+                _slots[idx].~value_type();
+        std::allocator<ctrl_t>().deallocate(_ctrl, _capacity + 1u);
+        std::allocator<value_type>().deallocate(_slots, _capacity);
+    }
+
+    ctrl_t *_ctrl;
+    value_type *_slots;
+    size_type _capacity;
+    size_type _size;
+    // empty slots that can be filled before the table grows
+    size_type _growth_left;
+    Hash _hash;
+    Equal _equal;
+};
+
+template<typename K, typename V, typename Hash, typename Equal>
+constexpr typename FlatHashMap<K, V, Hash, Equal>::size_type FlatHashMap<K, V, Hash, Equal>::npos;
+
+#endif // FLAT_HASH_MAP_HPP
@@ -0,0 +1,111 @@
+#ifndef ID_MAP_HPP
+#define ID_MAP_HPP
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+#include "types.hpp"
+
+/*
+ * Bijection between arbitrary external ids and contiguous internal ids in [0, size()).
+ * Internal ids are assigned in order of first appearance; sort() relabels them so that
+ * they follow the order of the external ids.
+ */
+class IdMap{
+    hash_map_t<id_type, dense_id_t> _to_dense;
+    std::vector<id_type> _to_external;
+public:
+    IdMap() : _to_dense{}, _to_external{}{}
+
+    std::size_t size() const    {return _to_external.size();}
+
+    // replace the mapping, the i-th external id gets internal id i
+    void assign(const id_type *first, const id_type *last){
+        _to_dense.clear();
+        _to_dense.reserve(last - first);
+        _to_external.assign(first, last);
+        for(dense_id_t dense{0u}; dense < _to_external.size(); ++dense)
+            _to_dense.insert(std::make_pair(_to_external[dense], dense));
+    }
+
+    const std::vector<id_type>& externals() const   {return _to_external;}
+
+    // return the internal id of an external one, assigning a new one if needed
+    dense_id_t insert(const id_type id){
+        auto it = _to_dense.find(id);
+        if(it != _to_dense.end())
+            return it->second;
+        const dense_id_t dense = _to_external.size();
+        _to_dense.insert(std::make_pair(id, dense));
+        _to_external.push_back(id);
+        return dense;
+    }
+
+    bool find(const id_type id, dense_id_t &dense) const{
+        auto it = _to_dense.find(id);
+        if(it == _to_dense.end())
+            return false;
+        dense = it->second;
+        return true;
+    }
+
+    bool contains(const id_type id) const{
+        return _to_dense.find(id) != _to_dense.end();
+    }
+
+    dense_id_t dense(const id_type id) const{
+        auto it = _to_dense.find(id);
+        if(it == _to_dense.end())
+            throw std::out_of_range("Unknown id " + std::to_string(id));
+        return it->second;
+    }
+
+    id_type external(const dense_id_t dense) const{
+        return _to_external[dense];
+    }
+
+    template<typename C>
+    std::vector<id_type> externals(const C &dense_ids) const{
+        std::vector<id_type> ids;
+        ids.reserve(dense_ids.size());
+        for(const auto &dense : dense_ids)
+            ids.push_back(_to_external[dense]);
+        return ids;
+    }
+
+    // relabel the internal ids in ascending order of the external ids
+    // returns the permutation from the old internal ids to the new ones
+    std::vector<dense_id_t> sort(){
+        std::vector<dense_id_t> order(size());
+        std::iota(order.begin(), order.end(), 0u);
+        std::sort(order.begin(), order.end(), [&](const dense_id_t lhs, const dense_id_t rhs){
+            return _to_external[lhs] < _to_external[rhs];
+        });
+        std::vector<dense_id_t> perm(size());
+        for(dense_id_t pos{0u}; pos < order.size(); ++pos)
+            perm[order[pos]] = pos;
+        relabel(perm);
+        return perm;
+    }
+
+    // apply a permutation from the current internal ids to new ones
+    void relabel(const std::vector<dense_id_t> &perm){
+        std::vector<id_type> to_external(size());
+        for(dense_id_t dense{0u}; dense < perm.size(); ++dense){
+            to_external[perm[dense]] = _to_external[dense];
+            _to_dense[_to_external[dense]] = perm[dense];
+        }
+        _to_external.swap(to_external);
+    }
+};
+
+// reorder values indexed by internal id according to a relabeling permutation
+template<typename T>
+void apply_permutation(std::vector<T> &values, const std::vector<dense_id_t> &perm){
+    std::vector<T> permuted(values.size());
+    for(std::size_t idx{0u}; idx < perm.size(); ++idx)
+        permuted[perm[idx]] = std::move(values[idx]);
+    values.swap(permuted);
+}
+
+#endif // ID_MAP_HPP
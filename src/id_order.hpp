@@ -0,0 +1,116 @@
+#ifndef ID_ORDER_HPP
+#define ID_ORDER_HPP
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <numeric>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "perf_counters.hpp"
+#include "stats.hpp"
+#include "types.hpp"
+
+/*
+ * Orders of the internal ids of the ABDTree indices, picked with the id_order argument of its
+ * constructor:
+ *  - external: the ids follow the external ids (the default);
+ *  - popularity: items and users by decreasing number of ratings, the users of the popular
+ *    splitters, that split_quality looks up in the user index, end up at its start;
+ *  - corating: items by popularity, users grouped by the two most popular items they rated, so
+ *    that the users who rated the same popular items sit next to each other.
+ * Only the internal ids change, the IdMaps translate them back to the external ones.
+ */
+enum class IdOrder{external = 0, popularity = 1, corating = 2};
+
+const char* order_name(const IdOrder order){
+    switch(order){
+    case IdOrder::popularity:   return "popularity";
+    case IdOrder::corating:     return "corating";
+    default:                    return "external";
+    }
+}
+
+// the order with the given name, false if there is none
+bool find_id_order(const std::string &name, IdOrder &order){
+    for(const auto candidate : {IdOrder::external, IdOrder::popularity, IdOrder::corating})
+        if(name == order_name(candidate)){
+            order = candidate;
+            return true;
+        }
+    return false;
+}
+
+// permutation from the ids to their rank by decreasing count, ties keep the order of the ids
+std::vector<dense_id_t> popularity_order(const std::vector<std::size_t> &counts){
+    std::vector<dense_id_t> order(counts.size());
+    std::iota(order.begin(), order.end(), 0u);
+    std::stable_sort(order.begin(), order.end(), [&counts](const dense_id_t lhs, const dense_id_t rhs){
+        return counts[lhs] > counts[rhs];
+    });
+    std::vector<dense_id_t> perm(order.size());
+    for(dense_id_t rank{0u}; rank < order.size(); ++rank)
+        perm[order[rank]] = rank;
+    return perm;
+}
+
+// permutation of the users of the rows, by the new ids of the two most popular items they rated
+// (item_perm is a popularity order), then by decreasing number of ratings
+template<typename Rows>
+std::vector<dense_id_t> corating_order(const Rows &user_rows, const std::vector<dense_id_t> &item_perm){
+    using key_t = std::tuple<dense_id_t, dense_id_t, std::size_t, dense_id_t>;
+    std::vector<key_t> keys;
+    keys.reserve(user_rows.size());
+    for(dense_id_t user{0u}; user < user_rows.size(); ++user){
+        dense_id_t first{std::numeric_limits<dense_id_t>::max()}, second{first};
+        for(const auto &score : user_rows[user]){
+            const auto item = item_perm[score._id];
+            if(item < first){
+                second = first;
+                first = item;
+            }else if(item < second && item != first){
+                second = item;
+            }
+        }
+        keys.emplace_back(first, second, std::numeric_limits<std::size_t>::max() - user_rows.num_scores(user), user);
+    }
+    std::sort(keys.begin(), keys.end());
+    std::vector<dense_id_t> perm(keys.size());
+    for(dense_id_t rank{0u}; rank < keys.size(); ++rank)
+        perm[std::get<3>(keys[rank])] = rank;
+    return perm;
+}
+
+// cache misses and time of the lookups of split_quality at the root, for the most popular
+// candidates: the users of each candidate are looked up in the user rows
+struct LocalityProbe{
+    static constexpr std::size_t num_candidates = 100u;
+    uint64_t _cache_misses;
+    double _ms;
+
+    template<typename ItemRows, typename UserRows>
+    static LocalityProbe run(const ItemRows &item_rows, const UserRows &user_rows){
+        std::vector<dense_id_t> candidates(item_rows.size());
+        std::iota(candidates.begin(), candidates.end(), 0u);
+        const auto n = std::min(num_candidates, candidates.size());
+        std::partial_sort(candidates.begin(), candidates.begin() + n, candidates.end(),
+                          [&item_rows](const dense_id_t lhs, const dense_id_t rhs){
+            return item_rows.num_scores(lhs) > item_rows.num_scores(rhs);
+        });
+        StatMap<id_type, ABDStats> stats;
+        CacheMissCounter counter;
+        const auto start = std::chrono::steady_clock::now();
+        counter.start();
+        for(std::size_t cand{0u}; cand < n; ++cand){
+            stats.clear();
+            for(const auto &score : item_rows[candidates[cand]])
+                user_rows.update_stats(stats, score._id);
+        }
+        const auto misses = counter.stop();
+        return LocalityProbe{misses, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()};
+    }
+};
+
+constexpr std::size_t LocalityProbe::num_candidates;
+
+#endif // ID_ORDER_HPP
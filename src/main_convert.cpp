@@ -0,0 +1,59 @@
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include "ratings.hpp"
+#include "ratings_bin.hpp"
+#include "ratings_stream.hpp"
+#include "stopwatch.hpp"
+
+void print_usage(){
+    std::cout << "TEXT <-> BINARY RATINGS CONVERSION" << std::endl
+              << "Usage: ./bdtree_convert <input-file> <output-file> [threads]" << std::endl
+              << "Text files (user item rating, optionally gzip/bzip2 compressed) are converted to the binary columnar format, binary files back to text." << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 3 || std::string(argv[1]) == "help"){
+        print_usage();
+        return 1;
+    }
+    std::string input_file(argv[1]);
+    std::string output_file(argv[2]);
+    unsigned num_threads = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 1u;
+
+    stopwatch sw;
+    sw.reset();
+    sw.start();
+    if(is_binary_ratings(input_file)){
+        BinaryRatings ratings(input_file);
+        std::ofstream ofs(output_file);
+        // enough digits to read the ratings back exactly
+        ofs.precision(std::numeric_limits<double>::max_digits10);
+        ratings.for_each_block([&](const Rating *first, const Rating *last){
+            for(auto rat = first; rat != last; ++rat)
+                ofs << rat->_user_id << " " << rat->_item_id << " " << rat->_value << "\n";
+        });
+        std::cout << "Written " << ratings.size() << " ratings to " << output_file
+                  << " in " << sw.elapsed_ms() / 1000.0 << " s." << std::endl;
+    }else{
+        ParseStats parse_stats;
+        std::vector<Rating> ratings;
+        if(compression_of(input_file) != Compression::NONE){
+            CompressedRatings(input_file, num_threads, &parse_stats).for_each_block([&](const Rating *first, const Rating *last){
+                ratings.insert(ratings.end(), first, last);
+            });
+        }else{
+            ratings = Rating::read_from(input_file, num_threads, &parse_stats);
+        }
+        std::cout << "Input parsed in " << parse_stats._elapsed_ms / 1000.0 << " s. ("
+                  << parse_stats._ratings << " ratings, " << parse_stats.mb_per_sec() << " MB/s)" << std::endl;
+        auto header = write_binary_ratings(output_file, ratings);
+        std::cout << "Num. users: " << header._num_users << " [" << header._min_user_id << ", " << header._max_user_id << "]" << std::endl
+                  << "Num. items: " << header._num_items << " [" << header._min_item_id << ", " << header._max_item_id << "]" << std::endl
+                  << "Ids: " << 8 * header.id_bytes() << " bit\tRatings: " << 8 * header.rating_bytes() << " bit" << std::endl
+                  << "Written " << header.file_size() << " bytes to " << output_file
+                  << " in " << sw.elapsed_ms() / 1000.0 << " s." << std::endl;
+    }
+    return 0;
+}
@@ -1,4 +1,5 @@
 #include "abd_tree.hpp"
+#include "ratings_io.hpp"
 #include "stopwatch.hpp"
 #include "d_tree_eval.hpp"
 
@@ -6,18 +7,25 @@ constexpr unsigned N = 10;
 
 void print_usage_build(){
     std::cout << "BUILD ONLY (no prediction / evaluation):" << std::endl
-              << "Usage: ./bdtree_error build <training-file> <lambda> <h-smooth> <max-depth> <min-ratings> <top-pop> <threads> <randomize> <rand-coeff>" << std::endl;
+              << "Usage: ./bdtree_error build <training-file> <lambda> <h-smooth> <max-depth> <min-ratings> <top-pop> <threads> <randomize> <rand-coeff> [snapshot-dir] [id-order]" << std::endl;
 }
 
 void print_usage_eval(){
     std::cout << "PREDICTION / EVALUATION" << std::endl
-              << "Usage: ./bdtree_error eval <training-file> <answer-file> <evaluation-file> <lambda> <h-smooth> <max-depth> <min-ratings> <top-pop> <threads> <randomize> <rand-coeff> <outfile>" << std::endl;
+              << "Usage: ./bdtree_error eval <training-file> <answer-file> <evaluation-file> <lambda> <h-smooth> <max-depth> <min-ratings> <top-pop> <threads> <randomize> <rand-coeff> <outfile> [snapshot-dir] [id-order]" << std::endl
+              << "Same arguments with 'stream' instead of 'eval' to read the answer and evaluation files one user at a time"
+              << " (both files must be sorted by user id)" << std::endl;
+}
+
+void print_usage_id_order(){
+    std::cout << "[id-order] orders the internal ids: external (default), popularity or corating,"
+              << " with an empty [snapshot-dir] to leave the snapshots off" << std::endl;
 }
 
 int main(int argc, char **argv)
 {
     if(argc < 2 || std::string(argv[1]) == "help"){
-        print_usage_build(); print_usage_eval();
+        print_usage_build(); print_usage_eval(); print_usage_id_order();
         return 1;
     }
     std::string mode(argv[1]);
@@ -35,13 +43,19 @@ int main(int argc, char **argv)
         unsigned num_threads = std::strtoul(argv[8], nullptr, 10);
         bool randomize = std::strtol(argv[9], nullptr, 10);
         double rand_coeff = std::strtod(argv[10], nullptr);
+        std::string snapshot_dir(argc > 11 ? argv[11] : "");
+        IdOrder id_order{IdOrder::external};
+        if(argc > 12 && !find_id_order(argv[12], id_order)){
+            print_usage_id_order();
+            return 1;
+        }
 
         stopwatch sw;
         sw.reset();
         sw.start();
         // build the decision tree
-        ABDTree bdtree{lambda, h_smoothing, max_depth, min_ratings, top_pop, num_threads, randomize, rand_coeff, false};
-        bdtree.init(Rating::read_from(training_file));
+        ABDTree bdtree{lambda, h_smoothing, max_depth, min_ratings, top_pop, num_threads, randomize, rand_coeff, false, id_order};
+        init_training(bdtree, training_file, lambda, num_threads, snapshot_dir);
         auto init_t = sw.elapsed_ms();
         std::cout << "Tree initialized in " << init_t / 1000.0 << " s." << std::endl ;
         bdtree.build();
@@ -50,7 +64,8 @@ int main(int argc, char **argv)
         std::cout << "Temporaries released. " << (sw.elapsed_ms() - init_t) / 1000.0 << " s." << std::endl;
         return 0;
 
-    }else if(mode == "eval"){
+    }else if(mode == "eval" || mode == "stream"){
+        const bool streaming = mode == "stream";
         if(argc < 14){
             print_usage_eval();
             return 1;
@@ -67,39 +82,63 @@ int main(int argc, char **argv)
         bool randomize = std::strtol(argv[11], nullptr, 10);
         double rand_coeff = std::strtod(argv[12], nullptr);
         std::string outfile(argv[13]);
+        std::string snapshot_dir(argc > 14 ? argv[14] : "");
+        IdOrder id_order{IdOrder::external};
+        if(argc > 15 && !find_id_order(argv[15], id_order)){
+            print_usage_id_order();
+            return 1;
+        }
 
         stopwatch sw;
         sw.reset();
         sw.start();
 
         // build the decision tree
-        ABDTree bdtree{lambda, h_smoothing, max_depth, min_ratings, top_pop, num_threads, randomize, rand_coeff, true};
-        bdtree.init(Rating::read_from(training_file));
+        ABDTree bdtree{lambda, h_smoothing, max_depth, min_ratings, top_pop, num_threads, randomize, rand_coeff, true, id_order};
+        init_training(bdtree, training_file, lambda, num_threads, snapshot_dir);
         auto init_t = sw.elapsed_ms();
         std::cout << "Tree initialized in " << init_t / 1000.0 << " s." << std::endl ;
+        // load the profiles while the tree is built, on a single thread to leave the cores to the build
+        // when streaming, the profiles are read during the evaluation instead
+        user_profiles_t answer_profiles, eval_profiles;
+        std::future<long long> profiles_loaded;
+        if(!streaming)
+            profiles_loaded = build_profiles_async(ans_file, answer_profiles, eval_file, eval_profiles);
         bdtree.build();
         std::cout << "Tree built in " << (sw.elapsed_ms() - init_t) / 1000.0 << " s." << std::endl ;
-
-        user_profiles_t answer_profiles, eval_profiles;
-        build_profiles(ans_file, answer_profiles);
-        build_profiles(eval_file, eval_profiles);
         std::ofstream ofs(outfile);
 
         // evaluate tree quality
-        std::cout << "EVALUATION:" << std::endl
-                  << "Num. test users: " << eval_profiles.size() << std::endl;
-        auto added = added_ratings<decltype(bdtree)>(bdtree, answer_profiles, eval_profiles);
-        ofs << "ADDED=["; print_range(ofs, added.cbegin(), added.cend()) << "]" << std::endl;
-        auto rmse = evaluate_rmse<decltype(bdtree)>(bdtree, answer_profiles, eval_profiles);
-        ofs << "RMSE=["; print_range(ofs, rmse.cbegin(), rmse.cend()) << "]" << std::endl;
-        auto p = evaluate_ranking<decltype(bdtree), Precision<N>>(bdtree, answer_profiles, eval_profiles);
-        ofs << "Precision_at_" << N << "=["; print_range(ofs, p.cbegin(), p.cend()) << "]" << std::endl;
-        auto map = evaluate_ranking<decltype(bdtree), AveragePrecision<N>>(bdtree, answer_profiles, eval_profiles);
-        ofs << "MAP_at_" << N << "=["; print_range(ofs, map.cbegin(), map.cend()) << "]" << std::endl;
-        auto ndcg = evaluate_ranking<decltype(bdtree), NDCG<N>>(bdtree, answer_profiles, eval_profiles);
-        ofs << "NDCG_at_" << N << "=["; print_range(ofs, ndcg.cbegin(), ndcg.cend()) << "]" << std::endl;
-        auto hlu = evaluate_ranking<decltype(bdtree), HLU<N,5>>(bdtree, answer_profiles, eval_profiles);
-        ofs << "HLU_at_" << N << "=["; print_range(ofs, hlu.cbegin(), hlu.cend()) << "]" << std::endl;
+        AddedRatingsAcc<ABDTree> added(bdtree);
+        RmseAcc<ABDTree> rmse(bdtree);
+        RankingAcc<ABDTree, Precision<N>> p(bdtree);
+        RankingAcc<ABDTree, AveragePrecision<N>> map(bdtree);
+        RankingAcc<ABDTree, NDCG<N>> ndcg(bdtree);
+        RankingAcc<ABDTree, HLU<N,5>> hlu(bdtree);
+        const std::vector<LevelAccumulator<ABDTree>*> metrics{&added, &rmse, &p, &map, &ndcg, &hlu};
+        if(streaming){
+            std::cout << "EVALUATION:" << std::endl;
+            try{
+                const auto num_users = evaluate_users_streaming(bdtree, ans_file, eval_file, metrics);
+                std::cout << "Num. evaluated users: " << num_users << std::endl;
+            }catch(const UnsortedRatingsError &e){
+                std::cerr << e.what() << std::endl
+                          << "The stream mode needs " << e.filename() << " sorted by user id, sort it or use the eval mode." << std::endl;
+                print_usage_eval();
+                return 1;
+            }
+        }else{
+            wait_profiles(profiles_loaded);
+            std::cout << "EVALUATION:" << std::endl
+                      << "Num. test users: " << eval_profiles.size() << std::endl;
+            evaluate_users(bdtree, answer_profiles, eval_profiles, metrics);
+        }
+        ofs << "ADDED=["; print_range(ofs, added.result()) << "]" << std::endl;
+        ofs << "RMSE=["; print_range(ofs, rmse.result()) << "]" << std::endl;
+        ofs << "Precision_at_" << N << "=["; print_range(ofs, p.result()) << "]" << std::endl;
+        ofs << "MAP_at_" << N << "=["; print_range(ofs, map.result()) << "]" << std::endl;
+        ofs << "NDCG_at_" << N << "=["; print_range(ofs, ndcg.result()) << "]" << std::endl;
+        ofs << "HLU_at_" << N << "=["; print_range(ofs, hlu.result()) << "]" << std::endl;
         std::cout << "Process completed in " << sw.elapsed_ms() / 1000.0  << " s." << std::endl;
         return 0;
 
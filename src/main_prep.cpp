@@ -0,0 +1,72 @@
+#include <iostream>
+#include "prep.hpp"
+#include "stopwatch.hpp"
+
+void print_usage(){
+    std::cout << "DATA PREPARATION" << std::endl
+              << "Usage: ./bdtree_prep kfold <input-file> <out-dir> [folds=4] [split-perc=0.75] [key=0] [delim=tab] [seed=0] [threads=1]" << std::endl
+              << "    k-fold split of the keys (users); the lines of each test key are further split into <split-perc> answers and evaluation." << std::endl
+              << "    Writes <out-dir>/s<i>/s<i>.{train,ans,eval}" << std::endl
+              << "Usage: ./bdtree_prep split <input-file> <out-dir> [perc=0.75] [seed=0] [threads=1]" << std::endl
+              << "    random split of the lines. Writes <out-dir>/<input-name>.{train,test}" << std::endl
+              << "Usage: ./bdtree_prep group <training-file> <test-file> <out-dir> [key=0] [sampling=1] [training-perc=0.75] [delim=tab] [seed=0] [threads=1]" << std::endl
+              << "    samples both files and splits them into disjoint sets of keys. Writes <out-dir>/<file-name>.{train,test} for both files" << std::endl
+              << "Usage: ./bdtree_prep renumber <csv-file> <output-file> [threads=1]" << std::endl
+              << "    maps the user and item ids of a \"user,item,rating\" file with header to consecutive integers, ratings are capped at 5" << std::endl
+              << "Usage: ./bdtree_prep probe <full-file> <probe-file> [threads=1]" << std::endl
+              << "    moves the Netflix probe ratings out of the \"user<TAB>item<TAB>rating\" file. Writes <full-file-name>.{train,test}" << std::endl;
+}
+
+// the delimiter given on the command line, "tab" and "\t" stand for a tab
+char parse_delim(const std::string &arg){
+    if(arg == "tab" || arg == "\\t" || arg.empty())
+        return '\t';
+    return arg[0];
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 2 || std::string(argv[1]) == "help"){
+        print_usage();
+        return 1;
+    }
+    std::string mode(argv[1]);
+    // optional positional argument
+    auto arg = [&](const int idx, const char *def){
+        return std::string(argc > idx ? argv[idx] : def);
+    };
+    stopwatch sw;
+    sw.reset();
+    sw.start();
+    if(mode == "kfold" && argc >= 4){
+        kfold(argv[2], argv[3],
+              std::strtoul(arg(4, "4").c_str(), nullptr, 10),
+              std::strtod(arg(5, "0.75").c_str(), nullptr),
+              std::strtoul(arg(6, "0").c_str(), nullptr, 10),
+              parse_delim(arg(7, "tab")),
+              std::strtoull(arg(8, "0").c_str(), nullptr, 10),
+              std::strtoul(arg(9, "1").c_str(), nullptr, 10));
+    }else if(mode == "split" && argc >= 4){
+        rand_split(argv[2], argv[3],
+                   std::strtod(arg(4, "0.75").c_str(), nullptr),
+                   std::strtoull(arg(5, "0").c_str(), nullptr, 10),
+                   std::strtoul(arg(6, "1").c_str(), nullptr, 10));
+    }else if(mode == "group" && argc >= 5){
+        group_split(argv[2], argv[3], argv[4],
+                    std::strtoul(arg(5, "0").c_str(), nullptr, 10),
+                    std::strtod(arg(6, "1").c_str(), nullptr),
+                    std::strtod(arg(7, "0.75").c_str(), nullptr),
+                    parse_delim(arg(8, "tab")),
+                    std::strtoull(arg(9, "0").c_str(), nullptr, 10),
+                    std::strtoul(arg(10, "1").c_str(), nullptr, 10));
+    }else if(mode == "renumber" && argc >= 4){
+        renumber(argv[2], argv[3], std::strtoul(arg(4, "1").c_str(), nullptr, 10));
+    }else if(mode == "probe" && argc >= 4){
+        probe_split(argv[2], argv[3], std::strtoul(arg(4, "1").c_str(), nullptr, 10));
+    }else{
+        print_usage();
+        return 1;
+    }
+    std::cout << "Done in " << sw.elapsed_ms() / 1000.0 << " s." << std::endl;
+    return 0;
+}
@@ -0,0 +1,147 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+ * Scratch files of the out-of-core indices (BDTREE_MAPPED_INDEX): the runs of the external sorts
+ * and the mapped scores. They are created in the directory given by the BDTREE_INDEX_DIR
+ * environment variable (TMPDIR, then /tmp, when unset) and unlinked at once, so that they go
+ * away with the process however it ends.
+ */
+std::string scratch_dir(){
+    for(const char *name : {"BDTREE_INDEX_DIR", "TMPDIR"}){
+        const char *env = std::getenv(name);
+        if(env != nullptr && *env != '\0')
+            return env;
+    }
+    return "/tmp";
+}
+
+// memory of the in-memory runs of the external sorts, BDTREE_SORT_MB megabytes (default 256)
+std::size_t sort_buffer_bytes(){
+    const char *env = std::getenv("BDTREE_SORT_MB");
+    const std::size_t mb = env != nullptr ? std::strtoull(env, nullptr, 10) : 0u;
+    return (mb > 0u ? mb : 256u) << 20;
+}
+
+// an unlinked file, closed on destruction
+class ScratchFile{
+    int _fd;
+public:
+    ScratchFile() : _fd{-1}{}
+    explicit ScratchFile(const std::string &dir) : _fd{-1}{
+        const std::string pattern = dir + "/bdtree-XXXXXX";
+        std::vector<char> path(pattern.cbegin(), pattern.cend());
+        path.push_back('\0');
+        _fd = ::mkstemp(path.data());
+        if(_fd < 0)
+            throw std::runtime_error("Unable to create a scratch file in " + dir + ": " + std::strerror(errno));
+        ::unlink(path.data());
+    }
+    ScratchFile(ScratchFile &&other) : _fd{other._fd}{
+        other._fd = -1;
+    }
+    ScratchFile& operator=(ScratchFile &&other){
+        std::swap(_fd, other._fd);
+        return *this;
+    }
+    ScratchFile(const ScratchFile&) = delete;
+    ScratchFile& operator=(const ScratchFile&) = delete;
+    ~ScratchFile(){
+        if(_fd >= 0) ::close(_fd);
+    }
+
+    int fd() const  {return _fd;}
+
+    void resize(const std::size_t bytes){
+        if(::ftruncate(_fd, bytes) != 0)
+            throw std::runtime_error(std::string("Unable to resize a scratch file: ") + std::strerror(errno));
+    }
+
+    void write(const void *data, const std::size_t bytes, const std::size_t offset){
+        auto first = static_cast<const char*>(data);
+        for(std::size_t done{0u}; done < bytes; ){
+            const auto n = ::pwrite(_fd, first + done, bytes - done, offset + done);
+            if(n < 0 && errno == EINTR) continue;
+            if(n <= 0)
+                throw std::runtime_error(std::string("Unable to write a scratch file: ") + std::strerror(errno));
+            done += n;
+        }
+    }
+
+    void read(void *data, const std::size_t bytes, const std::size_t offset) const{
+        auto first = static_cast<char*>(data);
+        for(std::size_t done{0u}; done < bytes; ){
+            const auto n = ::pread(_fd, first + done, bytes - done, offset + done);
+            if(n < 0 && errno == EINTR) continue;
+            if(n <= 0)
+                throw std::runtime_error(std::string("Unable to read a scratch file: ") + std::strerror(errno));
+            done += n;
+        }
+    }
+};
+
+/*
+ * Array of trivially copyable elements in a shared mapping of a scratch file: its pages are
+ * written back to the file instead of the swap, and the kernel can drop them whenever memory
+ * runs short.
+ */
+template<typename T>
+class MappedArray{
+    ScratchFile _file;
+    T *_data;
+    std::size_t _size;
+public:
+    MappedArray() : _file{}, _data{nullptr}, _size{0u}{}
+    MappedArray(const std::string &dir, const std::size_t size) : _file{dir}, _data{nullptr}, _size{size}{
+        if(_size == 0u) return;
+        _file.resize(_size * sizeof(T));
+        void *addr = ::mmap(nullptr, _size * sizeof(T), PROT_READ | PROT_WRITE, MAP_SHARED, _file.fd(), 0);
+        if(addr == MAP_FAILED)
+            throw std::runtime_error(std::string("Unable to map a scratch file: ") + std::strerror(errno));
+        _data = static_cast<T*>(addr);
+    }
+    MappedArray(MappedArray &&other) : _file{std::move(other._file)}, _data{other._data}, _size{other._size}{
+        other._data = nullptr;
+        other._size = 0u;
+    }
+    MappedArray& operator=(MappedArray &&other){
+        std::swap(_file, other._file);
+        std::swap(_data, other._data);
+        std::swap(_size, other._size);
+        return *this;
+    }
+    ~MappedArray(){
+        if(_data != nullptr) ::munmap(_data, _size * sizeof(T));
+    }
+
+    std::size_t size() const                    {return _size;}
+    T* data()                                   {return _data;}
+    const T* data() const                       {return _data;}
+    T& operator[](const std::size_t pos)        {return _data[pos];}
+    const T& operator[](const std::size_t pos) const    {return _data[pos];}
+
+    // hints the access pattern of the elements [first, last) to the kernel, see madvise(2)
+    // (hints only, failures are ignored)
+    void advise(const std::size_t first, const std::size_t last, const int advice) const{
+        if(first >= last) return;
+        static const std::size_t page = ::sysconf(_SC_PAGESIZE);
+        const auto begin = reinterpret_cast<std::size_t>(_data + first) & ~(page - 1);
+        const auto end = reinterpret_cast<std::size_t>(_data + last);
+        ::madvise(reinterpret_cast<void*>(begin), end - begin, advice);
+    }
+    void advise(const int advice) const{
+        advise(0u, _size, advice);
+    }
+};
+
+#endif // MAPPED_FILE_HPP
@@ -0,0 +1,204 @@
+#ifndef MAPPED_INDEX_HPP
+#define MAPPED_INDEX_HPP
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "csr_index.hpp"
+#include "external_sort.hpp"
+#include "mapped_file.hpp"
+#include "stats.hpp"
+
+/*
+ * Out-of-core variant of CSRIndex: the offsets stay in memory, the scores live in a mapped
+ * scratch file (see mapped_file.hpp) that the kernel pages in and out as needed, so that the
+ * indices of rating logs larger than the memory can still be built and partitioned.
+ *
+ * The index is filled from an external sort of (key, score) records and its scores are
+ * rearranged in place on the mapping. The scans of whole ranges are announced to the kernel:
+ * long ranges are prefetched before for_each() reads them and the passes over the whole index
+ * read ahead sequentially. With random_lookups the kernel reads ahead of nothing else, which suits
+ * indices looked up key by key, like the user index.
+ */
+template<typename Key, typename Stat, typename Score = typename Stat::score_t>
+class MappedIndex{
+public:
+    using score_t = Score;
+    using record_t = std::pair<dense_id_t, score_t>;
+    using sorter_t = ExternalSorter<record_t>;
+    using rows_t = CSRIndex<Key, Stat, Score>;
+    using entry_t = ScoreRange<score_t*>;
+    using const_entry_t = ScoreRange<const score_t*>;
+    using bound_t = typename rows_t::bound_t;
+    using range_iterator = score_t*;
+    using iterator = typename rows_t::template key_iterator<MappedIndex, entry_t>;
+    using const_iterator = typename rows_t::template key_iterator<const MappedIndex, const_entry_t>;
+    // scores are stored as they are, as in CSRIndex
+    static constexpr std::size_t block_size = 0u;
+    // ranges of at least this many bytes are prefetched before they are scanned
+    static constexpr std::size_t prefetch_bytes = 64u << 10;
+protected:
+    std::string _dir;
+    std::vector<std::size_t> _offsets;
+    MappedArray<score_t> _scores;
+    bool _random_lookups;
+public:
+    explicit MappedIndex(const std::string &dir = scratch_dir(), const bool random_lookups = false) :
+        _dir{dir}, _offsets(1, 0u), _scores{}, _random_lookups{random_lookups}{}
+    // takes the records of a sorter, for the keys 0..num_keys-1
+    MappedIndex(sorter_t &sorter, const std::size_t num_keys,
+                const std::string &dir = scratch_dir(), const bool random_lookups = false);
+    ~MappedIndex(){}
+
+    // accessors for some basic properties
+    std::size_t size() const                        {return _offsets.size() - 1;}
+    std::size_t num_scores() const                  {return _offsets.back();}
+    std::size_t num_scores(const Key &key) const    {return _offsets[key + 1] - _offsets[key];}
+    // bytes taken by the index in memory, the scores are mapped
+    std::size_t memory_bytes() const                {return _offsets.capacity() * sizeof(std::size_t);}
+    std::size_t mapped_bytes() const                {return _scores.size() * sizeof(score_t);}
+
+    entry_t operator[](const Key &key){
+        return entry_t(_scores.data() + _offsets[key], _scores.data() + _offsets[key + 1]);
+    }
+    const_entry_t operator[](const Key &key) const{
+        return const_entry_t(_scores.data() + _offsets[key], _scores.data() + _offsets[key + 1]);
+    }
+
+    iterator begin()                {return iterator(this, 0);}
+    iterator end()                  {return iterator(this, size());}
+    const_iterator begin() const    {return cbegin();}
+    const_iterator end() const      {return cend();}
+    const_iterator cbegin() const   {return const_iterator(this, 0);}
+    const_iterator cend() const     {return const_iterator(this, size());}
+
+    // return the -sorted- key vector
+    std::vector<Key> keys() const{
+        std::vector<Key> keys(size());
+        for(std::size_t key{0u}; key < size(); ++key)
+            keys[key] = key;
+        return keys;
+    }
+
+    // calls fn on the scores of a key in the positions [first, last)
+    template<typename Fn>
+    void for_each(const Key &key, const std::size_t first, const std::size_t last, Fn fn) const{
+        const auto begin = _offsets[key] + first, end = _offsets[key] + last;
+        if((end - begin) * sizeof(score_t) >= prefetch_bytes)
+            _scores.advise(begin, end, MADV_WILLNEED);
+        for(auto pos = begin; pos < end; ++pos)
+            fn(_scores[pos]);
+    }
+
+    // reorders the scores of each key within a range, in place, as CSRIndex::rearrange
+    template<typename RangeFn, typename Fn>
+    void rearrange(RangeFn range, Fn fn){
+        _scores.advise(MADV_SEQUENTIAL);
+        for(std::size_t key{0u}; key < size(); ++key){
+            const bound_t bounds = range(key);
+            fn(key, _scores.data() + _offsets[key] + bounds._left, _scores.data() + _offsets[key] + bounds._right);
+        }
+        default_advice();
+    }
+    // as rearrange, for the keys in [first_key, last_key) only (distinct); with more threads fn
+    // is called on several keys at once, it must only touch the range and the state of its key
+    template<typename KeyIt, typename RangeFn, typename Fn>
+    void rearrange(KeyIt first_key, KeyIt last_key, RangeFn range, Fn fn, const unsigned num_threads = 1u){
+        const long num_keys = std::distance(first_key, last_key);
+    #pragma omp parallel for schedule(dynamic, 16) num_threads(num_threads)
+        for(long idx = 0; idx < num_keys; ++idx){
+            const auto key = first_key[idx];
+            const bound_t bounds = range(key);
+            fn(key, _scores.data() + _offsets[key] + bounds._left, _scores.data() + _offsets[key] + bounds._right);
+        }
+    }
+
+    // drop the scores of the keys not in [first_key, last_key) (sorted), the keys stay with no
+    // scores; the kept scores are copied to a new scratch file
+    template<typename KeyIt>
+    void retain_keys(KeyIt first_key, KeyIt last_key){
+        std::vector<std::size_t> offsets(size() + 1, 0u);
+        for(std::size_t key{0u}; key < size(); ++key){
+            const bool kept = first_key != last_key && static_cast<std::size_t>(*first_key) == key;
+            offsets[key + 1] = offsets[key] + (kept ? num_scores(key) : 0u);
+            if(kept) ++first_key;
+        }
+        MappedArray<score_t> scores(_dir, offsets.back());
+        _scores.advise(MADV_SEQUENTIAL);
+        for(std::size_t key{0u}; key < size(); ++key)
+            if(offsets[key + 1] > offsets[key])
+                std::memcpy(scores.data() + offsets[key], _scores.data() + _offsets[key], num_scores(key) * sizeof(score_t));
+        _offsets.swap(offsets);
+        _scores = std::move(scores);
+        default_advice();
+    }
+
+    // the index is stored as offsets + scores, as a CSRIndex
+    template<typename Writer>
+    void write(Writer &writer) const{
+        const std::vector<uint64_t> offsets(_offsets.cbegin(), _offsets.cend());
+        writer.write(offsets.data(), offsets.size());
+        writer.write(_scores.data(), num_scores());
+    }
+    template<typename Reader>
+    void read(Reader &reader, const std::size_t num_keys, const std::size_t num_scores){
+        const auto offsets = reader.template read<uint64_t>(num_keys + 1);
+        _offsets.assign(offsets, offsets + num_keys + 1);
+        _scores = MappedArray<score_t>(_dir, num_scores);
+        if(num_scores > 0u)
+            std::memcpy(_scores.data(), reader.template read<score_t>(num_scores), num_scores * sizeof(score_t));
+        default_advice();
+    }
+
+    StatMap<Key, Stat> all_stats() const{
+        StatMap<Key, Stat>  stats{};
+        _scores.advise(MADV_SEQUENTIAL);
+        for(std::size_t key{0u}; key < size(); ++key)
+            update_stats(stats, key);
+        default_advice();
+        return stats;
+    }
+
+    // updates the stats with all the values associated to a given key
+    void update_stats(StatMap<Key, Stat> &stats, const Key key) const{
+        if(static_cast<std::size_t>(key) < size()){
+            for(auto pos = _offsets[key]; pos < _offsets[key + 1]; ++pos)
+                stats.update(_scores[pos]._id, _scores[pos]);
+        }
+    }
+
+private:
+    void default_advice() const{
+        _scores.advise(_random_lookups ? MADV_RANDOM : MADV_NORMAL);
+    }
+};
+
+template<typename Key, typename Stat, typename Score>
+constexpr std::size_t MappedIndex<Key, Stat, Score>::block_size;
+
+template<typename Key, typename Stat, typename Score>
+constexpr std::size_t MappedIndex<Key, Stat, Score>::prefetch_bytes;
+
+template<typename Key, typename Stat, typename Score>
+MappedIndex<Key, Stat, Score>::MappedIndex(sorter_t &sorter, const std::size_t num_keys,
+                                           const std::string &dir, const bool random_lookups) :
+    _dir{dir}, _offsets(num_keys + 1, 0u), _scores(dir, sorter.size()), _random_lookups{random_lookups}{
+    // the records come sorted by key, then by score, and are written out in that order
+    _scores.advise(MADV_SEQUENTIAL);
+    std::size_t pos{0u};
+    sorter.merge([&](const record_t &record){
+        if(record.first >= num_keys)
+            throw std::out_of_range("Key " + std::to_string(record.first) + " not in index");
+        ++_offsets[record.first + 1];
+        _scores[pos++] = record.second;
+    });
+    for(std::size_t key{0u}; key < num_keys; ++key)
+        _offsets[key + 1] += _offsets[key];
+    default_advice();
+}
+
+#endif // MAPPED_INDEX_HPP
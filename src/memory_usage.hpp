@@ -0,0 +1,31 @@
+#ifndef MEMORY_USAGE_HPP
+#define MEMORY_USAGE_HPP
+#include <cstddef>
+#include <fstream>
+#include <sys/resource.h>
+#include <unistd.h>
+
+// peak resident set size of the process, in bytes
+std::size_t peak_memory_bytes(){
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0) return 0u;
+#ifdef __APPLE__
+    return usage.ru_maxrss;
+#else
+    return static_cast<std::size_t>(usage.ru_maxrss) * 1024u;
+#endif
+}
+
+// current resident set size of the process, in bytes (0 where /proc is not available)
+std::size_t current_memory_bytes(){
+    std::size_t pages{0u}, resident{0u};
+    std::ifstream statm("/proc/self/statm");
+    if(!(statm >> pages >> resident)) return 0u;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+constexpr double to_mb(const std::size_t bytes){
+    return bytes / (1024.0 * 1024.0);
+}
+
+#endif // MEMORY_USAGE_HPP
@@ -5,6 +5,7 @@
 #include <iostream>
 #include "aux.hpp"
 #include "types.hpp"
+#include "user_profiles.hpp"
 
 /******************
  *
@@ -16,7 +17,8 @@
 
 template<typename Key = id_type>
 struct SqErr{
-    static std::pair<double, int> eval(profile_t &predicted, profile_t &actual){
+    template<typename Rel>
+    static std::pair<double, int> eval(profile_t &predicted, Rel &actual){
         double sq_err{.0};
         int n{0};
         for(const auto &act : actual){
@@ -27,6 +29,11 @@ struct SqErr{
         }
         return std::make_pair(sq_err, n);
     }
+    // actual ratings built in place, e.g. from a braced list
+    static std::pair<double, int> eval(profile_t &predicted, const profile_t &actual){
+        profile_t copy(actual);
+        return eval<profile_t>(predicted, copy);
+    }
 };
 
 
@@ -38,7 +45,8 @@ struct SqErr{
 
 template<std::size_t N = 10, int RelTh = 4, typename Key = id_type>
 struct Precision{
-    static double eval(const std::vector<Key> &ranking, hash_map_t<Key, double> &relevance){
+    template<typename Rel>
+    static double eval(const std::vector<Key> &ranking, Rel &relevance){
         std::size_t rel_count{0};
         auto it_end = ranking.size() > N ? ranking.cbegin() + N : ranking.cend();
         auto length = std::distance(ranking.cbegin(), it_end);
@@ -49,6 +57,11 @@ struct Precision{
         }
         return (double) rel_count / length;
     }
+    // relevances built in place, e.g. from a braced list
+    static double eval(const std::vector<Key> &ranking, const hash_map_t<Key, double> &relevance){
+        hash_map_t<Key, double> copy(relevance);
+        return eval<hash_map_t<Key, double>>(ranking, copy);
+    }
     static double eval_fast(const std::vector<Key> &ranking, __attribute__((unused))  const std::vector<Key> &best_ranking, hash_map_t<Key, double> &relevance){
         std::size_t rel_count{0};
         auto it_end = ranking.size() > N ? ranking.cbegin() + N : ranking.cend();
@@ -63,7 +76,8 @@ struct Precision{
 
 template<std::size_t N = 10, int RelTh = 4, typename Key = id_type>
 struct AveragePrecision{
-    static double eval(const std::vector<Key> &ranking, hash_map_t<Key, double> &relevance){
+    template<typename Rel>
+    static double eval(const std::vector<Key> &ranking, Rel &relevance){
         double p_at_k{.0};
         std::size_t num_relevant{0};
         for(const auto &entry : relevance)
@@ -82,6 +96,11 @@ struct AveragePrecision{
             return 0;
         }
     }
+    // relevances built in place, e.g. from a braced list
+    static double eval(const std::vector<Key> &ranking, const hash_map_t<Key, double> &relevance){
+        hash_map_t<Key, double> copy(relevance);
+        return eval<hash_map_t<Key, double>>(ranking, copy);
+    }
     static double eval_fast(const std::vector<Key> &ranking, __attribute__((unused))  const std::vector<Key> &best_ranking, hash_map_t<Key, double> &relevance){
         double p_at_k{.0};
         std::size_t num_relevant{0};
@@ -104,7 +123,8 @@ struct AveragePrecision{
 
 template<std::size_t N = 10, typename Key = id_type>
 struct NDCG{
-    static double eval(const std::vector<Key> &ranking, hash_map_t<Key, double> &relevance){
+    template<typename Rel>
+    static double eval(const std::vector<Key> &ranking, Rel &relevance){
         // best achievable ranking
         std::vector<Key> best_ranking(extract_keys(relevance));
         std::sort(best_ranking.begin(), best_ranking.end(),
@@ -113,11 +133,17 @@ struct NDCG{
         });
         return DCG(ranking, relevance) / DCG(best_ranking, relevance);
     }
+    // relevances built in place, e.g. from a braced list
+    static double eval(const std::vector<Key> &ranking, const hash_map_t<Key, double> &relevance){
+        hash_map_t<Key, double> copy(relevance);
+        return eval<hash_map_t<Key, double>>(ranking, copy);
+    }
     static double eval_fast(const std::vector<Key> &ranking, const std::vector<Key> &best_ranking, hash_map_t<Key, double> &relevance){
         return DCG_fast(ranking, relevance) / DCG_fast(best_ranking, relevance);
     }
 private:
-    static double DCG(const std::vector<Key> &ranking, hash_map_t<Key, double> &relevance){
+    template<typename Rel>
+    static double DCG(const std::vector<Key> &ranking, Rel &relevance){
         double dcg{.0};
         std::size_t rank{1};
         auto it_end = ranking.size() > N ? ranking.cbegin() + N : ranking.cend();
@@ -140,7 +166,8 @@ private:
 
 template<std::size_t N = 10, unsigned HL = 5, typename Key = id_type>
 struct HLU{
-    static double eval(const std::vector<Key> &ranking, hash_map_t<Key, double> &relevance){
+    template<typename Rel>
+    static double eval(const std::vector<Key> &ranking, Rel &relevance){
         // best achievable ranking
         std::vector<Key> best_ranking(extract_keys(relevance));
         std::sort(best_ranking.begin(), best_ranking.end(),
@@ -149,12 +176,18 @@ struct HLU{
         });
         return _HLU(ranking, relevance) / _HLU(best_ranking, relevance);
     }
+    // relevances built in place, e.g. from a braced list
+    static double eval(const std::vector<Key> &ranking, const hash_map_t<Key, double> &relevance){
+        hash_map_t<Key, double> copy(relevance);
+        return eval<hash_map_t<Key, double>>(ranking, copy);
+    }
     static double eval_fast(const std::vector<Key> &ranking, const std::vector<Key> &best_ranking, hash_map_t<Key, double> &relevance){
         return _HLU(ranking, relevance) / _HLU(best_ranking, relevance);
     }
 
 private:
-    static double _HLU(const std::vector<Key> &ranking, hash_map_t<Key, double> &relevance){
+    template<typename Rel>
+    static double _HLU(const std::vector<Key> &ranking, Rel &relevance){
         double hlu{.0};
         std::size_t rank{1};
         auto it_end = ranking.size() > N ? ranking.cbegin() + N : ranking.cend();
@@ -0,0 +1,491 @@
+#ifndef PACKED_INDEX_HPP
+#define PACKED_INDEX_HPP
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "csr_index.hpp"
+#include "external_sort.hpp"
+#include "score.hpp"
+#include "stats.hpp"
+
+// how the postings of a PackedIndex are rebuilt from an id, a rating and the shift of their key
+template<typename Score>
+struct PostingCodec;
+
+template<typename Value>
+struct PostingCodec<BasicItemScore<Value>>{
+    using value_t = Value;
+    static BasicItemScore<Value> decode(const dense_id_t id, const Value rating, __attribute__((unused)) const double shift){
+        return BasicItemScore<Value>(id, rating);
+    }
+};
+
+// the unbiased rating is the rating minus the shift of the key (the user bias), as in ABDTree::compute_biases
+template<typename Value>
+struct PostingCodec<BasicUserScore<Value>>{
+    using value_t = Value;
+    static BasicUserScore<Value> decode(const dense_id_t id, const Value rating, const double shift){
+        return BasicUserScore<Value>(id, rating, rating - shift);
+    }
+};
+
+/*
+ * Read-mostly variant of CSRIndex with the scores of each key packed in blocks of block_size.
+ * A block starts with its first id (4 bytes) and the bit width of its ids (1 byte), followed by
+ * the ids as deltas from the previous one and by the ratings as codes into the sorted table of
+ * the distinct ratings of the index, both bit-packed. Blocks whose ids are not sorted, as left
+ * by rearrange(), store the ids as offsets from the smallest one instead (high bit of the width).
+ * Scores with an unbiased rating get it back from the shift of their key (see PostingCodec).
+ *
+ * Keys are the internal ids 0..n-1, as in CSRIndex, and a range of the scores of a key is
+ * decoded block by block straight into the callers (for_each, update_stats).
+ *
+ * Every block is packed in a slot of fixed size, so that rearrange() writes the blocks it changes
+ * in place. The ids of a key never change, so a block packed in any order fits a slot as large as
+ * its ids at the bit width of the range of ids of its key; the indices that are never rearranged
+ * get slots as large as their blocks instead. The index is packed from sorted rows or straight
+ * from the sorted stream of an ExternalSorter, one key at a time.
+ */
+template<typename Key, typename Stat, typename Score = typename Stat::score_t>
+class PackedIndex{
+public:
+    using score_t = Score;
+    using rows_t = CSRIndex<Key, Stat, Score>;
+    using bound_t = typename rows_t::bound_t;
+    using range_iterator = typename rows_t::range_iterator;
+    using value_t = typename PostingCodec<Score>::value_t;
+    using record_t = std::pair<dense_id_t, score_t>;
+    using sorter_t = ExternalSorter<record_t>;
+    static constexpr std::size_t block_size = 128u;
+    // ratings beyond this many distinct values do not fit the 8-bit codes
+    static constexpr std::size_t max_values = 256u;
+protected:
+    // blocks are read 8 bytes at a time, the data is padded so that the last one can be
+    static constexpr std::size_t tail_padding = 8u;
+    static constexpr uint8_t unsorted_flag = 0x80u;
+    static constexpr std::size_t header_bytes = 5u;
+
+    std::vector<std::size_t> _offsets;
+    // first block of each key, its blocks are [_first_block[k], _first_block[k+1])
+    std::vector<std::size_t> _first_block;
+    // byte offset of the slot of each block in the data, the slot ends where the next one starts
+    std::vector<std::size_t> _block_offsets;
+    std::vector<value_t> _values;
+    unsigned _rating_bits;
+    std::vector<double> _shifts;
+    std::vector<uint8_t> _data;
+public:
+    PackedIndex() : _offsets(1, 0u), _first_block(1, 0u), _block_offsets(1, 0u), _values{}, _rating_bits{0u},
+        _shifts{}, _data(tail_padding, 0u){}
+    // packs sorted rows, shifts holds the shift of every key when the scores have unbiased ratings,
+    // without room to rearrange the slots are as large as the blocks
+    explicit PackedIndex(const rows_t &rows, const std::vector<double> &shifts = std::vector<double>{},
+                         const bool room_to_rearrange = true);
+    // packs the records merged by the sorter, which is left empty, for the keys 0..num_keys-1;
+    // values are the sorted distinct ratings of the records
+    PackedIndex(sorter_t &sorter, const std::size_t num_keys, const std::vector<value_t> &values,
+                const std::vector<double> &shifts = std::vector<double>{}, const bool room_to_rearrange = true);
+    ~PackedIndex(){}
+
+    // accessors for some basic properties
+    std::size_t size() const                            {return _offsets.size() - 1;}
+    std::size_t num_scores() const                      {return _offsets.back();}
+    std::size_t num_scores(const Key &key) const        {return _offsets[key + 1] - _offsets[key];}
+    const std::vector<value_t>& values() const          {return _values;}
+    // bytes taken by the index
+    std::size_t memory_bytes() const{
+        return (_offsets.capacity() + _first_block.capacity() + _block_offsets.capacity()) * sizeof(std::size_t) +
+                _values.capacity() * sizeof(value_t) + _shifts.capacity() * sizeof(double) + _data.capacity();
+    }
+
+    // return the -sorted- key vector
+    std::vector<Key> keys() const{
+        std::vector<Key> keys(size());
+        for(std::size_t key{0u}; key < size(); ++key)
+            keys[key] = key;
+        return keys;
+    }
+
+    // calls fn on the scores of a key in the positions [first, last)
+    template<typename Fn>
+    void for_each(const Key &key, const std::size_t first, const std::size_t last, Fn fn) const;
+
+    StatMap<Key, Stat> all_stats() const{
+        StatMap<Key, Stat>  stats{};
+        for(std::size_t key{0u}; key < size(); ++key)
+            update_stats(stats, key);
+        return stats;
+    }
+
+    // updates the stats with all the values associated to a given key
+    void update_stats(StatMap<Key, Stat> &stats, const Key key) const{
+        if(static_cast<std::size_t>(key) < size())
+            for_each(key, 0u, num_scores(key), [&stats](const score_t &score){stats.update(score._id, score);});
+    }
+
+    // reorders the scores of each key within a range, see CSRIndex::rearrange
+    // the blocks that overlap the ranges are decoded, handed to fn and packed again in their slots
+    template<typename RangeFn, typename Fn>
+    void rearrange(RangeFn range, Fn fn){
+        const auto all = keys();
+        rearrange(all.cbegin(), all.cend(), range, fn);
+    }
+    // as rearrange, for the keys in [first_key, last_key) only (sorted), the blocks of the other
+    // keys are left untouched; with more threads the keys are rearranged in parallel
+    template<typename KeyIt, typename RangeFn, typename Fn>
+    void rearrange(KeyIt first_key, KeyIt last_key, RangeFn range, Fn fn, const unsigned num_threads = 1u);
+
+    // drop the scores of the keys not in [first_key, last_key) (sorted), the keys stay with no scores
+    template<typename KeyIt>
+    void retain_keys(KeyIt first_key, KeyIt last_key);
+
+    template<typename Writer>
+    void write(Writer &writer) const;
+    template<typename Reader>
+    void read(Reader &reader, const std::size_t num_keys, const std::size_t num_scores);
+
+private:
+    static unsigned bit_width(const uint32_t value){
+        return value == 0u ? 0u : 32u - __builtin_clz(value);
+    }
+    // values are read and written 8 bytes at a time, there must be 8 bytes from the first one
+    static uint32_t read_bits(const uint8_t *data, const std::size_t bit, const unsigned width){
+        uint64_t word;
+        std::memcpy(&word, data + (bit >> 3), sizeof(word));
+        return (word >> (bit & 7u)) & ((uint64_t{1} << width) - 1u);
+    }
+    // the bits must be zero
+    static void write_bits(uint8_t *data, const std::size_t bit, const uint32_t value){
+        uint64_t word;
+        std::memcpy(&word, data + (bit >> 3), sizeof(word));
+        word |= static_cast<uint64_t>(value) << (bit & 7u);
+        std::memcpy(data + (bit >> 3), &word, sizeof(word));
+    }
+
+    // number of values smaller than a rating, its code if it is one of them
+    // ratings take few distinct values, a branchless scan beats a binary search on them
+    std::size_t rank(const value_t rating) const{
+        if(_values.size() > 32u)
+            return std::lower_bound(_values.cbegin(), _values.cend(), rating) - _values.cbegin();
+        std::size_t rank{0u};
+        for(const auto value : _values)
+            rank += value < rating;
+        return rank;
+    }
+    // appends the block of n scores
+    void encode_block(const score_t *scores, const std::size_t n, std::vector<uint8_t> &out) const;
+    // appends the slots of the blocks of the next key, packed from its n sorted scores
+    void append_key(const score_t *scores, const std::size_t n, const bool room_to_rearrange);
+    // sets the rating codes from the sorted distinct ratings
+    void init_values(const std::vector<value_t> &values);
+    // decodes the first m ids and rating codes of a block of n scores
+    void decode_block(const std::size_t block, const std::size_t n, const std::size_t m,
+                      dense_id_t *ids, uint8_t *codes) const;
+    // block offsets of the first and last + 1 blocks of each key, from the offsets
+    void init_blocks();
+};
+
+template<typename Key, typename Stat, typename Score>
+constexpr std::size_t PackedIndex<Key, Stat, Score>::block_size;
+template<typename Key, typename Stat, typename Score>
+constexpr std::size_t PackedIndex<Key, Stat, Score>::max_values;
+template<typename Key, typename Stat, typename Score>
+constexpr std::size_t PackedIndex<Key, Stat, Score>::tail_padding;
+
+template<typename Key, typename Stat, typename Score>
+PackedIndex<Key, Stat, Score>::PackedIndex(const rows_t &rows, const std::vector<double> &shifts, const bool room_to_rearrange) :
+    _offsets(1, 0u), _first_block(1, 0u), _block_offsets{}, _values{}, _rating_bits{0u}, _shifts(shifts), _data{}{
+    if(!_shifts.empty() && _shifts.size() != rows.size())
+        throw std::invalid_argument("One shift per key is needed.");
+    std::vector<value_t> values;
+    for(const auto &score : rows.scores()){
+        const auto pos = std::lower_bound(values.cbegin(), values.cend(), score._rating);
+        if(pos == values.cend() || *pos != score._rating)
+            values.insert(pos, score._rating);
+    }
+    init_values(values);
+    _data.reserve(rows.num_scores() * 2u);
+    for(std::size_t key{0u}; key < rows.size(); ++key)
+        append_key(rows.scores().data() + rows.offsets()[key], rows.num_scores(key), room_to_rearrange);
+    _block_offsets.push_back(_data.size());
+    _data.resize(_data.size() + tail_padding, 0u);
+    _data.shrink_to_fit();
+#ifndef NDEBUG
+    for(std::size_t key{0u}; key < size(); ++key){
+        auto pos = _offsets[key];
+        for_each(key, 0u, num_scores(key), [&](const score_t &score){assert(score == rows.scores()[pos++]);});
+    }
+#endif
+}
+
+template<typename Key, typename Stat, typename Score>
+PackedIndex<Key, Stat, Score>::PackedIndex(sorter_t &sorter, const std::size_t num_keys, const std::vector<value_t> &values,
+                                           const std::vector<double> &shifts, const bool room_to_rearrange) :
+    _offsets(1, 0u), _first_block(1, 0u), _block_offsets{}, _values{}, _rating_bits{0u}, _shifts(shifts), _data{}{
+    if(!_shifts.empty() && _shifts.size() != num_keys)
+        throw std::invalid_argument("One shift per key is needed.");
+    init_values(values);
+    // the records come sorted by key, then by score, only the scores of one key are held at a time
+    std::vector<score_t> scores;
+    auto next_key = [&](){
+        append_key(scores.data(), scores.size(), room_to_rearrange);
+        scores.clear();
+    };
+    sorter.merge([&](const record_t &record){
+        if(record.first >= num_keys)
+            throw std::out_of_range("Key " + std::to_string(record.first) + " not in index");
+        const auto code = rank(record.second._rating);
+        if(code == _values.size() || _values[code] != record.second._rating)
+            throw std::invalid_argument("Rating " + std::to_string(record.second._rating) + " not in the values of the index");
+        while(size() < record.first)
+            next_key();
+        scores.push_back(record.second);
+    });
+    while(size() < num_keys)
+        next_key();
+    _block_offsets.push_back(_data.size());
+    _data.resize(_data.size() + tail_padding, 0u);
+    _data.shrink_to_fit();
+}
+
+template<typename Key, typename Stat, typename Score>
+void PackedIndex<Key, Stat, Score>::init_values(const std::vector<value_t> &values){
+    if(values.size() > max_values)
+        throw std::runtime_error("Too many distinct ratings to pack the index (max " +
+                                 std::to_string(max_values) + ").");
+    if(std::adjacent_find(values.cbegin(), values.cend(), std::greater_equal<value_t>()) != values.cend())
+        throw std::invalid_argument("The values of the index must be sorted and distinct.");
+    _values = values;
+    _rating_bits = _values.empty() ? 0u : bit_width(_values.size() - 1);
+}
+
+template<typename Key, typename Stat, typename Score>
+void PackedIndex<Key, Stat, Score>::append_key(const score_t *scores, const std::size_t n, const bool room_to_rearrange){
+    // the bit width of the ids of the key, in any order
+    uint32_t min_id{n == 0u ? 0u : scores[0]._id}, max_id{min_id};
+    for(std::size_t i{1u}; i < n; ++i){
+        min_id = std::min<uint32_t>(min_id, scores[i]._id);
+        max_id = std::max<uint32_t>(max_id, scores[i]._id);
+    }
+    const unsigned id_bits = bit_width(max_id - min_id);
+    for(std::size_t first{0u}; first < n; first += block_size){
+        const auto block_n = std::min(block_size, n - first);
+        _block_offsets.push_back(_data.size());
+        encode_block(scores + first, block_n, _data);
+        if(room_to_rearrange)
+            _data.resize(_block_offsets.back() + header_bytes + (block_n * (id_bits + _rating_bits) + 7u) / 8u, 0u);
+    }
+    _offsets.push_back(_offsets.back() + n);
+    _first_block.push_back(_block_offsets.size());
+}
+
+template<typename Key, typename Stat, typename Score>
+void PackedIndex<Key, Stat, Score>::init_blocks(){
+    _first_block.assign(size() + 1, 0u);
+    for(std::size_t key{0u}; key < size(); ++key)
+        _first_block[key + 1] = _first_block[key] + (num_scores(key) + block_size - 1) / block_size;
+    _block_offsets.assign(_first_block.back() + 1, 0u);
+}
+
+template<typename Key, typename Stat, typename Score>
+void PackedIndex<Key, Stat, Score>::encode_block(const score_t *scores,
+                                                 const std::size_t n,
+                                                 std::vector<uint8_t> &out) const{
+    bool sorted{true};
+    uint32_t min_id{scores[0]._id}, max_id{scores[0]._id}, max_delta{0u};
+    for(std::size_t i{1u}; i < n; ++i){
+        sorted = sorted && scores[i]._id >= scores[i - 1]._id;
+        max_delta = std::max<uint32_t>(max_delta, scores[i]._id - scores[i - 1]._id);
+        min_id = std::min<uint32_t>(min_id, scores[i]._id);
+        max_id = std::max<uint32_t>(max_id, scores[i]._id);
+    }
+    const uint32_t base = sorted ? scores[0]._id : min_id;
+    const unsigned id_bits = bit_width(sorted ? max_delta : max_id - min_id);
+    const std::size_t num_bits = (sorted ? n - 1 : n) * id_bits + n * _rating_bits;
+    const auto pos = out.size();
+    // zeroed room for the block and for the 8-byte writes past its end
+    out.resize(pos + header_bytes + (num_bits + 7u) / 8u + tail_padding, 0u);
+    uint8_t *data = out.data() + pos;
+    std::memcpy(data, &base, sizeof(base));
+    data[4] = static_cast<uint8_t>(id_bits | (sorted ? 0u : unsorted_flag));
+    data += header_bytes;
+    std::size_t bit{0u};
+    for(std::size_t i = sorted ? 1u : 0u; i < n; ++i, bit += id_bits)
+        write_bits(data, bit, scores[i]._id - (sorted ? scores[i - 1]._id : base));
+    for(std::size_t i{0u}; i < n; ++i, bit += _rating_bits){
+        assert(_values[rank(scores[i]._rating)] == scores[i]._rating);
+        write_bits(data, bit, rank(scores[i]._rating));
+    }
+    out.resize(out.size() - tail_padding);
+}
+
+template<typename Key, typename Stat, typename Score>
+void PackedIndex<Key, Stat, Score>::decode_block(const std::size_t block,
+                                                 const std::size_t n,
+                                                 const std::size_t m,
+                                                 dense_id_t *ids,
+                                                 uint8_t *codes) const{
+    const uint8_t *data = _data.data() + _block_offsets[block];
+    uint32_t base;
+    std::memcpy(&base, data, sizeof(base));
+    const bool sorted = (data[4] & unsorted_flag) == 0u;
+    const unsigned id_bits = data[4] & ~unsorted_flag;
+    data += header_bytes;
+    std::size_t bit{0u};
+    if(sorted){
+        ids[0] = base;
+        for(std::size_t i{1u}; i < m; ++i, bit += id_bits)
+            ids[i] = ids[i - 1] + read_bits(data, bit, id_bits);
+    }else{
+        for(std::size_t i{0u}; i < m; ++i, bit += id_bits)
+            ids[i] = base + read_bits(data, bit, id_bits);
+    }
+    bit = (sorted ? n - 1 : n) * id_bits;
+    for(std::size_t i{0u}; i < m; ++i, bit += _rating_bits)
+        codes[i] = read_bits(data, bit, _rating_bits);
+}
+
+template<typename Key, typename Stat, typename Score>
+template<typename Fn>
+void PackedIndex<Key, Stat, Score>::for_each(const Key &key,
+                                             const std::size_t first,
+                                             const std::size_t last,
+                                             Fn fn) const{
+    dense_id_t ids[block_size];
+    uint8_t codes[block_size];
+    const double shift = _shifts.empty() ? .0 : _shifts[key];
+    const auto row_size = num_scores(key);
+    for(auto pos = first - first % block_size; pos < last; pos += block_size){
+        const auto n = std::min(block_size, row_size - pos);
+        const auto end = std::min(n, last - pos);
+        decode_block(_first_block[key] + pos / block_size, n, end, ids, codes);
+        for(auto i = pos < first ? first - pos : 0u; i < end; ++i)
+            fn(PostingCodec<Score>::decode(ids[i], _values[codes[i]], shift));
+    }
+}
+
+template<typename Key, typename Stat, typename Score>
+template<typename KeyIt, typename RangeFn, typename Fn>
+void PackedIndex<Key, Stat, Score>::rearrange(KeyIt first_key, KeyIt last_key, RangeFn range, Fn fn,
+                                              const unsigned num_threads){
+    const long num_keys = std::distance(first_key, last_key);
+    // keys whose blocks did not fit their slots, left as they were
+    std::size_t overflows{0u};
+#pragma omp parallel num_threads(num_threads) reduction(+:overflows)
+    {
+        // the range handed to fn, a copy of it, the blocks it overlaps and their packed bytes
+        std::vector<score_t> range_scores, original, scores;
+        std::vector<uint8_t> packed;
+        std::vector<std::size_t> packed_offsets;
+    #pragma omp for schedule(dynamic, 16)
+        for(long idx = 0; idx < num_keys; ++idx){
+            const std::size_t key = first_key[idx];
+            const bound_t bounds = range(key);
+            range_scores.clear();
+            for_each(key, bounds._left, bounds._right, [&range_scores](const score_t &score){range_scores.push_back(score);});
+            original.assign(range_scores.cbegin(), range_scores.cend());
+            fn(key, range_scores.begin(), range_scores.end());
+            if(range_scores == original)
+                continue;
+            const auto first = bounds._left / block_size * block_size;
+            const auto last = std::min((bounds._right + block_size - 1) / block_size * block_size, num_scores(key));
+            scores.clear();
+            for_each(key, first, last, [&scores](const score_t &score){scores.push_back(score);});
+            std::copy(range_scores.cbegin(), range_scores.cend(), scores.begin() + (bounds._left - first));
+            packed.clear();
+            packed_offsets.clear();
+            bool fits{true};
+            const auto first_block = _first_block[key] + first / block_size;
+            for(auto pos = first; pos < last; pos += block_size){
+                packed_offsets.push_back(packed.size());
+                encode_block(scores.data() + (pos - first), std::min(block_size, last - pos), packed);
+                const auto block = first_block + packed_offsets.size() - 1;
+                fits = fits && packed.size() - packed_offsets.back() <= _block_offsets[block + 1] - _block_offsets[block];
+            }
+            if(!fits){
+                ++overflows;
+                continue;
+            }
+            // the slots of a key are its own, the threads write disjoint bytes
+            packed_offsets.push_back(packed.size());
+            for(std::size_t block{0u}; block + 1 < packed_offsets.size(); ++block)
+                std::memcpy(_data.data() + _block_offsets[first_block + block], packed.data() + packed_offsets[block],
+                            packed_offsets[block + 1] - packed_offsets[block]);
+        }
+    }
+    if(overflows > 0u)
+        throw std::runtime_error("The blocks of " + std::to_string(overflows) +
+                                 " keys do not fit their slots, the index was packed without room to rearrange.");
+}
+
+template<typename Key, typename Stat, typename Score>
+template<typename KeyIt>
+void PackedIndex<Key, Stat, Score>::retain_keys(KeyIt first_key, KeyIt last_key){
+    std::vector<std::size_t> offsets(size() + 1, 0u), first_block(size() + 1, 0u), block_offsets;
+    std::vector<uint8_t> data;
+    for(std::size_t key{0u}; key < size(); ++key){
+        const bool kept = first_key != last_key && static_cast<std::size_t>(*first_key) == key;
+        offsets[key + 1] = offsets[key];
+        first_block[key + 1] = first_block[key];
+        if(!kept) continue;
+        ++first_key;
+        offsets[key + 1] += num_scores(key);
+        first_block[key + 1] += _first_block[key + 1] - _first_block[key];
+        const auto first = _block_offsets[_first_block[key]];
+        for(auto block = _first_block[key]; block < _first_block[key + 1]; ++block)
+            block_offsets.push_back(data.size() + _block_offsets[block] - first);
+        data.insert(data.end(), _data.cbegin() + first, _data.cbegin() + _block_offsets[_first_block[key + 1]]);
+    }
+    block_offsets.push_back(data.size());
+    data.resize(data.size() + tail_padding, 0u);
+    data.shrink_to_fit();
+    _offsets.swap(offsets);
+    _first_block.swap(first_block);
+    _block_offsets.swap(block_offsets);
+    _data.swap(data);
+}
+
+// the index is stored as the numbers of values, shifts and bytes, then the arrays
+template<typename Key, typename Stat, typename Score>
+template<typename Writer>
+void PackedIndex<Key, Stat, Score>::write(Writer &writer) const{
+    const uint64_t sizes[3] = {_values.size(), _shifts.size(), _block_offsets.back()};
+    writer.write(sizes, 3u);
+    const std::vector<uint64_t> offsets(_offsets.cbegin(), _offsets.cend());
+    writer.write(offsets.data(), offsets.size());
+    const std::vector<uint64_t> block_offsets(_block_offsets.cbegin(), _block_offsets.cend());
+    writer.write(block_offsets.data(), block_offsets.size());
+    writer.write(_values.data(), _values.size());
+    writer.write(_shifts.data(), _shifts.size());
+    writer.write(_data.data(), _block_offsets.back());
+}
+
+template<typename Key, typename Stat, typename Score>
+template<typename Reader>
+void PackedIndex<Key, Stat, Score>::read(Reader &reader, const std::size_t num_keys, const std::size_t num_scores){
+    const auto sizes = reader.template read<uint64_t>(3u);
+    const auto offsets = reader.template read<uint64_t>(num_keys + 1);
+    _offsets.assign(offsets, offsets + num_keys + 1);
+    if(_offsets.back() != num_scores)
+        throw std::runtime_error("Invalid packed index");
+    init_blocks();
+    const auto block_offsets = reader.template read<uint64_t>(_block_offsets.size());
+    _block_offsets.assign(block_offsets, block_offsets + _block_offsets.size());
+    const auto values = reader.template read<value_t>(sizes[0]);
+    _values.assign(values, values + sizes[0]);
+    _rating_bits = _values.empty() ? 0u : bit_width(_values.size() - 1);
+    const auto shifts = reader.template read<double>(sizes[1]);
+    _shifts.assign(shifts, shifts + sizes[1]);
+    const auto data = reader.template read<uint8_t>(sizes[2]);
+    _data.assign(data, data + sizes[2]);
+    _data.resize(_data.size() + tail_padding, 0u);
+}
+
+#endif // PACKED_INDEX_HPP
@@ -0,0 +1,64 @@
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+#include <cstdint>
+#include <cstring>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Hardware cache misses of the calling thread, counted by the kernel through perf_event_open(2).
+ * The counter is not available outside Linux, in most containers or when perf_event_paranoid
+ * forbids it: available() is false and stop() returns 0.
+ */
+class CacheMissCounter{
+    int _fd;
+public:
+    CacheMissCounter() : _fd{-1}{
+#ifdef __linux__
+        struct perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        _fd = ::syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+    CacheMissCounter(const CacheMissCounter&) = delete;
+    CacheMissCounter& operator=(const CacheMissCounter&) = delete;
+    ~CacheMissCounter(){
+#ifdef __linux__
+        if(_fd >= 0) ::close(_fd);
+#endif
+    }
+
+    bool available() const  {return _fd >= 0;}
+
+    void start(){
+#ifdef __linux__
+        if(_fd < 0) return;
+        ::ioctl(_fd, PERF_EVENT_IOC_RESET, 0);
+        ::ioctl(_fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    // misses since start()
+    uint64_t stop(){
+        uint64_t count{0u};
+#ifdef __linux__
+        if(_fd < 0) return 0u;
+        ::ioctl(_fd, PERF_EVENT_IOC_DISABLE, 0);
+        if(::read(_fd, &count, sizeof(count)) != sizeof(count))
+            count = 0u;
+#endif
+        return count;
+    }
+};
+
+#endif // PERF_COUNTERS_HPP
@@ -0,0 +1,470 @@
+#ifndef PREP_HPP
+#define PREP_HPP
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <ostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include <omp.h>
+#include "ratings.hpp"
+
+/*
+ * Line-level tools for the data preparation utilities, and the modes of bdtree_prep built on them.
+ * Lines are never copied: they are kept as offsets into the memory-mapped input and
+ * written back verbatim, so any delimiter and any extra field is preserved.
+ */
+
+using range_t = std::pair<const char*, const char*>;
+
+// counter-based random numbers: the value for (seed, n) does not depend on the order of
+// evaluation, so parallel loops produce the same output for any number of threads
+uint64_t mix_seed(const uint64_t seed, const uint64_t n){
+    // splitmix64 finalizer
+    uint64_t z = seed + (n + 1) * 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// uniform in [0, 1)
+double uniform01(const uint64_t seed, const uint64_t n){
+    return (mix_seed(seed, n) >> 11) * (1.0 / (1ull << 53));
+}
+
+// the field_idx-th field of the range [first, last), empty if the line has fewer fields
+range_t field_of(const char *first, const char *last, const std::size_t field_idx, const char delim){
+    for(std::size_t f{0u}; f < field_idx; ++f){
+        first = std::find(first, last, delim);
+        if(first == last) return range_t(last, last);
+        ++first;
+    }
+    return range_t(first, std::find(first, last, delim));
+}
+
+// the non-empty lines of a memory-mapped file
+class LineFile{
+    boost::iostreams::mapped_file_source _mmap;
+    std::vector<std::size_t> _starts;
+public:
+    explicit LineFile(const std::string &filename, const unsigned num_threads = 1) : _mmap{}, _starts{}{
+        std::ifstream probe(filename);
+        if(!probe)
+            throw std::runtime_error("Unable to open " + filename);
+        // mapping an empty file fails
+        if(probe.peek() == std::ifstream::traits_type::eof()) return;
+        _mmap.open(filename);
+        const char *data = _mmap.data();
+        const auto bounds = split_lines(data, data + _mmap.size(), num_threads);
+        std::vector<std::vector<std::size_t>> chunks(bounds.size() - 1);
+#pragma omp parallel for num_threads(num_threads) schedule(static, 1)
+        for(std::size_t c = 0; c < chunks.size(); ++c){
+            for(const char *it = bounds[c]; it < bounds[c+1]; ){
+                const char *eol = std::find(it, bounds[c+1], '\n');
+                if(eol != it && !(eol == it + 1 && *it == '\r'))
+                    chunks[c].push_back(it - data);
+                it = eol + 1;
+            }
+        }
+        for(const auto &chunk : chunks)
+            _starts.insert(_starts.end(), chunk.cbegin(), chunk.cend());
+    }
+
+    std::size_t size() const    {return _starts.size();}
+
+    // the idx-th line, without the line terminator
+    range_t line(const std::size_t idx) const{
+        const char *first = _mmap.data() + _starts[idx];
+        const char *last = _mmap.data() + _mmap.size();
+        const char *eol = static_cast<const char*>(std::memchr(first, '\n', last - first));
+        if(eol != nullptr) last = eol;
+        if(last != first && *(last-1) == '\r') --last;
+        return range_t(first, last);
+    }
+
+    void write(std::ostream &os, const std::size_t idx) const{
+        const auto l = line(idx);
+        os.write(l.first, l.second - l.first);
+        os.put('\n');
+    }
+
+    template<typename It>
+    void write(std::ostream &os, It first, It last) const{
+        for(; first != last; ++first)
+            write(os, *first);
+    }
+};
+
+// dense ids of the keys, in order of first appearance
+// chunks of keys are numbered locally in parallel, then merged in chunk order
+std::vector<std::size_t> first_seen_ids(const std::vector<range_t> &keys,
+                                        std::vector<std::string> &names,
+                                        const unsigned num_threads = 1){
+    const std::size_t num_chunks = std::max(num_threads, 1u);
+    const std::size_t chunk_size = (keys.size() + num_chunks - 1) / num_chunks;
+    std::vector<std::size_t> ids(keys.size());
+    std::vector<std::vector<std::string>> local_names(num_chunks);
+#pragma omp parallel for num_threads(num_threads) schedule(static, 1)
+    for(std::size_t c = 0; c < num_chunks; ++c){
+        std::unordered_map<std::string, std::size_t> local;
+        const auto last = std::min(keys.size(), (c + 1) * chunk_size);
+        for(std::size_t k{c * chunk_size}; k < last; ++k){
+            std::string key(keys[k].first, keys[k].second);
+            auto it = local.find(key);
+            if(it == local.end()){
+                it = local.insert(std::make_pair(key, local_names[c].size())).first;
+                local_names[c].push_back(std::move(key));
+            }
+            ids[k] = it->second;
+        }
+    }
+    // map the local ids to global ones
+    std::unordered_map<std::string, std::size_t> global;
+    std::vector<std::vector<std::size_t>> to_global(num_chunks);
+    names.clear();
+    for(std::size_t c{0u}; c < num_chunks; ++c){
+        to_global[c].reserve(local_names[c].size());
+        for(auto &name : local_names[c]){
+            auto it = global.find(name);
+            if(it == global.end()){
+                it = global.insert(std::make_pair(name, names.size())).first;
+                names.push_back(std::move(name));
+            }
+            to_global[c].push_back(it->second);
+        }
+    }
+#pragma omp parallel for num_threads(num_threads) schedule(static, 1)
+    for(std::size_t c = 0; c < num_chunks; ++c){
+        const auto last = std::min(keys.size(), (c + 1) * chunk_size);
+        for(std::size_t k{c * chunk_size}; k < last; ++k)
+            ids[k] = to_global[c][ids[k]];
+    }
+    return ids;
+}
+
+/*
+ * Lines grouped by the value of a key field, in compressed row layout: the lines of the
+ * g-th group are _lines[_offsets[g], _offsets[g+1]), in file order.
+ * Groups are numbered in order of first appearance of their key.
+ */
+struct LineGroups{
+    std::vector<std::string> _keys;
+    std::vector<std::size_t> _offsets;
+    std::vector<std::size_t> _lines;
+
+    std::size_t size() const    {return _keys.size();}
+    std::size_t group_size(const std::size_t g) const   {return _offsets[g+1] - _offsets[g];}
+    std::vector<std::size_t>::const_iterator begin(const std::size_t g) const   {return _lines.cbegin() + _offsets[g];}
+    std::vector<std::size_t>::const_iterator end(const std::size_t g) const     {return _lines.cbegin() + _offsets[g+1];}
+};
+
+// group the lines of a file by their key_idx-th field
+// lines with keep[line] == false are left out of the groups, but their keys still get a group
+LineGroups group_lines(const LineFile &lines,
+                       const std::size_t key_idx,
+                       const char delim,
+                       const unsigned num_threads = 1,
+                       const std::vector<char> *keep = nullptr){
+    std::vector<range_t> keys(lines.size());
+#pragma omp parallel for num_threads(num_threads)
+    for(std::size_t l = 0; l < lines.size(); ++l){
+        const auto line = lines.line(l);
+        keys[l] = field_of(line.first, line.second, key_idx, delim);
+    }
+    LineGroups groups;
+    const auto ids = first_seen_ids(keys, groups._keys, num_threads);
+    // stable counting sort of the lines by group
+    groups._offsets.assign(groups._keys.size() + 1, 0u);
+    for(std::size_t l{0u}; l < ids.size(); ++l)
+        if(keep == nullptr || (*keep)[l])
+            ++groups._offsets[ids[l] + 1];
+    for(std::size_t g{0u}; g < groups._keys.size(); ++g)
+        groups._offsets[g+1] += groups._offsets[g];
+    groups._lines.resize(groups._offsets.back());
+    std::vector<std::size_t> next(groups._offsets.cbegin(), groups._offsets.cend() - 1);
+    for(std::size_t l{0u}; l < ids.size(); ++l)
+        if(keep == nullptr || (*keep)[l])
+            groups._lines[next[ids[l]]++] = l;
+    return groups;
+}
+
+// keys in increasing order, the decimal ones by value as the ids parsed from them
+bool key_less(const std::string &lhs, const std::string &rhs){
+    auto is_decimal = [](const std::string &key){
+        return !key.empty() && std::all_of(key.cbegin(), key.cend(), [](const char c){return std::isdigit(static_cast<unsigned char>(c)) != 0;});
+    };
+    if(is_decimal(lhs) && is_decimal(rhs))
+        return lhs.size() < rhs.size() || (lhs.size() == rhs.size() && lhs < rhs);
+    return lhs < rhs;
+}
+
+// the groups in increasing order of their keys
+std::vector<std::size_t> sorted_groups(const LineGroups &groups){
+    std::vector<std::size_t> sorted(groups.size());
+    std::iota(sorted.begin(), sorted.end(), 0u);
+    std::sort(sorted.begin(), sorted.end(), [&groups](const std::size_t lhs, const std::size_t rhs){
+        return key_less(groups._keys[lhs], groups._keys[rhs]);
+    });
+    return sorted;
+}
+
+std::string file_name(const std::string &path){
+    const auto slash = path.rfind('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+std::string dir_name(const std::string &path){
+    const auto slash = path.rfind('/');
+    return slash == std::string::npos ? std::string(".") : path.substr(0, slash);
+}
+
+std::string strip_extension(const std::string &filename){
+    const auto dot = filename.rfind('.');
+    return dot == std::string::npos || dot == 0 ? filename : filename.substr(0, dot);
+}
+
+void mkdir_p(const std::string &path){
+    for(std::size_t pos = path.find('/', 1); ; pos = path.find('/', pos + 1)){
+        const auto dir = path.substr(0, pos);
+        if(::mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+            throw std::runtime_error("Unable to create the directory " + dir);
+        if(pos == std::string::npos) break;
+    }
+}
+
+std::ofstream open_out(const std::string &filename){
+    std::ofstream ofs(filename);
+    if(!ofs)
+        throw std::runtime_error("Unable to write " + filename);
+    return ofs;
+}
+
+void kfold(const std::string &input, const std::string &outdir,
+           const std::size_t num_folds, const double split_perc,
+           const std::size_t key_idx, const char delim,
+           const uint64_t seed, const unsigned num_threads){
+    if(num_folds == 0u)
+        throw std::runtime_error("The number of folds must be positive.");
+    LineFile lines(input, num_threads);
+    const auto groups = group_lines(lines, key_idx, delim, num_threads);
+    std::cout << "Dataset " << input << " imported: " << lines.size() << " lines, " << groups.size() << " keys." << std::endl;
+    if(groups.size() < num_folds)
+        throw std::runtime_error("Fewer keys than folds.");
+    std::vector<std::size_t> order(groups.size());
+    std::iota(order.begin(), order.end(), 0u);
+    std::mt19937_64 rng(seed);
+    std::shuffle(order.begin(), order.end(), rng);
+
+    // the keys of a fold are a range of the shuffled order, the last fold takes the remainder
+    const std::size_t fold_size = groups.size() / num_folds;
+    std::vector<std::size_t> fold_of(groups.size());
+    for(std::size_t pos{0u}; pos < order.size(); ++pos)
+        fold_of[order[pos]] = std::min(pos / fold_size, num_folds - 1);
+    // the files list the keys in increasing order, as the streaming evaluation reads them
+    const auto by_key = sorted_groups(groups);
+    for(std::size_t fold{0u}; fold < num_folds; ++fold){
+        const auto splitname = "s" + std::to_string(fold);
+        const auto splitpath = outdir + "/" + splitname;
+        mkdir_p(splitpath);
+        std::cout << "Writing fold " << fold << " to " << splitpath << std::endl;
+        auto train = open_out(splitpath + "/" + splitname + ".train");
+        for(const auto g : by_key)
+            if(fold_of[g] != fold)
+                lines.write(train, groups.begin(g), groups.end(g));
+        auto ans = open_out(splitpath + "/" + splitname + ".ans");
+        auto eval = open_out(splitpath + "/" + splitname + ".eval");
+        std::vector<std::size_t> shuffled;
+        for(const auto g : by_key){
+            if(fold_of[g] != fold) continue;
+            shuffled.assign(groups.begin(g), groups.end(g));
+            // every key is tested in one fold only, seed its shuffle with the key
+            std::mt19937_64 key_rng(mix_seed(seed, g));
+            std::shuffle(shuffled.begin(), shuffled.end(), key_rng);
+            const auto thresh = static_cast<std::size_t>(split_perc * shuffled.size());
+            lines.write(ans, shuffled.cbegin(), shuffled.cbegin() + thresh);
+            lines.write(eval, shuffled.cbegin() + thresh, shuffled.cend());
+        }
+    }
+}
+
+void rand_split(const std::string &input, const std::string &outdir,
+                const double perc, const uint64_t seed, const unsigned num_threads){
+    LineFile lines(input, num_threads);
+    const auto name = outdir + "/" + strip_extension(file_name(input));
+    auto train = open_out(name + ".train");
+    auto test = open_out(name + ".test");
+    std::size_t num_train{0u};
+    for(std::size_t l{0u}; l < lines.size(); ++l){
+        if(uniform01(seed, l) < perc){
+            lines.write(train, l);
+            ++num_train;
+        }else{
+            lines.write(test, l);
+        }
+    }
+    std::cout << "Split " << lines.size() << " lines: " << num_train << " training, "
+              << lines.size() - num_train << " test." << std::endl;
+}
+
+void group_split(const std::string &train_file, const std::string &test_file, const std::string &outdir,
+                 const std::size_t key_idx, const double sampling, const double train_perc,
+                 const char delim, const uint64_t seed, const unsigned num_threads){
+    // sample the lines of a file, each file gets its own random stream
+    auto sample = [&](const LineFile &lines, const uint64_t stream){
+        std::vector<char> keep(lines.size());
+        const auto file_seed = mix_seed(seed, stream);
+#pragma omp parallel for num_threads(num_threads)
+        for(std::size_t l = 0; l < lines.size(); ++l)
+            keep[l] = uniform01(file_seed, l) < sampling;
+        return keep;
+    };
+    LineFile train_lines(train_file, num_threads), test_lines(test_file, num_threads);
+    const auto train_keep = sample(train_lines, 0u);
+    const auto test_keep = sample(test_lines, 1u);
+    const auto train_groups = group_lines(train_lines, key_idx, delim, num_threads, &train_keep);
+    const auto test_groups = group_lines(test_lines, key_idx, delim, num_threads, &test_keep);
+
+    // split the keys of the training file
+    std::vector<std::size_t> order(train_groups.size());
+    std::iota(order.begin(), order.end(), 0u);
+    std::mt19937_64 rng(seed);
+    std::shuffle(order.begin(), order.end(), rng);
+    const auto train_size = static_cast<std::size_t>(order.size() * train_perc);
+    std::cout << "Keys: " << train_size << " training, " << order.size() - train_size << " test." << std::endl;
+
+    // test file group of each training key, if any
+    const std::size_t none = test_groups.size();
+    std::unordered_map<std::string, std::size_t> test_group_of;
+    for(std::size_t g{0u}; g < test_groups.size(); ++g)
+        test_group_of.insert(std::make_pair(test_groups._keys[g], g));
+    std::vector<std::size_t> train_to_test(train_groups.size(), none);
+    for(std::size_t g{0u}; g < train_groups.size(); ++g){
+        auto it = test_group_of.find(train_groups._keys[g]);
+        if(it != test_group_of.end())
+            train_to_test[g] = it->second;
+    }
+
+    std::vector<char> is_train(train_groups.size(), false);
+    for(std::size_t pos{0u}; pos < train_size; ++pos)
+        is_train[order[pos]] = true;
+
+    // the keys are written in increasing order
+    const auto by_key = sorted_groups(train_groups);
+    auto write_split = [&](const std::string &filename, const LineFile &lines, const LineGroups &groups,
+                           const std::vector<std::size_t> *group_of){
+        const auto name = outdir + "/" + file_name(filename);
+        auto train = open_out(name + ".train");
+        auto test = open_out(name + ".test");
+        for(const auto key : by_key){
+            const auto g = group_of == nullptr ? key : (*group_of)[key];
+            if(g != none)
+                lines.write(is_train[key] ? train : test, groups.begin(g), groups.end(g));
+        }
+    };
+    write_split(train_file, train_lines, train_groups, nullptr);
+    write_split(test_file, test_lines, test_groups, &train_to_test);
+}
+
+void renumber(const std::string &input, const std::string &output, const unsigned num_threads){
+    LineFile lines(input, num_threads);
+    if(lines.size() == 0)
+        throw std::runtime_error("Empty input file " + input);
+    // the first line is the header
+    const std::size_t num_ratings = lines.size() - 1;
+    std::vector<range_t> users(num_ratings), items(num_ratings);
+    std::vector<double> values(num_ratings);
+    bool failed{false};
+#pragma omp parallel for num_threads(num_threads)
+    for(std::size_t r = 0; r < num_ratings; ++r){
+        const auto line = lines.line(r + 1);
+        users[r] = field_of(line.first, line.second, 0u, ',');
+        items[r] = field_of(line.first, line.second, 1u, ',');
+        auto value = field_of(line.first, line.second, 2u, ',');
+        if(!qi::phrase_parse(value.first, value.second, qi::double_, qi::blank, values[r])){
+#pragma omp atomic write
+            failed = true;
+        }
+        values[r] = std::min(values[r], 5.0);
+    }
+    if(failed)
+        throw std::runtime_error("Unable to parse the ratings in " + input);
+    std::vector<std::string> user_names, item_names;
+    const auto user_ids = first_seen_ids(users, user_names, num_threads);
+    const auto item_ids = first_seen_ids(items, item_names, num_threads);
+
+    // format the output in parallel chunks, then write them in order
+    const std::size_t num_chunks = std::max(num_threads, 1u);
+    const std::size_t chunk_size = (num_ratings + num_chunks - 1) / num_chunks;
+    std::vector<std::string> chunks(num_chunks);
+#pragma omp parallel for num_threads(num_threads) schedule(static, 1)
+    for(std::size_t c = 0; c < num_chunks; ++c){
+        std::ostringstream oss;
+        const auto last = std::min(num_ratings, (c + 1) * chunk_size);
+        for(std::size_t r{c * chunk_size}; r < last; ++r)
+            oss << user_ids[r] << '\t' << item_ids[r] << '\t' << values[r] << '\n';
+        chunks[c] = oss.str();
+    }
+    auto ofs = open_out(output);
+    for(const auto &chunk : chunks)
+        ofs.write(chunk.data(), chunk.size());
+    std::cout << "Renumbered " << num_ratings << " ratings: "
+              << user_names.size() << " users, " << item_names.size() << " items." << std::endl;
+}
+
+struct PairHash{
+    std::size_t operator()(const std::pair<id_type, id_type> &p) const{
+        return mix_seed(static_cast<uint64_t>(p.first), static_cast<uint64_t>(p.second));
+    }
+};
+
+void probe_split(const std::string &full_file, const std::string &probe_file, const unsigned num_threads){
+    // probe lines are either "item:" or "user", the users follow their item
+    LineFile probe(probe_file);
+    std::unordered_set<std::pair<id_type, id_type>, PairHash> probe_pairs;
+    id_type item{-1};
+    for(std::size_t l{0u}; l < probe.size(); ++l){
+        auto line = probe.line(l);
+        id_type id;
+        if(!qi::phrase_parse(line.first, line.second, qi::long_long, qi::blank, id))
+            throw std::runtime_error("Unable to parse the probe file " + probe_file);
+        if(line.first != line.second && *line.first == ':')
+            item = id;
+        else if(item >= 0)
+            probe_pairs.insert(std::make_pair(id, item));
+        else
+            throw std::runtime_error("Probe user with no item in " + probe_file);
+    }
+
+    LineFile full(full_file, num_threads);
+    std::vector<char> is_test(full.size());
+#pragma omp parallel for num_threads(num_threads)
+    for(std::size_t l = 0; l < full.size(); ++l){
+        auto line = full.line(l);
+        std::pair<id_type, id_type> rating;
+        is_test[l] = qi::phrase_parse(line.first, line.second, qi::long_long >> qi::long_long, qi::blank, rating.first, rating.second) &&
+                probe_pairs.count(rating) > 0;
+    }
+    const auto name = dir_name(full_file) + "/" + strip_extension(file_name(full_file));
+    auto train = open_out(name + ".train");
+    auto test = open_out(name + ".test");
+    std::size_t num_test{0u};
+    for(std::size_t l{0u}; l < full.size(); ++l){
+        full.write(is_test[l] ? test : train, l);
+        num_test += is_test[l];
+    }
+    std::cout << "Probe ratings: " << probe_pairs.size() << ", found: " << num_test << std::endl;
+}
+
+#endif // PREP_HPP
@@ -2,6 +2,7 @@
 #define RANKTREE_HPP
 #include <algorithm>
 #include <cstdio>
+#include <utility>
 #include "abd_tree.hpp"
 #include "aux.hpp"
 #include "stopwatch.hpp"
@@ -15,18 +16,25 @@ protected:
     hash_map_t<Key, relevance_t> _relevances;
     hash_map_t<Key, ranking_t> _best_rankings;
 public:
-    RankIndex(){
-        _relevances.set_empty_key(-1);
-        _best_rankings.set_empty_key(-1);
-    }
+    RankIndex() : _relevances{}, _best_rankings{}{}
 
     void insert(const Key &key, const Key &item, const double &rating){
-        if(_relevances.count(key) == 0){
-            _relevances[key].set_empty_key(-1);
-        }
         _relevances[key].insert(std::make_pair(item, rating));
     }
 
+    // replace the users and the items with user_id(user) and item_id(item), both injective
+    template<typename UserFn, typename ItemFn>
+    void relabel(UserFn user_id, ItemFn item_id){
+        hash_map_t<Key, relevance_t> relevances;
+        for(const auto &entry : _relevances){
+            auto &relevance = relevances[user_id(entry.first)];
+            for(const auto &item : entry.second)
+                relevance.insert(std::make_pair(item_id(item.first), item.second));
+        }
+        _relevances.swap(relevances);
+        _best_rankings.clear();
+    }
+
     // return the -unordered- key vector
     std::vector<Key> keys(){
         return extract_keys(_relevances);
@@ -74,7 +82,8 @@ protected:
 template<typename R>
 class RankTree : public ABDTree{
 protected:
-    using ABDTree::index_t;
+    using ABDTree::item_index_t;
+    using ABDTree::user_index_t;
     using ABDTree::stat_map_t;
 public:
     using ABDTree::node_ptr_t;
@@ -95,26 +104,48 @@ public:
             _ranking_index->insert(rat._user_id, rat._item_id, rat._value);
         }
         ABDTree::init(training_data);
-        // initialize root _users member
-        this->_root->_users = std::unique_ptr<group_t>(new group_t{});
-        this->_root->_users->reserve(_user_index->size());
-        for(const auto &entry : *_user_index)
-            this->_root->_users->push_back(entry.first);
+        init_root_users();
     }
 
     void init(const std::vector<Rating> &training_data) override{
+        init(RatingVector(training_data));
+    }
+
+    void init(const RatingSource &training_data) override{
         //TODO: caching is forced for the time. Support for optional caching to be added in future.
         _cache_enabled = true;
         _ranking_index = std::unique_ptr<R>(new R{});
-        for(const auto &rat : training_data){
-            _ranking_index->insert(rat._user_id, rat._item_id, rat._value);
+        auto fill_ranking_index = [&](const Rating *first, const Rating *last){
+            for(auto rat = first; rat != last; ++rat)
+                _ranking_index->insert(rat->_user_id, rat->_item_id, rat->_value);
+        };
+        if(training_data.multi_pass()){
+            training_data.for_each_block(fill_ranking_index);
+            ABDTree::init(training_data);
+        }else{
+            // fill the ranking index in the same pass that builds the indices
+            ABDTree::init(TappedRatings(training_data, fill_ranking_index));
         }
-        ABDTree::init(training_data);
-        // initialize root _users member
-        this->_root->_users = std::unique_ptr<group_t>(new group_t{});
-        this->_root->_users->reserve(_user_index->size());
-        for(const auto &entry : *_user_index)
-            this->_root->_users->push_back(entry.first);
+        init_root_users();
+    }
+
+    bool load_snapshot(const std::string &filename, const uint64_t content_hash) override{
+        _cache_enabled = true;
+        std::size_t num_ratings;
+        stat_map_t root_stats;
+        if(!this->read_snapshot(filename, content_hash, num_ratings, root_stats))
+            return false;
+        // the training ratings are all in the user index
+        _ranking_index = std::unique_ptr<R>(new R{});
+        for(std::size_t user{0u}; user < _user_index->size(); ++user){
+            const auto user_id = _user_ids->external(user);
+            _user_index->for_each(user, 0u, _user_index->num_scores(user), [&](const UserScore &score){
+                _ranking_index->insert(user_id, _item_ids->external(score._id), score._rating);
+            });
+        }
+        this->init_root(num_ratings, std::move(root_stats));
+        init_root_users();
+        return true;
     }
 
     void build(){
@@ -145,15 +176,42 @@ protected:
                          std::vector<double> &g_qualities,
                          std::vector<stat_map_t> &g_stats) const override;
     void unknown_users(const node_cptr_t node, std::vector<group_t> &groups) const;
+    // key the ranking index by internal ids, so that the rankings and the groups are evaluated as
+    // they are; the users and the items without training ratings get ids past the internal ones
+    void key_ranking_index(){
+        hash_map_t<id_type, id_type> new_users, new_items;
+        const auto to_internal = [](const IdMap &ids, hash_map_t<id_type, id_type> &new_ids, const id_type id) -> id_type{
+            dense_id_t dense;
+            if(ids.find(id, dense))
+                return static_cast<id_type>(dense);
+            const id_type next = ids.size() + new_ids.size();
+            return new_ids.insert(std::make_pair(id, next)).first->second;
+        };
+        _ranking_index->relabel([&](const id_type user){return to_internal(*_user_ids, new_users, user);},
+                                [&](const id_type item){return to_internal(*_item_ids, new_items, item);});
+    }
+    void init_root_users(){
+        this->_root->_users = std::unique_ptr<group_t>(new group_t{});
+        this->_root->_users->reserve(_user_index->size());
+        for(std::size_t user{0u}; user < _user_index->size(); ++user)
+            this->_root->_users->push_back(user);
+    }
 protected:
     using ABDTree::unknown_stats;
     using ABDTree::_item_index;
     using ABDTree::_user_index;
+    using ABDTree::_item_ids;
+    using ABDTree::_user_ids;
+    using ABDTree::_thread_labels;
+    using ABDTree::unknown_label;
+    using ABDTree::_split_moved_bytes;
     std::unique_ptr<R> _ranking_index;
 };
 
 template<typename R>
 void RankTree<R>::compute_root_quality(){
+    // the ranking index is filled with external ids, the id maps are complete once the root is set up
+    key_ranking_index();
     _root->_quality = _ranking_index->evaluate_all(rank_all_items(*_root->_stats));
 }
 
@@ -166,14 +224,18 @@ void RankTree<R>::split(node_ptr_t node,
                              std::vector<stat_map_t> &g_stats){
 
     // groups now contains users also for the unknown branch
-    // need to remove it for the base split method to work properly
-    std::vector<group_t> base_groups(groups.size()-1);
-    std::copy(groups.cbegin(), groups.cend()-1, base_groups.begin());
-
-    ABDTree::split(node, splitter_id, splitter_quality, base_groups, g_qualities, g_stats);
-    // explicitly save the ids of the users of each children node
-    for(std::size_t gidx{0u}; gidx < groups.size(); ++gidx)
-        node->_children[gidx]->_users = std::unique_ptr<group_t>(new group_t(groups[gidx]));
+    // need to set it aside for the base split method to work properly
+    group_t unknown_group;
+    unknown_group.swap(groups.back());
+    groups.pop_back();
+    ABDTree::split(node, splitter_id, splitter_quality, groups, g_qualities, g_stats);
+    groups.push_back(std::move(unknown_group));
+    // explicitly save the ids of the users of each children node, the groups are moved into them
+    for(std::size_t gidx{0u}; gidx < groups.size(); ++gidx){
+        // the known groups were copied twice, once into the groups of the base split
+        _split_moved_bytes += (gidx + 1 < groups.size() ? 2u : 1u) * groups[gidx].size() * sizeof(id_type);
+        node->_children[gidx]->_users = std::unique_ptr<group_t>(new group_t(std::move(groups[gidx])));
+    }
 
     assert(node->_children[0]->_users->size() == node->_children[0]->_num_users);
     assert(node->_children[1]->_users->size() == node->_children[1]->_num_users);
@@ -191,22 +253,9 @@ double RankTree<R>::split_quality(const node_cptr_t node,
 
     groups.clear();
     g_qualities.clear();
-    g_stats.clear();
     groups.assign(2, group_t{});
-    g_stats.assign(2, stat_map_t());
-
-    auto it_left = this->_item_index->at(splitter_id).cbegin() + (*_node_bounds)[node->_id][splitter_id]._left;
-    auto it_right = this->_item_index->at(splitter_id).cbegin() + (*_node_bounds)[node->_id][splitter_id]._right;
-
-    for(auto it_score = it_left; it_score < it_right; ++it_score){
-        if(it_score->_rating >= 4){  // loved item
-            groups[0].push_back(it_score->_id);
-            this->_user_index->update_stats(g_stats[0], it_score->_id);
-        }else{  // hated item
-            groups[1].push_back(it_score->_id);
-            this->_user_index->update_stats(g_stats[1], it_score->_id);
-        }
-    }
+    this->reset_stats(g_stats);
+    this->known_groups(node, splitter_id, groups, g_stats);
     unknown_stats(node, g_stats);
     unknown_users(node, groups);
     double quality{.0};
@@ -214,13 +263,11 @@ double RankTree<R>::split_quality(const node_cptr_t node,
         if(node->_level > 1){
             g_qualities.emplace_back(
                         _ranking_index->evaluate_users(
-                            rank_all_items(g_stats[gidx], *node->_scores, this->_h_smooth),
-                            groups[gidx]));
+                            rank_all_items(g_stats[gidx], *node->_scores, this->_h_smooth), groups[gidx]));
         }else{
             g_qualities.emplace_back(
                         _ranking_index->evaluate_users(
-                            rank_all_items(g_stats[gidx]),
-                            groups[gidx]));
+                            rank_all_items(g_stats[gidx]), groups[gidx]));
         }
         quality += g_qualities.back();
     }
@@ -230,18 +277,20 @@ double RankTree<R>::split_quality(const node_cptr_t node,
 template<typename R>
 void RankTree<R>::unknown_users(const node_cptr_t node,
                                       std::vector<group_t> &groups) const{
-    groups.push_back(*node->_users); //init with parent's users
-    auto &unknown_users = groups.back();
-    assert(is_ordered(unknown_users.begin(), unknown_users.end()));
-    for(std::size_t gidx{0}; gidx < groups.size()-1; ++gidx){
-        assert(is_ordered(groups[gidx].begin(), groups[gidx].end()));
-        group_t diff_result(unknown_users.size());
-        auto it = std::set_difference(unknown_users.begin(), unknown_users.end(),
-                                      groups[gidx].begin(), groups[gidx].end(),
-                                      diff_result.begin());
-        diff_result.resize(std::distance(diff_result.begin(), it));
-        unknown_users.swap(diff_result);
-    }
-    assert(unknown_users.size() == node->_num_users - groups[0].size() - groups[1].size());
+    // label the users of the known groups, keep the users of the node without a label
+    auto &labels = (*_thread_labels)[omp_get_thread_num()];
+    for(std::size_t gidx{0}; gidx < groups.size(); ++gidx)
+        for(const auto user : groups[gidx])
+            labels[user] = gidx;
+    group_t unknown_users;
+    unknown_users.reserve(node->_users->size());
+    for(const auto user : *node->_users)
+        if(labels[user] == unknown_label)
+            unknown_users.push_back(user);
+    for(const auto &group : groups)
+        for(const auto user : group)
+            labels[user] = unknown_label;
+    groups.push_back(std::move(unknown_users));
+    assert(groups.back().size() == node->_num_users - groups[0].size() - groups[1].size());
 }
 #endif // RANKTREE_HPP
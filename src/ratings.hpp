@@ -3,11 +3,32 @@
 #include <boost/fusion/adapted.hpp>
 #include <boost/iostreams/device/mapped_file.hpp>
 #include <boost/spirit/include/qi.hpp>
+#include <algorithm>
+#include <cctype>
+#include <functional>
 #include <sstream>
+#include <stdexcept>
+#include <omp.h>
+#include "stopwatch.hpp"
 #include "types.hpp"
 
 namespace qi = boost::spirit::qi;
 
+// a line "user item rating" takes roughly this many bytes, used to presize the parse buffers
+constexpr std::size_t bytes_per_line_hint = 16;
+
+struct ParseStats{
+    std::size_t _bytes;
+    std::size_t _ratings;
+    long long _elapsed_ms;
+
+    ParseStats() : _bytes{0u}, _ratings{0u}, _elapsed_ms{0}{}
+
+    double mb_per_sec() const{
+        return _elapsed_ms > 0 ? (_bytes / (1024.0 * 1024.0)) / (_elapsed_ms / 1000.0) : .0;
+    }
+};
+
 struct Rating{
     id_type _user_id;
     id_type _item_id;
@@ -27,20 +48,200 @@ struct Rating{
         return os;
     }
 
-    static std::vector<Rating> read_from(const std::string &training_filename, const std::size_t sz_hint = 10000){
-        boost::iostreams::mapped_file mmap(training_filename, boost::iostreams::mapped_file::readonly);
-        auto f = mmap.const_data();
-        auto l = f + mmap.size();
+    static std::vector<Rating> read_from(const std::string &training_filename,
+                                         const unsigned num_threads = 1,
+                                         ParseStats *stats = nullptr);
+
+};
+BOOST_FUSION_ADAPT_STRUCT(Rating, (id_type, _user_id)(id_type, _item_id)(double, _value))
+
+// split the range [first, last) into (at most) num_chunks chunks of similar size
+// every chunk but the last one ends right after a newline, so that no line is broken
+// returns the num_chunks+1 chunk boundaries
+std::vector<const char*> split_lines(const char *first, const char *last, const std::size_t num_chunks){
+    std::vector<const char*> bounds;
+    bounds.reserve(num_chunks + 1);
+    bounds.push_back(first);
+    const std::size_t chunk_size = std::distance(first, last) / std::max<std::size_t>(num_chunks, 1u);
+    for(std::size_t c{1}; c < num_chunks; ++c){
+        const char *it = std::max(bounds.back(), first + c * chunk_size);
+        it = std::find(it, last, '\n');
+        bounds.push_back(it != last ? it + 1 : last);
+    }
+    bounds.push_back(last);
+    return bounds;
+}
+
+// parse the "user item rating" lines in [first, last) and append them to ratings
+void parse_ratings(const char *first, const char *last, std::vector<Rating> &ratings){
+    // skip empty lines and blanks
+    while(first != last && std::isspace(*first)) ++first;
+    if(first == last) return;
+    try{
+        // the list stops at a line that does not start with an id, the rest of the range must be blank
+        if(qi::phrase_parse(first, last, (qi::ulong_long > qi::ulong_long > qi::double_) % +qi::eol, qi::blank, ratings)){
+            while(first != last && std::isspace(*first)) ++first;
+            if(first == last)
+                return;
+        }
+    }catch(const qi::expectation_failure<const char*> &){}
+    throw std::runtime_error ("Unable to parse the ratings file.");
+}
 
-        std::vector<Rating> ratings;
-        ratings.reserve(sz_hint);
-        if(!qi::phrase_parse(f,l,(qi::ulong_long > qi::ulong_long > qi::double_) % qi::eol, qi::blank, ratings))
-            throw std::runtime_error ("Unable to parse the training file.");
-        return ratings;
+std::vector<Rating> Rating::read_from(const std::string &training_filename,
+                                      const unsigned num_threads,
+                                      ParseStats *stats){
+    stopwatch sw;
+    sw.reset(); sw.start();
+    boost::iostreams::mapped_file mmap(training_filename, boost::iostreams::mapped_file::readonly);
+    auto f = mmap.const_data();
+    auto l = f + mmap.size();
+
+    // parse each chunk in a per-thread buffer
+    const auto bounds = split_lines(f, l, num_threads);
+    std::vector<std::vector<Rating>> chunks(bounds.size()-1);
+    bool failed{false};
+#pragma omp parallel for num_threads(num_threads) schedule(static, 1)
+    for(std::size_t c = 0; c < chunks.size(); ++c){
+        chunks[c].reserve(std::distance(bounds[c], bounds[c+1]) / bytes_per_line_hint);
+        try{
+            parse_ratings(bounds[c], bounds[c+1], chunks[c]);
+        }catch(const std::exception &){
+#pragma omp atomic write
+            failed = true;
+        }
+    }
+    if(failed)
+        throw std::runtime_error ("Unable to parse the training file.");
+
+    // join the chunks into a presized vector
+    std::vector<std::size_t> offsets(chunks.size()+1, 0u);
+    for(std::size_t c{0}; c < chunks.size(); ++c)
+        offsets[c+1] = offsets[c] + chunks[c].size();
+    std::vector<Rating> ratings(offsets.back());
+#pragma omp parallel for num_threads(num_threads) schedule(static, 1)
+    for(std::size_t c = 0; c < chunks.size(); ++c){
+        std::copy(chunks[c].cbegin(), chunks[c].cend(), ratings.begin() + offsets[c]);
+        std::vector<Rating>().swap(chunks[c]);
+    }
+    sw.stop();
+    if(stats != nullptr){
+        stats->_bytes = mmap.size();
+        stats->_ratings = ratings.size();
+        stats->_elapsed_ms = sw.elapsed_ms();
     }
+    return ratings;
+}
 
+// sequential access to a collection of ratings, one block at a time
+// blocks are only valid for the duration of the callback
+class RatingSource{
+public:
+    using block_fn_t = std::function<void(const Rating *first, const Rating *last)>;
+
+    virtual ~RatingSource(){}
+    virtual std::size_t size() const = 0;
+    virtual void for_each_block(const block_fn_t &fn) const = 0;
+    // true if the ratings can be read more than once at little cost
+    virtual bool multi_pass() const {return false;}
 };
-BOOST_FUSION_ADAPT_STRUCT(Rating, (id_type, _user_id)(id_type, _item_id)(double, _value))
 
+// exposes a vector of ratings as a single block
+class RatingVector : public RatingSource{
+    std::vector<Rating> _owned;
+    const std::vector<Rating> *_ratings;
+public:
+    explicit RatingVector(const std::vector<Rating> &ratings) : _owned{}, _ratings{&ratings}{}
+    explicit RatingVector(std::vector<Rating> &&ratings) : _owned(std::move(ratings)), _ratings{&_owned}{}
+    RatingVector(const RatingVector&) = delete;
+    RatingVector& operator=(const RatingVector&) = delete;
+
+    std::size_t size() const override   {return _ratings->size();}
+    bool multi_pass() const override    {return true;}
+    void for_each_block(const block_fn_t &fn) const override{
+        if(!_ratings->empty())
+            fn(_ratings->data(), _ratings->data() + _ratings->size());
+    }
+};
+
+/*
+ * Ratings parsed from a memory-mapped text file, one batch of chunks at a time.
+ * The chunks of a batch are parsed in parallel and handed out in file order,
+ * so at most num_threads chunks of ratings are in memory at any time.
+ */
+class TextRatings : public RatingSource{
+    static constexpr std::size_t chunk_bytes = 8u << 20;
+
+    boost::iostreams::mapped_file_source _mmap;
+    unsigned _num_threads;
+    ParseStats *_stats;
+public:
+    explicit TextRatings(const std::string &filename,
+                         const unsigned num_threads = 1,
+                         ParseStats *stats = nullptr) :
+        _mmap(filename), _num_threads{std::max(num_threads, 1u)}, _stats{stats}{}
+
+    // the number of ratings is not known until the file has been parsed
+    std::size_t size() const override   {return 0u;}
+    // parsing the mapping again is cheaper than growing containers of unknown size
+    bool multi_pass() const override    {return true;}
+
+    void for_each_block(const block_fn_t &fn) const override{
+        stopwatch sw;
+        sw.reset();
+        const auto bounds = split_lines(_mmap.data(), _mmap.data() + _mmap.size(), _mmap.size() / chunk_bytes + 1);
+        const std::size_t num_chunks = bounds.size() - 1;
+        std::vector<std::vector<Rating>> batch(_num_threads);
+        std::size_t num_ratings{0u};
+        for(std::size_t first{0u}; first < num_chunks; first += _num_threads){
+            const std::size_t batch_size = std::min<std::size_t>(_num_threads, num_chunks - first);
+            bool failed{false};
+            // only the parsing is timed, not the consumer
+            sw.start();
+#pragma omp parallel for num_threads(_num_threads) schedule(static, 1)
+            for(std::size_t b = 0; b < batch_size; ++b){
+                batch[b].clear();
+                batch[b].reserve(std::distance(bounds[first+b], bounds[first+b+1]) / bytes_per_line_hint);
+                try{
+                    parse_ratings(bounds[first+b], bounds[first+b+1], batch[b]);
+                }catch(const std::exception &){
+#pragma omp atomic write
+                    failed = true;
+                }
+            }
+            sw.stop();
+            if(failed)
+                throw std::runtime_error ("Unable to parse the ratings file.");
+            for(std::size_t b{0u}; b < batch_size; ++b){
+                num_ratings += batch[b].size();
+                if(!batch[b].empty())
+                    fn(batch[b].data(), batch[b].data() + batch[b].size());
+            }
+        }
+        if(_stats != nullptr){
+            _stats->_bytes = _mmap.size();
+            _stats->_ratings = num_ratings;
+            _stats->_elapsed_ms = sw.elapsed_ms();
+        }
+    }
+};
+constexpr std::size_t TextRatings::chunk_bytes;
+
+// forwards the blocks of another source, passing them to a tap function first
+// NOTE: the tap runs on every pass, so the source is never reported as multi-pass
+class TappedRatings : public RatingSource{
+    const RatingSource &_source;
+    block_fn_t _tap;
+public:
+    TappedRatings(const RatingSource &source, const block_fn_t &tap) : _source(source), _tap{tap}{}
+
+    std::size_t size() const override   {return _source.size();}
+    void for_each_block(const block_fn_t &fn) const override{
+        _source.for_each_block([&](const Rating *first, const Rating *last){
+            _tap(first, last);
+            fn(first, last);
+        });
+    }
+};
 
 #endif // RATING_HPP
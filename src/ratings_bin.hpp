@@ -0,0 +1,214 @@
+#ifndef RATINGS_BIN_HPP
+#define RATINGS_BIN_HPP
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <unordered_set>
+#include "ratings.hpp"
+#include "types.hpp"
+
+/*
+ * Binary columnar ratings format.
+ *
+ * | header | user ids | item ids | ratings |
+ *
+ * Each column is padded to a multiple of 8 bytes. Ids are stored either as 64-bit
+ * integers or, when the range of ids allows it, as 32-bit offsets from the minimum id.
+ * Ratings are stored as floats when they can be represented exactly, as doubles otherwise.
+ */
+struct BinaryRatingsHeader{
+    static constexpr char magic[8] = {'B', 'D', 'T', 'R', 'A', 'T', 'E', 'S'};
+    static constexpr uint32_t current_version = 1u;
+    static constexpr uint32_t ids_32bit = 1u;
+    static constexpr uint32_t ratings_32bit = 2u;
+
+    char _magic[8];
+    uint32_t _version;
+    uint32_t _flags;
+    uint64_t _num_ratings;
+    uint64_t _num_users;
+    uint64_t _num_items;
+    int64_t _min_user_id, _max_user_id;
+    int64_t _min_item_id, _max_item_id;
+
+    std::size_t id_bytes() const        {return (_flags & ids_32bit) ? 4u : 8u;}
+    std::size_t rating_bytes() const    {return (_flags & ratings_32bit) ? 4u : 8u;}
+    std::size_t users_offset() const    {return sizeof(BinaryRatingsHeader);}
+    std::size_t items_offset() const    {return users_offset() + padded(_num_ratings * id_bytes());}
+    std::size_t ratings_offset() const  {return items_offset() + padded(_num_ratings * id_bytes());}
+    std::size_t file_size() const       {return ratings_offset() + padded(_num_ratings * rating_bytes());}
+
+    static std::size_t padded(const std::size_t bytes){
+        return (bytes + 7u) & ~static_cast<std::size_t>(7u);
+    }
+};
+constexpr char BinaryRatingsHeader::magic[8];
+constexpr uint32_t BinaryRatingsHeader::current_version;
+constexpr uint32_t BinaryRatingsHeader::ids_32bit;
+constexpr uint32_t BinaryRatingsHeader::ratings_32bit;
+
+// true if the file starts with the binary ratings magic
+bool is_binary_ratings(const std::string &filename){
+    char buf[sizeof(BinaryRatingsHeader::magic)];
+    std::ifstream ifs(filename, std::ios::binary);
+    return ifs.read(buf, sizeof(buf)) &&
+            std::equal(buf, buf + sizeof(buf), BinaryRatingsHeader::magic);
+}
+
+namespace detail{
+
+template<typename T>
+void write_column(std::ostream &os, const std::vector<Rating> &ratings, std::function<T(const Rating&)> get){
+    std::vector<T> buf;
+    buf.reserve(std::min<std::size_t>(ratings.size(), 1u << 16));
+    for(auto it = ratings.cbegin(); it != ratings.cend(); ){
+        buf.clear();
+        for(; it != ratings.cend() && buf.size() < buf.capacity(); ++it)
+            buf.push_back(get(*it));
+        os.write(reinterpret_cast<const char*>(buf.data()), buf.size() * sizeof(T));
+    }
+    const char zeros[8] = {};
+    os.write(zeros, BinaryRatingsHeader::padded(ratings.size() * sizeof(T)) - ratings.size() * sizeof(T));
+}
+
+template<typename T>
+T read_column(const char *column, const std::size_t idx){
+    T value;
+    std::memcpy(&value, column + idx * sizeof(T), sizeof(T));
+    return value;
+}
+
+}
+
+// write the ratings in the binary columnar format
+// narrow ids and ratings are used whenever no information is lost
+BinaryRatingsHeader write_binary_ratings(const std::string &filename, const std::vector<Rating> &ratings){
+    BinaryRatingsHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::copy(BinaryRatingsHeader::magic, BinaryRatingsHeader::magic + sizeof(header._magic), header._magic);
+    header._version = BinaryRatingsHeader::current_version;
+    header._num_ratings = ratings.size();
+    header._min_user_id = header._min_item_id = std::numeric_limits<int64_t>::max();
+    header._max_user_id = header._max_item_id = std::numeric_limits<int64_t>::lowest();
+    bool exact_float{true};
+    std::unordered_set<id_type> users, items;
+    for(const auto &rat : ratings){
+        header._min_user_id = std::min(header._min_user_id, rat._user_id);
+        header._max_user_id = std::max(header._max_user_id, rat._user_id);
+        header._min_item_id = std::min(header._min_item_id, rat._item_id);
+        header._max_item_id = std::max(header._max_item_id, rat._item_id);
+        exact_float &= static_cast<double>(static_cast<float>(rat._value)) == rat._value;
+        users.insert(rat._user_id);
+        items.insert(rat._item_id);
+    }
+    header._num_users = users.size();
+    header._num_items = items.size();
+    if(ratings.empty()){
+        header._min_user_id = header._max_user_id = 0;
+        header._min_item_id = header._max_item_id = 0;
+    }
+    const uint64_t max_narrow = std::numeric_limits<uint32_t>::max();
+    // the spans are taken unsigned, they may not fit an id_type
+    if(static_cast<uint64_t>(header._max_user_id) - static_cast<uint64_t>(header._min_user_id) <= max_narrow &&
+            static_cast<uint64_t>(header._max_item_id) - static_cast<uint64_t>(header._min_item_id) <= max_narrow)
+        header._flags |= BinaryRatingsHeader::ids_32bit;
+    if(exact_float)
+        header._flags |= BinaryRatingsHeader::ratings_32bit;
+
+    std::ofstream ofs(filename, std::ios::binary);
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if(header._flags & BinaryRatingsHeader::ids_32bit){
+        const auto min_user = header._min_user_id, min_item = header._min_item_id;
+        detail::write_column<uint32_t>(ofs, ratings, [=](const Rating &r){return static_cast<uint32_t>(r._user_id - min_user);});
+        detail::write_column<uint32_t>(ofs, ratings, [=](const Rating &r){return static_cast<uint32_t>(r._item_id - min_item);});
+    }else{
+        detail::write_column<int64_t>(ofs, ratings, [](const Rating &r){return r._user_id;});
+        detail::write_column<int64_t>(ofs, ratings, [](const Rating &r){return r._item_id;});
+    }
+    if(header._flags & BinaryRatingsHeader::ratings_32bit)
+        detail::write_column<float>(ofs, ratings, [](const Rating &r){return static_cast<float>(r._value);});
+    else
+        detail::write_column<double>(ofs, ratings, [](const Rating &r){return r._value;});
+    if(!ofs)
+        throw std::runtime_error("Unable to write the binary ratings file " + filename);
+    return header;
+}
+
+// memory-mapped view over a binary ratings file
+// ratings are decoded from the columns on access, no parsing is involved
+class BinaryRatings : public RatingSource{
+    static constexpr std::size_t block_size = 1u << 16;
+
+    boost::iostreams::mapped_file_source _mmap;
+    BinaryRatingsHeader _header;
+    const char *_users;
+    const char *_items;
+    const char *_ratings;
+public:
+    explicit BinaryRatings(const std::string &filename) : _mmap(filename){
+        if(_mmap.size() < sizeof(BinaryRatingsHeader))
+            throw std::runtime_error("Invalid binary ratings file " + filename);
+        std::memcpy(&_header, _mmap.data(), sizeof(_header));
+        if(!std::equal(_header._magic, _header._magic + sizeof(_header._magic), BinaryRatingsHeader::magic) ||
+                _header._version != BinaryRatingsHeader::current_version ||
+                _mmap.size() < _header.file_size())
+            throw std::runtime_error("Invalid binary ratings file " + filename);
+        _users = _mmap.data() + _header.users_offset();
+        _items = _mmap.data() + _header.items_offset();
+        _ratings = _mmap.data() + _header.ratings_offset();
+    }
+
+    const BinaryRatingsHeader& header() const   {return _header;}
+    std::size_t size() const override           {return _header._num_ratings;}
+    bool multi_pass() const override            {return true;}
+
+    id_type user_id(const std::size_t idx) const{
+        return (_header._flags & BinaryRatingsHeader::ids_32bit) ?
+                    _header._min_user_id + detail::read_column<uint32_t>(_users, idx) :
+                    detail::read_column<int64_t>(_users, idx);
+    }
+
+    id_type item_id(const std::size_t idx) const{
+        return (_header._flags & BinaryRatingsHeader::ids_32bit) ?
+                    _header._min_item_id + detail::read_column<uint32_t>(_items, idx) :
+                    detail::read_column<int64_t>(_items, idx);
+    }
+
+    double value(const std::size_t idx) const{
+        return (_header._flags & BinaryRatingsHeader::ratings_32bit) ?
+                    detail::read_column<float>(_ratings, idx) :
+                    detail::read_column<double>(_ratings, idx);
+    }
+
+    Rating operator[](const std::size_t idx) const{
+        return Rating(user_id(idx), item_id(idx), value(idx));
+    }
+
+    // decode the ratings in [first, last) into out
+    void decode(const std::size_t first, const std::size_t last, Rating *out) const{
+        for(std::size_t idx{first}; idx < last; ++idx, ++out)
+            *out = (*this)[idx];
+    }
+
+    void for_each_block(const block_fn_t &fn) const override{
+        std::vector<Rating> block(std::min(block_size, size()));
+        for(std::size_t first{0u}; first < size(); first += block_size){
+            const auto last = std::min(first + block_size, size());
+            decode(first, last, block.data());
+            fn(block.data(), block.data() + (last - first));
+        }
+    }
+
+    std::vector<Rating> to_vector() const{
+        std::vector<Rating> ratings(size());
+        decode(0u, size(), ratings.data());
+        return ratings;
+    }
+};
+constexpr std::size_t BinaryRatings::block_size;
+
+#endif // RATINGS_BIN_HPP
@@ -0,0 +1,34 @@
+#ifndef RATINGS_IO_HPP
+#define RATINGS_IO_HPP
+#include <memory>
+#include <string>
+#include "ratings.hpp"
+#include "ratings_bin.hpp"
+#include "ratings_stream.hpp"
+#include "stopwatch.hpp"
+
+// open a ratings file picking the loader from its format:
+// binary columnar files are memory-mapped, gzip/bzip2 files (by extension) are decompressed and parsed
+// as a stream, plain text files are memory-mapped and parsed in parallel batches
+// NOTE: text sources fill stats only once they have been read
+std::unique_ptr<RatingSource> open_ratings(const std::string &filename,
+                                           const unsigned num_threads = 1,
+                                           ParseStats *stats = nullptr){
+    if(is_binary_ratings(filename)){
+        stopwatch sw;
+        sw.reset(); sw.start();
+        auto ratings = new BinaryRatings(filename);
+        sw.stop();
+        if(stats != nullptr){
+            stats->_bytes = ratings->header().file_size();
+            stats->_ratings = ratings->size();
+            stats->_elapsed_ms = sw.elapsed_ms();
+        }
+        return std::unique_ptr<RatingSource>(ratings);
+    }
+    if(compression_of(filename) != Compression::NONE)
+        return std::unique_ptr<RatingSource>(new CompressedRatings(filename, num_threads, stats));
+    return std::unique_ptr<RatingSource>(new TextRatings(filename, num_threads, stats));
+}
+
+#endif // RATINGS_IO_HPP
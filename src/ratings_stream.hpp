@@ -0,0 +1,243 @@
+#ifndef RATINGS_STREAM_HPP
+#define RATINGS_STREAM_HPP
+#include <boost/iostreams/device/file.hpp>
+#include <boost/iostreams/filter/bzip2.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "ratings.hpp"
+#include "stopwatch.hpp"
+
+enum class Compression{NONE, GZIP, BZIP2};
+
+// guess the compression of a file from its extension
+Compression compression_of(const std::string &filename){
+    auto ends_with = [&](const std::string &ext){
+        return filename.size() >= ext.size() &&
+                filename.compare(filename.size() - ext.size(), ext.size(), ext) == 0;
+    };
+    if(ends_with(".gz") || ends_with(".gzip"))
+        return Compression::GZIP;
+    if(ends_with(".bz2") || ends_with(".bzip2"))
+        return Compression::BZIP2;
+    return Compression::NONE;
+}
+
+// bounded multi-producer multi-consumer queue
+template<typename T>
+class BlockingQueue{
+    std::deque<T> _items;
+    std::size_t _capacity;
+    bool _closed;
+    std::mutex _mtx;
+    std::condition_variable _not_empty, _not_full;
+public:
+    explicit BlockingQueue(const std::size_t capacity) : _items{}, _capacity{capacity}, _closed{false}{}
+
+    // false when the queue has been closed
+    bool push(T item){
+        std::unique_lock<std::mutex> lock(_mtx);
+        _not_full.wait(lock, [&]{return _items.size() < _capacity || _closed;});
+        if(_closed) return false;
+        _items.push_back(std::move(item));
+        _not_empty.notify_one();
+        return true;
+    }
+
+    // false when the queue is closed and drained
+    bool pop(T &item){
+        std::unique_lock<std::mutex> lock(_mtx);
+        _not_empty.wait(lock, [&]{return !_items.empty() || _closed;});
+        if(_items.empty()) return false;
+        item = std::move(_items.front());
+        _items.pop_front();
+        _not_full.notify_one();
+        return true;
+    }
+
+    void close(){
+        std::lock_guard<std::mutex> lock(_mtx);
+        _closed = true;
+        _not_empty.notify_all();
+        _not_full.notify_all();
+    }
+};
+
+/*
+ * Ratings read from a gzip/bzip2 compressed text file.
+ * One thread decompresses the file into chunks of whole lines, the other threads parse the chunks
+ * while the next ones are decompressed. Blocks are handed out in file order.
+ */
+class CompressedRatings : public RatingSource{
+    static constexpr std::size_t chunk_size = 4u << 20;
+
+    std::string _filename;
+    Compression _compression;
+    unsigned _num_threads;
+    ParseStats *_stats;
+
+    using chunk_t = std::pair<std::size_t, std::string>;
+public:
+    CompressedRatings(const std::string &filename,
+                      const unsigned num_threads = 1,
+                      ParseStats *stats = nullptr) :
+        _filename{filename}, _compression{compression_of(filename)},
+        _num_threads{std::max(num_threads, 1u)}, _stats{stats}{}
+
+    // the number of ratings is not known until the file has been read
+    std::size_t size() const override   {return 0u;}
+
+    void for_each_block(const block_fn_t &fn) const override;
+
+protected:
+    // returns the number of chunks pushed to the queue
+    std::size_t decompress(BlockingQueue<chunk_t> &chunks, std::size_t &bytes) const;
+};
+constexpr std::size_t CompressedRatings::chunk_size;
+
+std::size_t CompressedRatings::decompress(BlockingQueue<chunk_t> &chunks, std::size_t &bytes) const{
+    namespace io = boost::iostreams;
+    io::filtering_istream in;
+    if(_compression == Compression::GZIP)
+        in.push(io::gzip_decompressor());
+    else if(_compression == Compression::BZIP2)
+        in.push(io::bzip2_decompressor());
+    if(!std::ifstream(_filename))
+        throw std::runtime_error("Unable to open " + _filename);
+    in.push(io::file_source(_filename, std::ios::in | std::ios::binary));
+
+    // the errors of the decompressors set the badbit: a truncated or corrupt file must not look
+    // like a shorter one
+    in.exceptions(std::ios::badbit);
+    std::string carry;
+    std::size_t seq{0u};
+    while(in){
+        std::string chunk(std::move(carry));
+        const auto used = chunk.size();
+        chunk.resize(used + chunk_size);
+        try{
+            in.read(&chunk[used], chunk_size);
+        }catch(const std::exception &e){
+            throw std::runtime_error("Unable to decompress " + _filename + ", the file is truncated or corrupt (" + e.what() + ")");
+        }
+        chunk.resize(used + in.gcount());
+        bytes += in.gcount();
+        // move the trailing partial line to the next chunk
+        if(in){
+            const auto eol = chunk.rfind('\n');
+            if(eol == std::string::npos){
+                carry.swap(chunk);
+                continue;
+            }
+            carry.assign(chunk, eol + 1, std::string::npos);
+            chunk.resize(eol + 1);
+        }
+        if(!chunk.empty() && !chunks.push(std::make_pair(seq++, std::move(chunk))))
+            break;
+    }
+    if(in.bad())
+        throw std::runtime_error("Unable to decompress " + _filename + ", the file is truncated or corrupt");
+    return seq;
+}
+
+void CompressedRatings::for_each_block(const block_fn_t &fn) const{
+    stopwatch sw;
+    sw.reset(); sw.start();
+    BlockingQueue<chunk_t> chunks(2 * _num_threads);
+    std::map<std::size_t, std::vector<Rating>> parsed;
+    std::size_t next{0u}, num_chunks{0u}, bytes{0u}, num_ratings{0u};
+    bool decompressed{false};
+    // the errors of the decompression win over those of the parse, that corrupt data can cause
+    std::exception_ptr error{nullptr}, read_error{nullptr};
+    std::mutex mtx;
+    std::condition_variable cv;
+
+    auto fail = [&](std::exception_ptr e){
+        std::lock_guard<std::mutex> lock(mtx);
+        if(!error) error = e;
+        chunks.close();
+        cv.notify_all();
+    };
+
+    std::thread reader([&]{
+        std::size_t count{0u};
+        try{
+            count = decompress(chunks, bytes);
+        }catch(...){
+            read_error = std::current_exception();
+            fail(read_error);
+        }
+        std::lock_guard<std::mutex> lock(mtx);
+        decompressed = true;
+        num_chunks = count;
+        chunks.close();
+        cv.notify_all();
+    });
+
+    std::vector<std::thread> parsers;
+    for(unsigned t{0u}; t < _num_threads; ++t){
+        parsers.emplace_back([&]{
+            chunk_t chunk;
+            while(chunks.pop(chunk)){
+                std::vector<Rating> ratings;
+                ratings.reserve(chunk.second.size() / bytes_per_line_hint);
+                try{
+                    parse_ratings(chunk.second.data(), chunk.second.data() + chunk.second.size(), ratings);
+                }catch(...){
+                    fail(std::current_exception());
+                    return;
+                }
+                std::unique_lock<std::mutex> lock(mtx);
+                // do not run too far ahead of the consumer
+                cv.wait(lock, [&]{return chunk.first < next + 2 * _num_threads || error;});
+                parsed.emplace(chunk.first, std::move(ratings));
+                cv.notify_all();
+            }
+        });
+    }
+
+    // hand out the parsed chunks in file order
+    while(true){
+        std::vector<Rating> ratings;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [&]{
+                return parsed.count(next) > 0 || error || (decompressed && next == num_chunks);
+            });
+            if(error || parsed.count(next) == 0) break;
+            ratings.swap(parsed[next]);
+            parsed.erase(next++);
+            cv.notify_all();
+        }
+        num_ratings += ratings.size();
+        try{
+            if(!ratings.empty())
+                fn(ratings.data(), ratings.data() + ratings.size());
+        }catch(...){
+            fail(std::current_exception());
+            break;
+        }
+    }
+    reader.join();
+    for(auto &parser : parsers)
+        parser.join();
+    if(read_error)
+        std::rethrow_exception(read_error);
+    if(error)
+        std::rethrow_exception(error);
+    sw.stop();
+    if(_stats != nullptr){
+        _stats->_bytes = bytes;
+        _stats->_ratings = num_ratings;
+        _stats->_elapsed_ms = sw.elapsed_ms();
+    }
+}
+
+#endif // RATINGS_STREAM_HPP
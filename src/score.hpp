@@ -34,5 +34,67 @@ struct ScoreUnbiased{
 
 };
 
+/*
+ * Compact records for the ABDTree indices, with 32-bit internal ids.
+ * The item index is only read for the rating class of its users, the user index also
+ * for the unbiased ratings that feed the stats: with floats they take 8 and 12 bytes.
+ */
+// posting of the item index: a user and its rating of the item
+template<typename Value>
+struct BasicItemScore{
+    dense_id_t _id;
+    Value _rating;
+
+    BasicItemScore(dense_id_t id, double rating) : _id{id}, _rating{static_cast<Value>(rating)}{}
+    BasicItemScore() : BasicItemScore(0u, .0){}
+
+    friend bool operator ==(const BasicItemScore &lhs, const BasicItemScore &rhs){
+        return lhs._id == rhs._id && lhs._rating == rhs._rating;
+    }
+    friend bool operator !=(const BasicItemScore &lhs, const BasicItemScore &rhs){
+        return !(lhs == rhs);
+    }
+    friend std::ostream &operator <<(std::ostream &os, const BasicItemScore &s){
+        os << "(" << s._id << ", " << s._rating << ")";
+        return os;
+    }
+    friend bool operator< (const BasicItemScore &lhs, const BasicItemScore &rhs){
+        return lhs._id < rhs._id ||
+                (lhs._id == rhs._id && lhs._rating < rhs._rating);
+    }
+};
+
+// posting of the user index: an item, its rating by the user and the rating without the user bias
+template<typename Value>
+struct BasicUserScore{
+    dense_id_t _id;
+    Value _rating;
+    Value _rating_unbiased;
+
+    BasicUserScore(dense_id_t id, double rating, double rating_unbiased) :
+        _id{id}, _rating{static_cast<Value>(rating)}, _rating_unbiased{static_cast<Value>(rating_unbiased)}{}
+    BasicUserScore() : BasicUserScore(0u, .0, .0){}
+
+    friend bool operator ==(const BasicUserScore &lhs, const BasicUserScore &rhs){
+        return lhs._id == rhs._id && lhs._rating == rhs._rating &&
+                lhs._rating_unbiased == rhs._rating_unbiased;
+    }
+    friend bool operator !=(const BasicUserScore &lhs, const BasicUserScore &rhs){
+        return !(lhs == rhs);
+    }
+    friend std::ostream &operator <<(std::ostream &os, const BasicUserScore &s){
+        os << "(" << s._id << ", "
+           << s._rating << ", "
+           << s._rating_unbiased << ")";
+        return os;
+    }
+    friend bool operator< (const BasicUserScore &lhs, const BasicUserScore &rhs){
+        return lhs._id < rhs._id ||
+                (lhs._id == rhs._id && lhs._rating < rhs._rating);
+    }
+};
+
+using ItemScore = BasicItemScore<float>;
+using UserScore = BasicUserScore<float>;
 
 #endif // SCORE_HPP
@@ -0,0 +1,159 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <unistd.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <omp.h>
+
+/*
+ * Snapshots of the prepared training indices.
+ * A snapshot is a header followed by flat arrays, each padded to a multiple of 8 bytes,
+ * so that it can be memory-mapped back and its arrays used in place.
+ */
+struct SnapshotHeader{
+    static constexpr char magic[8] = {'B', 'D', 'T', 'S', 'N', 'A', 'P', 'S'};
+    static constexpr uint32_t current_version = 5u;
+
+    char _magic[8];
+    uint32_t _version;
+    // layout checks, snapshots are not portable across builds with different record types
+    uint32_t _item_score_bytes;
+    uint32_t _user_score_bytes;
+    uint32_t _stats_bytes;
+    // postings per block of packed indices, 0 for plain rows
+    uint32_t _block_size;
+    // IdOrder of the internal ids
+    uint32_t _id_order;
+    uint64_t _content_hash;
+    double _bu_reg;
+    double _global_mean;
+    uint64_t _num_ratings;
+    uint64_t _num_users;
+    uint64_t _num_items;
+
+    static std::size_t padded(const std::size_t bytes){
+        return (bytes + 7u) & ~static_cast<std::size_t>(7u);
+    }
+};
+constexpr char SnapshotHeader::magic[8];
+constexpr uint32_t SnapshotHeader::current_version;
+
+// 64-bit hash of the content of a file
+// the file is hashed in fixed-size chunks in parallel, the result does not depend on num_threads
+uint64_t content_hash(const std::string &filename, const unsigned num_threads = 1){
+    constexpr std::size_t chunk_bytes = 64u << 20;
+    constexpr uint64_t k1 = 0x87C37B91114253D5ull, k2 = 0x4CF5AD432745937Full;
+    auto fmix = [](uint64_t h){
+        h ^= h >> 33; h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 33; h *= 0xC4CEB9FE1A85EC53ull;
+        return h ^ (h >> 33);
+    };
+    std::ifstream probe(filename, std::ios::binary | std::ios::ate);
+    if(!probe)
+        throw std::runtime_error("Unable to open " + filename);
+    const std::size_t size = probe.tellg();
+    if(size == 0u) return fmix(0u);
+    boost::iostreams::mapped_file_source mmap(filename);
+    const char *data = mmap.data();
+
+    const std::size_t num_chunks = (size + chunk_bytes - 1) / chunk_bytes;
+    std::vector<uint64_t> chunk_hashes(num_chunks);
+#pragma omp parallel for num_threads(num_threads) schedule(dynamic, 1)
+    for(std::size_t c = 0; c < num_chunks; ++c){
+        const char *first = data + c * chunk_bytes;
+        const std::size_t bytes = std::min(chunk_bytes, size - c * chunk_bytes);
+        uint64_t h{c};
+        std::size_t pos{0u};
+        for(; pos + 8u <= bytes; pos += 8u){
+            uint64_t w;
+            std::memcpy(&w, first + pos, 8u);
+            w *= k1; w = (w << 31) | (w >> 33); w *= k2;
+            h ^= w;
+            h = ((h << 27) | (h >> 37)) * 5u + 0x52DCE729u;
+        }
+        uint64_t tail{0u};
+        std::memcpy(&tail, first + pos, bytes - pos);
+        chunk_hashes[c] = fmix(h ^ (tail * k1) ^ bytes);
+    }
+    uint64_t h{size};
+    for(const auto ch : chunk_hashes)
+        h = fmix(h ^ ch) * k2;
+    return h;
+}
+
+// snapshot file name for a given training content and user bias regularization
+std::string snapshot_path(const std::string &dir, const uint64_t content_hash, const double bu_reg){
+    std::ostringstream oss;
+    oss << dir << "/" << std::hex << std::setw(16) << std::setfill('0') << content_hash
+        << std::dec << "-bu" << bu_reg << ".snap";
+    return oss.str();
+}
+
+// sequential writer of a snapshot
+// the file is written under a temporary name and renamed when closed, so that concurrent
+// runs never read a partial snapshot
+class SnapshotWriter{
+    std::string _filename;
+    std::string _tmp_filename;
+    std::ofstream _ofs;
+public:
+    explicit SnapshotWriter(const std::string &filename) :
+        _filename{filename}, _tmp_filename{filename + ".tmp" + std::to_string(::getpid())},
+        _ofs(_tmp_filename, std::ios::binary){
+        if(!_ofs)
+            throw std::runtime_error("Unable to write the snapshot " + filename);
+    }
+
+    template<typename T>
+    void write(const T *data, const std::size_t n){
+        _ofs.write(reinterpret_cast<const char*>(data), n * sizeof(T));
+        const char zeros[8] = {};
+        _ofs.write(zeros, SnapshotHeader::padded(n * sizeof(T)) - n * sizeof(T));
+    }
+
+    void close(){
+        _ofs.close();
+        if(!_ofs || std::rename(_tmp_filename.c_str(), _filename.c_str()) != 0){
+            std::remove(_tmp_filename.c_str());
+            throw std::runtime_error("Unable to write the snapshot " + _filename);
+        }
+    }
+};
+
+// memory-mapped snapshot, arrays are read in the order they were written
+class SnapshotReader{
+    boost::iostreams::mapped_file_source _mmap;
+    SnapshotHeader _header;
+    std::size_t _pos;
+public:
+    explicit SnapshotReader(const std::string &filename) : _mmap(filename), _pos{0u}{
+        if(_mmap.size() < sizeof(SnapshotHeader))
+            throw std::runtime_error("Invalid snapshot " + filename);
+        std::memcpy(&_header, _mmap.data(), sizeof(_header));
+        if(!std::equal(_header._magic, _header._magic + sizeof(_header._magic), SnapshotHeader::magic))
+            throw std::runtime_error("Invalid snapshot " + filename);
+        _pos = SnapshotHeader::padded(sizeof(SnapshotHeader));
+    }
+
+    const SnapshotHeader& header() const    {return _header;}
+
+    template<typename T>
+    const T* read(const std::size_t n){
+        const std::size_t bytes = SnapshotHeader::padded(n * sizeof(T));
+        if(_pos + bytes > _mmap.size())
+            throw std::runtime_error("Truncated snapshot");
+        auto data = reinterpret_cast<const T*>(_mmap.data() + _pos);
+        _pos += bytes;
+        return data;
+    }
+};
+
+#endif // SNAPSHOT_HPP
@@ -2,37 +2,56 @@
 #define STATS_HPP
 #include <algorithm>
 #include <iostream>
-#include <map>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
 #include <vector>
 #include "score.hpp"
+#include "stats_kernels.hpp"
 
-struct ABDStats{
+/*
+ * Rating statistics of an item over a group of users.
+ * Sum is the value type of the plain sums, that give the predictions, Unbiased the one of the
+ * unbiased sums, that give the squared error: sum2 - sum*sum/n cancels badly in low precision.
+ * Results are always computed in double precision.
+ */
+template<typename Sum, typename Unbiased = Sum>
+struct BasicABDStats{
     using score_t = ScoreUnbiased;
+    using sum_t = Sum;
+    using unbiased_t = Unbiased;
 
-    double _sum, _sum_unbiased;
-    double _sum2, _sum2_unbiased;
+    // widest members first, to keep the mixed layout at 32 bytes
+    Unbiased _sum_unbiased, _sum2_unbiased;
+    Sum _sum, _sum2;
     int _n;
 
-    ABDStats(double sum, double sum_unbiased, double sum2, double sum2_unbiased, int n) :
-        _sum{sum}, _sum_unbiased{sum_unbiased}, _sum2{sum2}, _sum2_unbiased{sum2_unbiased}, _n{n}{}
-    ABDStats() : ABDStats(.0, .0, .0, .0, 0){}
+    BasicABDStats(double sum, double sum_unbiased, double sum2, double sum2_unbiased, int n) :
+        _sum_unbiased{static_cast<Unbiased>(sum_unbiased)}, _sum2_unbiased{static_cast<Unbiased>(sum2_unbiased)},
+        _sum{static_cast<Sum>(sum)}, _sum2{static_cast<Sum>(sum2)}, _n{n}{}
+    BasicABDStats() : BasicABDStats(.0, .0, .0, .0, 0){}
 
-    void update(const ScoreUnbiased &score){
-        _sum += score._rating;
-        _sum_unbiased += score._rating_unbiased;
-        _sum2 += score._rating * score._rating;
-        _sum2_unbiased += score._rating_unbiased * score._rating_unbiased;
+    // any score with a rating and an unbiased rating, products are taken in double precision
+    template<typename Score>
+    void update(const Score &score){
+        const double rating = score._rating;
+        const double rating_unbiased = score._rating_unbiased;
+        _sum += rating;
+        _sum_unbiased += rating_unbiased;
+        _sum2 += rating * rating;
+        _sum2_unbiased += rating_unbiased * rating_unbiased;
         ++_n;
     }
 
     double squared_error() const{
         if(_n <= 0) throw std::runtime_error("n <= 0");
-        return _sum2_unbiased - (_sum_unbiased * _sum_unbiased) / _n;
+        const double sum_unbiased = _sum_unbiased;
+        return static_cast<double>(_sum2_unbiased) - (sum_unbiased * sum_unbiased) / _n;
     }
 
     double pred() const{
         if(_n <= 0) throw std::runtime_error("n <= 0");
-        return _sum / _n;
+        return static_cast<double>(_sum) / _n;
     }
 
     double pred(const double parent_pred, const double h_smooth) const{
@@ -41,14 +60,14 @@ struct ABDStats{
 
     double score() const{
         if(_n <= 0) throw std::runtime_error("n <= 0");
-        return _sum_unbiased / _n;
+        return static_cast<double>(_sum_unbiased) / _n;
     }
 
     double score(const double parent_score, const double h_smooth) const{
         return (_sum_unbiased + h_smooth * parent_score) / (_n + h_smooth);
     }
 
-    ABDStats& operator-=(const ABDStats &rhs){
+    BasicABDStats& operator-=(const BasicABDStats &rhs){
         this->_sum -= rhs._sum;
         this->_sum_unbiased -= rhs._sum_unbiased;
         this->_sum2 -= rhs._sum2;
@@ -57,7 +76,7 @@ struct ABDStats{
         return *this;
     }
 
-    friend std::ostream& operator<< (std::ostream &os, const ABDStats &stats){
+    friend std::ostream& operator<< (std::ostream &os, const BasicABDStats &stats){
         os << "sum: " << stats._sum
               << "\tsum(unbiased): " << stats._sum_unbiased
               << "\tsum2: " << stats._sum2
@@ -67,18 +86,392 @@ struct ABDStats{
     }
 };
 
+// precision of the tree statistics, picked at build time (BDTREE_STATS in CMake)
+// double: 40 bytes per entry, mixed: 32 bytes with double only for the unbiased sums, float: 20 bytes
+#if defined(BDTREE_STATS_FLOAT)
+using ABDStats = BasicABDStats<float>;
+#elif defined(BDTREE_STATS_MIXED)
+using ABDStats = BasicABDStats<float, double>;
+#else
+using ABDStats = BasicABDStats<double>;
+#endif
+
+/*
+ * Map from dense keys (internal ids) to the stats of BasicABDStats, iterated by increasing key.
+ * Small maps are a sorted vector of (key, stats) pairs. Past dense_threshold entries a map
+ * switches to one column per member of the stats, indexed by key, plus the list of the keys
+ * it holds: updates are O(1), clear() costs O(entries) and keeps the memory of both layouts,
+ * so that maps reused across candidate splitters never go back to the allocator, and the
+ * squared error and the stats of the unknown group run on the columns with the kernels of
+ * stats_kernels.hpp.
+ *
+ * Every entry has some ratings (_n > 0), stats set without ratings are not stored.
+ * The key list of the dense layout is sorted on the first iteration after an insertion.
+ * Copies are always compact and sorted, while iterating an unsorted map from several threads
+ * at once is not safe.
+ */
 template<typename K, typename S>
-using StatMap = std::map<K, S>;
+class StatMap{
+public:
+    using key_type = K;
+    using mapped_type = S;
+    using value_type = std::pair<K, S>;
+    static constexpr std::size_t dense_threshold = 64u;
+
+    // the dense layout has no pairs in memory, entries are assembled in the iterator
+    class const_iterator : public std::iterator<std::bidirectional_iterator_tag, const value_type>{
+        const StatMap *_map;
+        std::size_t _pos;
+        mutable value_type _entry;
+    public:
+        const_iterator(const StatMap *map, const std::size_t pos) : _map{map}, _pos{pos}, _entry{}{}
+        const_iterator() : const_iterator(nullptr, 0u){}
+
+        const value_type& operator*() const{
+            if(!_map->_is_dense)
+                return _map->_sparse[_pos];
+            const auto key = _map->_keys[_pos];
+            _entry = value_type(key, _map->slot(key));
+            return _entry;
+        }
+        const value_type* operator->() const    {return &**this;}
+        const_iterator& operator++()            {++_pos; return *this;}
+        const_iterator operator++(int)          {auto it = *this; ++_pos; return it;}
+        const_iterator& operator--()            {--_pos; return *this;}
+        const_iterator operator--(int)          {auto it = *this; --_pos; return it;}
+        friend bool operator ==(const const_iterator &lhs, const const_iterator &rhs){return lhs._pos == rhs._pos;}
+        friend bool operator !=(const const_iterator &lhs, const const_iterator &rhs){return lhs._pos != rhs._pos;}
+    };
+    using iterator = const_iterator;
+
+private:
+    using sum_t = typename S::sum_t;
+    using unbiased_t = typename S::unbiased_t;
+
+    // sorted entries of the sparse layout
+    std::vector<value_type> _sparse;
+    // columns of the dense layout, the slots of absent keys are all zeros
+    std::vector<unbiased_t> _sum_unbiased, _sum2_unbiased;
+    std::vector<sum_t> _sum, _sum2;
+    std::vector<int> _n;
+    mutable std::vector<K> _keys;
+    mutable bool _sorted;
+    bool _is_dense;
+public:
+    StatMap() : _sparse{}, _sum_unbiased{}, _sum2_unbiased{}, _sum{}, _sum2{}, _n{},
+        _keys{}, _sorted{true}, _is_dense{false}{}
+    StatMap(const StatMap &other) : StatMap(){
+        _sparse.reserve(other.size());
+        _sparse.assign(other.cbegin(), other.cend());
+    }
+    StatMap(StatMap &&other) = default;
+    StatMap& operator=(const StatMap &other){
+        if(this != &other){
+            clear();
+            _sparse.assign(other.cbegin(), other.cend());
+        }
+        return *this;
+    }
+    StatMap& operator=(StatMap &&other) = default;
+    ~StatMap(){}
+
+    // a compact copy of the map that leaves it empty: the entries of the sparse layout are moved,
+    // those of the dense layout are copied out of the columns, which keep their memory
+    StatMap take_compact(){
+        StatMap compact;
+        if(_is_dense){
+            compact._sparse.reserve(size());
+            compact._sparse.assign(cbegin(), cend());
+            clear();
+        }else{
+            compact._sparse.swap(_sparse);
+        }
+        return compact;
+    }
+
+    std::size_t size() const    {return _is_dense ? _keys.size() : _sparse.size();}
+    bool empty() const          {return size() == 0u;}
+    bool is_dense() const       {return _is_dense;}
+
+    // add a score with a rating and an unbiased rating to the stats of a key
+    template<typename Score>
+    void update(const K &key, const Score &score){
+        if(!_is_dense){
+            auto it = std::lower_bound(_sparse.begin(), _sparse.end(), key, key_less);
+            if(it != _sparse.end() && it->first == key){
+                it->second.update(score);
+                return;
+            }
+            if(_sparse.size() < dense_threshold){
+                _sparse.insert(it, value_type(key, S{}))->second.update(score);
+                return;
+            }
+            to_dense();
+        }
+        const auto pos = dense_slot(key);
+        const double rating = score._rating;
+        const double rating_unbiased = score._rating_unbiased;
+        _sum[pos] += rating;
+        _sum_unbiased[pos] += rating_unbiased;
+        _sum2[pos] += rating * rating;
+        _sum2_unbiased[pos] += rating_unbiased * rating_unbiased;
+        ++_n[pos];
+    }
+
+    // replace the stats of a key
+    void set(const K &key, const S &stats){
+        if(!_is_dense){
+            auto it = std::lower_bound(_sparse.begin(), _sparse.end(), key, key_less);
+            if(it != _sparse.end() && it->first == key){
+                if(stats._n > 0)
+                    it->second = stats;
+                else
+                    _sparse.erase(it);
+                return;
+            }
+            if(stats._n <= 0) return;
+            if(_sparse.size() < dense_threshold){
+                _sparse.insert(it, value_type(key, stats));
+                return;
+            }
+            to_dense();
+        }
+        if(stats._n > 0){
+            set_slot(dense_slot(key), stats);
+        }else if(count(key) > 0){
+            set_slot(static_cast<std::size_t>(key), S{});
+            _keys.erase(std::find(_keys.begin(), _keys.end(), key));
+        }
+    }
+
+    S at(const K &key) const{
+        if(count(key) == 0u)
+            throw std::out_of_range("Key not in the stat map");
+        if(_is_dense)
+            return slot(key);
+        return std::lower_bound(_sparse.cbegin(), _sparse.cend(), key, key_less)->second;
+    }
+
+    std::size_t count(const K &key) const{
+        if(_is_dense){
+            const auto pos = static_cast<std::size_t>(key);
+            return pos < _n.size() && _n[pos] > 0 ? 1u : 0u;
+        }
+        auto it = std::lower_bound(_sparse.cbegin(), _sparse.cend(), key, key_less);
+        return it != _sparse.cend() && it->first == key ? 1u : 0u;
+    }
+
+    // sum of the squared errors of all the entries
+    double squared_error() const{
+        if(!_is_dense){
+            double lanes[8] = {};
+            for(std::size_t pos{0u}; pos < _sparse.size(); ++pos)
+                lanes[pos % 8] += _sparse[pos].second.squared_error();
+            return stats_kernels::sum_lanes(lanes);
+        }
+        if(mostly_full())
+            return stats_kernels::squared_error(_sum_unbiased.data(), _sum2_unbiased.data(), _n.data(), _n.size());
+        sort_keys();
+        return stats_kernels::squared_error(_sum_unbiased.data(), _sum2_unbiased.data(), _n.data(),
+                                            _keys.data(), _keys.size());
+    }
+
+    // set the map to the stats of whole minus those of the parts, e.g. the unknown group of
+    // a split from the node and the other groups
+    // pre: the keys of the parts are keys of whole
+    template<typename It>
+    void assign_difference(const StatMap &whole, It first_part, It last_part){
+        clear();
+        _is_dense = true;
+        if(whole.empty()) return;
+        if(!(whole._is_dense && whole.mostly_full())){
+            // a pass over the entries of whole
+            resize_columns(static_cast<std::size_t>(std::prev(whole.cend())->first) + 1);
+            for(const auto &entry : whole){
+                auto stats = entry.second;
+                for(auto it = first_part; it != last_part; ++it)
+                    if(it->count(entry.first) > 0)
+                        stats -= it->at(entry.first);
+                if(stats._n > 0){
+                    set_slot(static_cast<std::size_t>(entry.first), stats);
+                    _keys.push_back(entry.first);
+                }
+            }
+            return;
+        }
+        // a pass over the columns of whole
+        const auto num_slots = whole._n.size();
+        resize_columns(num_slots);
+        std::copy(whole._sum_unbiased.cbegin(), whole._sum_unbiased.cend(), _sum_unbiased.begin());
+        std::copy(whole._sum2_unbiased.cbegin(), whole._sum2_unbiased.cend(), _sum2_unbiased.begin());
+        std::copy(whole._sum.cbegin(), whole._sum.cend(), _sum.begin());
+        std::copy(whole._sum2.cbegin(), whole._sum2.cend(), _sum2.begin());
+        std::copy(whole._n.cbegin(), whole._n.cend(), _n.begin());
+        for(; first_part != last_part; ++first_part){
+            const StatMap &part = *first_part;
+            if(part._is_dense && part.mostly_full()){
+                const auto num_part_slots = std::min(num_slots, part._n.size());
+                stats_kernels::subtract(_sum_unbiased.data(), part._sum_unbiased.data(), num_part_slots);
+                stats_kernels::subtract(_sum2_unbiased.data(), part._sum2_unbiased.data(), num_part_slots);
+                stats_kernels::subtract(_sum.data(), part._sum.data(), num_part_slots);
+                stats_kernels::subtract(_sum2.data(), part._sum2.data(), num_part_slots);
+                stats_kernels::subtract(_n.data(), part._n.data(), num_part_slots);
+            }else if(part._is_dense){
+                for(const auto key : part._keys)
+                    subtract_slot(static_cast<std::size_t>(key), part.slot(key));
+            }else{
+                for(const auto &entry : part._sparse)
+                    subtract_slot(static_cast<std::size_t>(entry.first), entry.second);
+            }
+        }
+        _keys.resize(num_slots);
+        _keys.resize(stats_kernels::nonzero_keys(_n.data(), num_slots, _keys.data()));
+        // the keys with no ratings left are cleared of the rounding residues
+        if(_keys.size() < whole.size()){
+            for(const auto key : whole._keys)
+                if(_n[key] == 0)
+                    set_slot(static_cast<std::size_t>(key), S{});
+        }
+    }
+
+    // make the map a dense copy of another one
+    void assign_dense(const StatMap &other){
+        clear();
+        _is_dense = true;
+        if(other.empty()) return;
+        resize_columns(static_cast<std::size_t>(std::prev(other.cend())->first) + 1);
+        for(const auto &entry : other){
+            set_slot(static_cast<std::size_t>(entry.first), entry.second);
+            _keys.push_back(entry.first);
+        }
+    }
+
+    // remove all the entries, keeping the memory of both layouts
+    void clear(){
+        if(_is_dense && mostly_full()){
+            std::fill(_sum_unbiased.begin(), _sum_unbiased.end(), unbiased_t{});
+            std::fill(_sum2_unbiased.begin(), _sum2_unbiased.end(), unbiased_t{});
+            std::fill(_sum.begin(), _sum.end(), sum_t{});
+            std::fill(_sum2.begin(), _sum2.end(), sum_t{});
+            std::fill(_n.begin(), _n.end(), 0);
+        }else{
+            for(const auto key : _keys)
+                set_slot(static_cast<std::size_t>(key), S{});
+        }
+        _keys.clear();
+        _sparse.clear();
+        _sorted = true;
+        _is_dense = false;
+    }
+
+    void swap(StatMap &other){
+        _sparse.swap(other._sparse);
+        _sum_unbiased.swap(other._sum_unbiased);
+        _sum2_unbiased.swap(other._sum2_unbiased);
+        _sum.swap(other._sum);
+        _sum2.swap(other._sum2);
+        _n.swap(other._n);
+        _keys.swap(other._keys);
+        std::swap(_sorted, other._sorted);
+        std::swap(_is_dense, other._is_dense);
+    }
+
+    const_iterator begin() const    {return cbegin();}
+    const_iterator end() const      {return cend();}
+    const_iterator cbegin() const{
+        if(_is_dense) sort_keys();
+        return const_iterator(this, 0u);
+    }
+    const_iterator cend() const     {return const_iterator(this, size());}
+
+private:
+    static bool key_less(const value_type &entry, const K &key){
+        return entry.first < key;
+    }
+
+    // a good share of the slots is used, a pass over the columns beats going through the keys
+    bool mostly_full() const{
+        return _keys.size() * 8u > _n.size();
+    }
+
+    S slot(const K &key) const{
+        const auto pos = static_cast<std::size_t>(key);
+        S stats;
+        stats._sum_unbiased = _sum_unbiased[pos];
+        stats._sum2_unbiased = _sum2_unbiased[pos];
+        stats._sum = _sum[pos];
+        stats._sum2 = _sum2[pos];
+        stats._n = _n[pos];
+        return stats;
+    }
+
+    void set_slot(const std::size_t pos, const S &stats){
+        _sum_unbiased[pos] = stats._sum_unbiased;
+        _sum2_unbiased[pos] = stats._sum2_unbiased;
+        _sum[pos] = stats._sum;
+        _sum2[pos] = stats._sum2;
+        _n[pos] = stats._n;
+    }
+
+    void subtract_slot(const std::size_t pos, const S &stats){
+        _sum_unbiased[pos] -= stats._sum_unbiased;
+        _sum2_unbiased[pos] -= stats._sum2_unbiased;
+        _sum[pos] -= stats._sum;
+        _sum2[pos] -= stats._sum2;
+        _n[pos] -= stats._n;
+    }
+
+    void resize_columns(const std::size_t num_slots){
+        if(num_slots <= _n.size()) return;
+        const auto size = std::max(num_slots, 2 * _n.size());
+        _sum_unbiased.resize(size, unbiased_t{});
+        _sum2_unbiased.resize(size, unbiased_t{});
+        _sum.resize(size, sum_t{});
+        _sum2.resize(size, sum_t{});
+        _n.resize(size, 0);
+    }
+
+    // the slot of a key, added to the keys if it is empty
+    std::size_t dense_slot(const K &key){
+        const auto pos = static_cast<std::size_t>(key);
+        resize_columns(pos + 1);
+        if(_n[pos] == 0){
+            _sorted = _sorted && (_keys.empty() || _keys.back() < key);
+            _keys.push_back(key);
+        }
+        return pos;
+    }
+
+    // move the sparse entries, already sorted, to the dense layout
+    void to_dense(){
+        _is_dense = true;
+        _sorted = true;
+        for(const auto &entry : _sparse)
+            set_slot(dense_slot(entry.first), entry.second);
+        _sparse.clear();
+    }
+
+    void sort_keys() const{
+        if(_sorted) return;
+        if(mostly_full()){
+            _keys.clear();
+            for(std::size_t pos{0u}; pos < _n.size(); ++pos)
+                if(_n[pos] > 0)
+                    _keys.push_back(static_cast<K>(pos));
+        }else{
+            std::sort(_keys.begin(), _keys.end());
+        }
+        _sorted = true;
+    }
+};
+template<typename K, typename S>
+constexpr std::size_t StatMap<K, S>::dense_threshold;
 
 template<typename K, typename S>
 double compute_quality(const StatMap<K, S> &map){
-    double q{.0};
-    for(const auto entry : map)
-        q -= entry.second.squared_error();
-    return q;
+    return -map.squared_error();
 }
 
-
 template<typename K, typename S>
 std::vector<K> rank_all_items(const StatMap<K, S> &stats){
     std::vector<std::pair<K, double>> items_by_score;
@@ -97,15 +490,17 @@ std::vector<K> rank_all_items(const StatMap<K, S> &stats){
 }
 
 template<typename K, typename S>
-std::vector<K> rank_all_items(const StatMap<K, S> &stats, const std::map<K, double> &parent_scores, const double h_smooth){
-    // sort items by smoothed score
+std::vector<K> rank_all_items(const StatMap<K, S> &stats, const std::vector<double> &parent_scores, const double h_smooth){
+    // sort items by smoothed score, parent_scores is indexed by internal item id
     std::vector<std::pair<K, double>> items_by_score;
     items_by_score.reserve(parent_scores.size());
-    for(const auto &p_pred : parent_scores){
-        if(stats.count(p_pred.first) > 0){
-            items_by_score.emplace_back(p_pred.first, stats.at(p_pred.first).score(p_pred.second, h_smooth));
+    auto it_stats = stats.cbegin();
+    for(K item{0}; item < static_cast<K>(parent_scores.size()); ++item){
+        if(it_stats != stats.cend() && it_stats->first == item){
+            items_by_score.emplace_back(item, it_stats->second.score(parent_scores[item], h_smooth));
+            ++it_stats;
         }else{
-            items_by_score.emplace_back(p_pred.first, p_pred.second);
+            items_by_score.emplace_back(item, parent_scores[item]);
         }
     }
     std::sort(items_by_score.begin(),
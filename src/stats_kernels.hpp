@@ -0,0 +1,361 @@
+#ifndef STATS_KERNELS_HPP
+#define STATS_KERNELS_HPP
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define BDTREE_SIMD_X86
+#endif
+
+/*
+ * Kernels over the columns of the dense stat maps, with AVX2 and AVX-512 variants picked at
+ * runtime and a scalar fallback.
+ * Reductions accumulate in 8 lanes, element i in lane i % 8, and add the lanes up in the same
+ * order in every variant: the results do not depend on the instruction set.
+ * The level can be lowered with the BDTREE_SIMD environment variable (scalar, avx2, avx512).
+ */
+namespace stats_kernels{
+
+enum class SimdLevel{scalar = 0, avx2 = 1, avx512 = 2};
+
+const char* level_name(const SimdLevel level){
+    switch(level){
+    case SimdLevel::avx512: return "avx512";
+    case SimdLevel::avx2:   return "avx2";
+    default:                return "scalar";
+    }
+}
+
+// the best level supported by the cpu
+SimdLevel supported_level(){
+#ifdef BDTREE_SIMD_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f"))
+        return SimdLevel::avx512;
+    if(__builtin_cpu_supports("avx2"))
+        return SimdLevel::avx2;
+#endif
+    return SimdLevel::scalar;
+}
+
+SimdLevel& active_level(){
+    static SimdLevel level = []{
+        SimdLevel best = supported_level();
+        const char *env = std::getenv("BDTREE_SIMD");
+        if(env != nullptr){
+            const std::string name(env);
+            for(const auto requested : {SimdLevel::scalar, SimdLevel::avx2, SimdLevel::avx512})
+                if(name == level_name(requested) && requested < best)
+                    best = requested;
+        }
+        return best;
+    }();
+    return level;
+}
+
+SimdLevel simd_level(){
+    return active_level();
+}
+
+// use at most the given level, e.g. to compare the kernels, returns the level in use
+SimdLevel set_simd_level(const SimdLevel level){
+    active_level() = level < supported_level() ? level : supported_level();
+    return active_level();
+}
+
+// add up the 8 lanes of a reduction
+double sum_lanes(const double *lanes){
+    return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+}
+
+namespace detail{
+
+// squared error of one slot, 0 for the empty ones
+template<typename U>
+double slot_error(const U sum, const U sum2, const int n){
+    return n > 0 ? static_cast<double>(sum2) - (static_cast<double>(sum) * sum) / n : .0;
+}
+
+template<typename U>
+double squared_error_scalar(const U *sum, const U *sum2, const int *n, std::size_t first, const std::size_t last){
+    double lanes[8] = {};
+    for(; first < last; ++first)
+        lanes[first % 8] += slot_error(sum[first], sum2[first], n[first]);
+    return sum_lanes(lanes);
+}
+
+template<typename U, typename K>
+double squared_error_scalar(const U *sum, const U *sum2, const int *n, const K *keys,
+                            std::size_t first, const std::size_t last, double *lanes){
+    for(; first < last; ++first)
+        lanes[first % 8] += slot_error(sum[keys[first]], sum2[keys[first]], n[keys[first]]);
+    return sum_lanes(lanes);
+}
+
+template<typename T>
+void subtract_scalar(T *dst, const T *src, std::size_t first, const std::size_t last){
+    for(; first < last; ++first)
+        dst[first] -= src[first];
+}
+
+template<typename K>
+std::size_t nonzero_keys_scalar(const int *n, std::size_t first, const std::size_t last, K *keys){
+    std::size_t num_keys{0u};
+    for(; first < last; ++first)
+        if(n[first] > 0)
+            keys[num_keys++] = static_cast<K>(first);
+    return num_keys;
+}
+
+#ifdef BDTREE_SIMD_X86
+// 4 values widened to double
+__attribute__((target("avx2"))) __m256d load4(const double *p)    {return _mm256_loadu_pd(p);}
+__attribute__((target("avx2"))) __m256d load4(const float *p)     {return _mm256_cvtps_pd(_mm_loadu_ps(p));}
+__attribute__((target("avx2"))) __m256d gather4(const double *p, const __m256i idx)  {return _mm256_i64gather_pd(p, idx, 8);}
+__attribute__((target("avx2"))) __m256d gather4(const float *p, const __m256i idx)   {return _mm256_cvtps_pd(_mm256_i64gather_ps(p, idx, 4));}
+
+// lanes of the squared errors of 4 slots, the empty ones masked out
+__attribute__((target("avx2")))
+__m256d errors4(const __m256d sum, const __m256d sum2, const __m256d n){
+    const __m256d full = _mm256_cmp_pd(n, _mm256_setzero_pd(), _CMP_GT_OQ);
+    return _mm256_and_pd(full, _mm256_sub_pd(sum2, _mm256_div_pd(_mm256_mul_pd(sum, sum), n)));
+}
+
+template<typename U>
+__attribute__((target("avx2")))
+double squared_error_avx2(const U *sum, const U *sum2, const int *n, const std::size_t count){
+    __m256d lo = _mm256_setzero_pd(), hi = _mm256_setzero_pd();
+    std::size_t i{0u};
+    for(; i + 8u <= count; i += 8u){
+        const __m256d n_lo = _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i*>(n + i)));
+        const __m256d n_hi = _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i*>(n + i + 4)));
+        lo = _mm256_add_pd(lo, errors4(load4(sum + i), load4(sum2 + i), n_lo));
+        hi = _mm256_add_pd(hi, errors4(load4(sum + i + 4), load4(sum2 + i + 4), n_hi));
+    }
+    double lanes[8];
+    _mm256_storeu_pd(lanes, lo);
+    _mm256_storeu_pd(lanes + 4, hi);
+    for(; i < count; ++i)
+        lanes[i % 8] += slot_error(sum[i], sum2[i], n[i]);
+    return sum_lanes(lanes);
+}
+
+template<typename U>
+__attribute__((target("avx2")))
+double squared_error_avx2(const U *sum, const U *sum2, const int *n, const int64_t *keys, const std::size_t count){
+    __m256d lo = _mm256_setzero_pd(), hi = _mm256_setzero_pd();
+    std::size_t i{0u};
+    for(; i + 8u <= count; i += 8u){
+        const __m256i k_lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+        const __m256i k_hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i + 4));
+        lo = _mm256_add_pd(lo, errors4(gather4(sum, k_lo), gather4(sum2, k_lo),
+                                       _mm256_cvtepi32_pd(_mm256_i64gather_epi32(n, k_lo, 4))));
+        hi = _mm256_add_pd(hi, errors4(gather4(sum, k_hi), gather4(sum2, k_hi),
+                                       _mm256_cvtepi32_pd(_mm256_i64gather_epi32(n, k_hi, 4))));
+    }
+    double lanes[8];
+    _mm256_storeu_pd(lanes, lo);
+    _mm256_storeu_pd(lanes + 4, hi);
+    return squared_error_scalar(sum, sum2, n, keys, i, count, lanes);
+}
+
+// 8 values widened to double
+// the masked forms with a zero source keep gcc from warning about the undefined one of the others
+__attribute__((target("avx512f"))) __m512d load8(const double *p)  {return _mm512_loadu_pd(p);}
+__attribute__((target("avx512f"))) __m512d load8(const float *p)   {return _mm512_maskz_cvtps_pd(0xFF, _mm256_loadu_ps(p));}
+__attribute__((target("avx512f"))) __m512d load8(const int *p){
+    return _mm512_maskz_cvtepi32_pd(0xFF, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+}
+__attribute__((target("avx512f"))) __m512d gather8(const double *p, const __m512i idx){
+    return _mm512_mask_i64gather_pd(_mm512_setzero_pd(), 0xFF, idx, p, 8);
+}
+__attribute__((target("avx512f"))) __m512d gather8(const float *p, const __m512i idx){
+    return _mm512_maskz_cvtps_pd(0xFF, _mm512_mask_i64gather_ps(_mm256_setzero_ps(), 0xFF, idx, p, 4));
+}
+__attribute__((target("avx512f"))) __m512d gather8(const int *p, const __m512i idx){
+    return _mm512_maskz_cvtepi32_pd(0xFF, _mm512_mask_i64gather_epi32(_mm256_setzero_si256(), 0xFF, idx, p, 4));
+}
+
+// adds the squared errors of 8 slots to the lanes, the empty ones are masked out
+__attribute__((target("avx512f")))
+__m512d add_errors8(const __m512d acc, const __m512d sum, const __m512d sum2, const __m512d n){
+    const __mmask8 full = _mm512_cmp_pd_mask(n, _mm512_setzero_pd(), _CMP_GT_OQ);
+    const __m512d ratio = _mm512_maskz_div_pd(full, _mm512_mul_pd(sum, sum), n);
+    return _mm512_mask_add_pd(acc, full, acc, _mm512_sub_pd(sum2, ratio));
+}
+
+template<typename U>
+__attribute__((target("avx512f")))
+double squared_error_avx512(const U *sum, const U *sum2, const int *n, const std::size_t count){
+    __m512d acc = _mm512_setzero_pd();
+    std::size_t i{0u};
+    for(; i + 8u <= count; i += 8u){
+        acc = add_errors8(acc, load8(sum + i), load8(sum2 + i), load8(n + i));
+    }
+    double lanes[8];
+    _mm512_storeu_pd(lanes, acc);
+    for(; i < count; ++i)
+        lanes[i % 8] += slot_error(sum[i], sum2[i], n[i]);
+    return sum_lanes(lanes);
+}
+
+template<typename U>
+__attribute__((target("avx512f")))
+double squared_error_avx512(const U *sum, const U *sum2, const int *n, const int64_t *keys, const std::size_t count){
+    __m512d acc = _mm512_setzero_pd();
+    std::size_t i{0u};
+    for(; i + 8u <= count; i += 8u){
+        const __m512i k8 = _mm512_loadu_si512(keys + i);
+        acc = add_errors8(acc, gather8(sum, k8), gather8(sum2, k8), gather8(n, k8));
+    }
+    double lanes[8];
+    _mm512_storeu_pd(lanes, acc);
+    return squared_error_scalar(sum, sum2, n, keys, i, count, lanes);
+}
+
+__attribute__((target("avx2")))
+void subtract_avx2(double *dst, const double *src, const std::size_t count){
+    std::size_t i{0u};
+    for(; i + 4u <= count; i += 4u)
+        _mm256_storeu_pd(dst + i, _mm256_sub_pd(_mm256_loadu_pd(dst + i), _mm256_loadu_pd(src + i)));
+    subtract_scalar(dst, src, i, count);
+}
+__attribute__((target("avx2")))
+void subtract_avx2(float *dst, const float *src, const std::size_t count){
+    std::size_t i{0u};
+    for(; i + 8u <= count; i += 8u)
+        _mm256_storeu_ps(dst + i, _mm256_sub_ps(_mm256_loadu_ps(dst + i), _mm256_loadu_ps(src + i)));
+    subtract_scalar(dst, src, i, count);
+}
+__attribute__((target("avx2")))
+void subtract_avx2(int *dst, const int *src, const std::size_t count){
+    std::size_t i{0u};
+    for(; i + 8u <= count; i += 8u){
+        const auto lhs = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        const auto rhs = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_sub_epi32(lhs, rhs));
+    }
+    subtract_scalar(dst, src, i, count);
+}
+
+__attribute__((target("avx512f")))
+void subtract_avx512(double *dst, const double *src, const std::size_t count){
+    std::size_t i{0u};
+    for(; i + 8u <= count; i += 8u)
+        _mm512_storeu_pd(dst + i, _mm512_sub_pd(_mm512_loadu_pd(dst + i), _mm512_loadu_pd(src + i)));
+    subtract_scalar(dst, src, i, count);
+}
+__attribute__((target("avx512f")))
+void subtract_avx512(float *dst, const float *src, const std::size_t count){
+    std::size_t i{0u};
+    for(; i + 16u <= count; i += 16u)
+        _mm512_storeu_ps(dst + i, _mm512_sub_ps(_mm512_loadu_ps(dst + i), _mm512_loadu_ps(src + i)));
+    subtract_scalar(dst, src, i, count);
+}
+__attribute__((target("avx512f")))
+void subtract_avx512(int *dst, const int *src, const std::size_t count){
+    std::size_t i{0u};
+    for(; i + 16u <= count; i += 16u)
+        _mm512_storeu_si512(dst + i, _mm512_sub_epi32(_mm512_loadu_si512(dst + i), _mm512_loadu_si512(src + i)));
+    subtract_scalar(dst, src, i, count);
+}
+
+__attribute__((target("avx2")))
+std::size_t nonzero_keys_avx2(const int *n, const std::size_t count, int64_t *keys){
+    std::size_t i{0u}, num_keys{0u};
+    for(; i + 8u <= count; i += 8u){
+        const __m256i full = _mm256_cmpgt_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(n + i)),
+                                                _mm256_setzero_si256());
+        for(unsigned bits = _mm256_movemask_ps(_mm256_castsi256_ps(full)); bits != 0u; bits &= bits - 1)
+            keys[num_keys++] = i + __builtin_ctz(bits);
+    }
+    return num_keys + nonzero_keys_scalar(n, i, count, keys + num_keys);
+}
+
+__attribute__((target("avx512f")))
+std::size_t nonzero_keys_avx512(const int *n, const std::size_t count, int64_t *keys){
+    std::size_t i{0u}, num_keys{0u};
+    const __m512i lanes = _mm512_setr_epi64(0, 1, 2, 3, 4, 5, 6, 7);
+    for(; i + 16u <= count; i += 16u){
+        const __mmask16 full = _mm512_cmpgt_epi32_mask(_mm512_loadu_si512(n + i), _mm512_setzero_si512());
+        const __m512i lo = _mm512_add_epi64(lanes, _mm512_set1_epi64(i));
+        const __m512i hi = _mm512_add_epi64(lo, _mm512_set1_epi64(8));
+        _mm512_mask_compressstoreu_epi64(keys + num_keys, static_cast<__mmask8>(full), lo);
+        num_keys += __builtin_popcount(full & 0xFFu);
+        _mm512_mask_compressstoreu_epi64(keys + num_keys, static_cast<__mmask8>(full >> 8), hi);
+        num_keys += __builtin_popcount(full >> 8);
+    }
+    return num_keys + nonzero_keys_scalar(n, i, count, keys + num_keys);
+}
+#endif // BDTREE_SIMD_X86
+
+} // namespace detail
+
+// sum of sum2[i] - sum[i]^2 / n[i] over the slots [0, count), the empty slots (n[i] == 0) are skipped
+template<typename U>
+double squared_error(const U *sum, const U *sum2, const int *n, const std::size_t count,
+                     __attribute__((unused)) const SimdLevel level = simd_level()){
+#ifdef BDTREE_SIMD_X86
+    if(level == SimdLevel::avx512)
+        return detail::squared_error_avx512(sum, sum2, n, count);
+    if(level == SimdLevel::avx2)
+        return detail::squared_error_avx2(sum, sum2, n, count);
+#endif
+    return detail::squared_error_scalar(sum, sum2, n, 0u, count);
+}
+
+// same as above over the slots of the given keys, gathered in the order of the keys
+template<typename U, typename K>
+double squared_error(const U *sum, const U *sum2, const int *n, const K *keys, const std::size_t count,
+                     __attribute__((unused)) const SimdLevel level = simd_level()){
+    double lanes[8] = {};
+    return detail::squared_error_scalar(sum, sum2, n, keys, 0u, count, lanes);
+}
+
+template<typename U>
+double squared_error(const U *sum, const U *sum2, const int *n, const int64_t *keys, const std::size_t count,
+                     __attribute__((unused)) const SimdLevel level = simd_level()){
+#ifdef BDTREE_SIMD_X86
+    if(level == SimdLevel::avx512)
+        return detail::squared_error_avx512(sum, sum2, n, keys, count);
+    if(level == SimdLevel::avx2)
+        return detail::squared_error_avx2(sum, sum2, n, keys, count);
+#endif
+    double lanes[8] = {};
+    return detail::squared_error_scalar(sum, sum2, n, keys, 0u, count, lanes);
+}
+
+// dst[i] -= src[i] over [0, count), for double, float and int columns
+template<typename T>
+void subtract(T *dst, const T *src, const std::size_t count, __attribute__((unused)) const SimdLevel level = simd_level()){
+#ifdef BDTREE_SIMD_X86
+    if(level == SimdLevel::avx512)
+        return detail::subtract_avx512(dst, src, count);
+    if(level == SimdLevel::avx2)
+        return detail::subtract_avx2(dst, src, count);
+#endif
+    detail::subtract_scalar(dst, src, 0u, count);
+}
+
+// write the slots [0, count) with n[i] > 0 to keys, in increasing order, and return their number
+template<typename K>
+std::size_t nonzero_keys(const int *n, const std::size_t count, K *keys,
+                         __attribute__((unused)) const SimdLevel level = simd_level()){
+    return detail::nonzero_keys_scalar(n, 0u, count, keys);
+}
+
+std::size_t nonzero_keys(const int *n, const std::size_t count, int64_t *keys,
+                         __attribute__((unused)) const SimdLevel level = simd_level()){
+#ifdef BDTREE_SIMD_X86
+    if(level == SimdLevel::avx512)
+        return detail::nonzero_keys_avx512(n, count, keys);
+    if(level == SimdLevel::avx2)
+        return detail::nonzero_keys_avx2(n, count, keys);
+#endif
+    return detail::nonzero_keys_scalar(n, 0u, count, keys);
+}
+
+} // namespace stats_kernels
+
+#endif // STATS_KERNELS_HPP
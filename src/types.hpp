@@ -1,14 +1,43 @@
 #ifndef TYPES_HPP
 #define TYPES_HPP
+#include <cstdint>
+#include <initializer_list>
 #include <map>
 #include <vector>
 #include <unordered_map>
+#ifdef BDTREE_DENSE_HASH_MAP
 #include <google/dense_hash_map>
 
+// google::dense_hash_map with -1, never a valid id, as the empty key
 template<typename K, typename V>
-using hash_map_t = google::dense_hash_map<K, V>;
+class DenseHashMap : public google::dense_hash_map<K, V>{
+public:
+    DenseHashMap() : google::dense_hash_map<K, V>(){
+        this->set_empty_key(-1);
+    }
+    explicit DenseHashMap(const std::size_t n) : google::dense_hash_map<K, V>(n){
+        this->set_empty_key(-1);
+    }
+    DenseHashMap(std::initializer_list<std::pair<const K, V>> init) : DenseHashMap(init.size()){
+        this->insert(init.begin(), init.end());
+    }
+    void reserve(const std::size_t n){
+        this->resize(n);
+    }
+};
+
+template<typename K, typename V>
+using hash_map_t = DenseHashMap<K, V>;
+#else
+#include "flat_hash_map.hpp"
+
+template<typename K, typename V>
+using hash_map_t = FlatHashMap<K, V>;
+#endif
 
 using id_type = int64_t;
+// contiguous internal ids, see IdMap
+using dense_id_t = uint32_t;
 using group_t = std::vector<id_type>;
 using profile_t = hash_map_t<id_type, double>;
 
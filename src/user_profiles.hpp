@@ -0,0 +1,270 @@
+#ifndef USER_PROFILES_HPP
+#define USER_PROFILES_HPP
+#include <algorithm>
+#include <exception>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "ratings.hpp"
+#include "ratings_stream.hpp"
+#include "types.hpp"
+
+// read-only view over the ratings of a single user, sorted by item id
+class ProfileView{
+    const id_type *_items;
+    const double *_ratings;
+    std::size_t _size;
+public:
+    class const_iterator : public std::iterator<std::forward_iterator_tag, std::pair<id_type, double>>{
+        const ProfileView *_view;
+        std::size_t _pos;
+    public:
+        const_iterator(const ProfileView *view, const std::size_t pos) : _view{view}, _pos{pos}{}
+        std::pair<id_type, double> operator*() const {return std::make_pair(_view->item(_pos), _view->rating(_pos));}
+        const_iterator& operator++()    {++_pos; return *this;}
+        friend bool operator ==(const const_iterator &lhs, const const_iterator &rhs){return lhs._pos == rhs._pos;}
+        friend bool operator !=(const const_iterator &lhs, const const_iterator &rhs){return lhs._pos != rhs._pos;}
+    };
+
+    ProfileView(const id_type *items, const double *ratings, const std::size_t size) :
+        _items{items}, _ratings{ratings}, _size{size}{}
+    ProfileView() : ProfileView(nullptr, nullptr, 0u){}
+
+    std::size_t size() const                    {return _size;}
+    bool empty() const                          {return _size == 0u;}
+    id_type item(const std::size_t pos) const   {return _items[pos];}
+    double rating(const std::size_t pos) const  {return _ratings[pos];}
+    const_iterator begin() const                {return const_iterator(this, 0u);}
+    const_iterator end() const                  {return const_iterator(this, _size);}
+
+    // pointer to the rating of an item, nullptr if the user did not rate it
+    const double* find(const id_type item_id) const{
+        auto it = std::lower_bound(_items, _items + _size, item_id);
+        if(it == _items + _size || *it != item_id)
+            return nullptr;
+        return _ratings + (it - _items);
+    }
+
+    std::size_t count(const id_type item_id) const{
+        return find(item_id) != nullptr ? 1u : 0u;
+    }
+
+    double operator[](const id_type item_id) const{
+        auto rating = find(item_id);
+        if(rating == nullptr)
+            throw std::out_of_range("Item " + std::to_string(item_id) + " not in profile");
+        return *rating;
+    }
+
+    std::vector<id_type> items() const{
+        return std::vector<id_type>(_items, _items + _size);
+    }
+};
+
+// the -sorted- rated items
+std::vector<id_type> extract_keys(const ProfileView &profile){
+    return profile.items();
+}
+
+/*
+ * Profiles of a set of users in compressed row layout: users are sorted by id, the ratings
+ * of the i-th user are stored in [offsets[i], offsets[i+1]) of the item and rating arrays.
+ * If a user rated an item more than once, the last rating wins.
+ */
+class UserProfiles{
+    std::vector<id_type> _users;
+    std::vector<std::size_t> _offsets;
+    std::vector<id_type> _items;
+    std::vector<double> _ratings;
+public:
+    static constexpr std::size_t npos = std::numeric_limits<std::size_t>::max();
+
+    UserProfiles() : _users{}, _offsets(1, 0u), _items{}, _ratings{}{}
+
+    // replace the profiles with the ratings of the source
+    // returns the average rating
+    double assign(const RatingSource &source);
+
+    std::size_t size() const                    {return _users.size();}
+    bool empty() const                          {return _users.empty();}
+    std::size_t num_ratings() const             {return _items.size();}
+    id_type user(const std::size_t idx) const   {return _users[idx];}
+
+    ProfileView profile(const std::size_t idx) const{
+        return ProfileView(_items.data() + _offsets[idx],
+                           _ratings.data() + _offsets[idx],
+                           _offsets[idx + 1] - _offsets[idx]);
+    }
+
+    // position of a user, npos if not found
+    std::size_t find(const id_type user_id) const{
+        auto it = std::lower_bound(_users.cbegin(), _users.cend(), user_id);
+        if(it == _users.cend() || *it != user_id)
+            return npos;
+        return std::distance(_users.cbegin(), it);
+    }
+
+    std::size_t count(const id_type user_id) const{
+        return find(user_id) != npos ? 1u : 0u;
+    }
+};
+constexpr std::size_t UserProfiles::npos;
+
+double UserProfiles::assign(const RatingSource &source){
+    std::vector<Rating> ratings;
+    ratings.reserve(source.size());
+    double sum{.0};
+    source.for_each_block([&](const Rating *first, const Rating *last){
+        for(auto rat = first; rat != last; ++rat)
+            sum += rat->_value;
+        ratings.insert(ratings.end(), first, last);
+    });
+    // stable, so that the last of repeated ratings comes last
+    std::stable_sort(ratings.begin(), ratings.end(), [](const Rating &lhs, const Rating &rhs){
+        return lhs._user_id < rhs._user_id ||
+                (lhs._user_id == rhs._user_id && lhs._item_id < rhs._item_id);
+    });
+    _users.clear();
+    _offsets.assign(1, 0u);
+    _items.clear();
+    _ratings.clear();
+    _items.reserve(ratings.size());
+    _ratings.reserve(ratings.size());
+    for(auto it = ratings.cbegin(); it != ratings.cend(); ++it){
+        auto next = it + 1;
+        if(next != ratings.cend() && next->_user_id == it->_user_id && next->_item_id == it->_item_id)
+            continue;
+        if(_users.empty() || _users.back() != it->_user_id){
+            if(!_users.empty())
+                _offsets.push_back(_items.size());
+            _users.push_back(it->_user_id);
+        }
+        _items.push_back(it->_item_id);
+        _ratings.push_back(it->_value);
+    }
+    if(!_users.empty())
+        _offsets.push_back(_items.size());
+    return sum / ratings.size();
+}
+
+/*
+ * Profiles read one user at a time from a source sorted by user id.
+ * The source is read on a background thread into a short queue of blocks, so only the
+ * blocks in flight and the current profile are in memory at any time.
+ * Profiles are built as in UserProfiles: sorted by item id, the last repeated rating wins.
+ */
+// thrown by ProfileStream when a user comes after a larger one, with the name of the source
+class UnsortedRatingsError : public std::runtime_error{
+    std::string _filename;
+public:
+    UnsortedRatingsError(const std::string &filename, const std::string &what) :
+        std::runtime_error(what), _filename{filename}{}
+    const std::string& filename() const {return _filename;}
+};
+
+class ProfileStream{
+    static constexpr std::size_t max_blocks = 4u;
+    using block_t = std::vector<Rating>;
+    // thrown from the source callback to stop reading when the stream is destroyed early
+    struct stream_closed{};
+
+    BlockingQueue<block_t> _blocks;
+    std::exception_ptr _error;
+    std::thread _reader;
+    block_t _block;
+    std::size_t _pos;
+    std::string _name;
+    bool _started;
+    id_type _user;
+    block_t _profile;
+    std::vector<id_type> _items;
+    std::vector<double> _ratings;
+public:
+    // name is the file of the source, reported when it is not sorted
+    explicit ProfileStream(const RatingSource &source, const std::string &name = "") :
+        _blocks{max_blocks}, _error{nullptr}, _reader{}, _block{}, _pos{0u}, _name{name}, _started{false}, _user{0}{
+        _reader = std::thread([this, &source]{
+            try{
+                source.for_each_block([this](const Rating *first, const Rating *last){
+                    if(!_blocks.push(block_t(first, last)))
+                        throw stream_closed();
+                });
+            }catch(const stream_closed &){
+            }catch(...){
+                _error = std::current_exception();
+            }
+            _blocks.close();
+        });
+    }
+    ProfileStream(const ProfileStream&) = delete;
+    ProfileStream& operator=(const ProfileStream&) = delete;
+
+    ~ProfileStream(){
+        _blocks.close();
+        if(_reader.joinable())
+            _reader.join();
+    }
+
+    // move to the profile of the next user, false at the end of the source
+    bool next();
+
+    id_type user() const    {return _user;}
+
+    // valid until the next call to next()
+    ProfileView profile() const{
+        return ProfileView(_items.data(), _ratings.data(), _items.size());
+    }
+
+private:
+    // the next rating of the source, nullptr at the end
+    const Rating* peek(){
+        while(_pos == _block.size()){
+            if(!_blocks.pop(_block)){
+                _reader.join();
+                if(_error)
+                    std::rethrow_exception(_error);
+                return nullptr;
+            }
+            _pos = 0u;
+        }
+        return &_block[_pos];
+    }
+};
+constexpr std::size_t ProfileStream::max_blocks;
+
+bool ProfileStream::next(){
+    _items.clear();
+    _ratings.clear();
+    if(!_reader.joinable()) return false;
+    const Rating *rat = peek();
+    if(rat == nullptr) return false;
+    if(_started && rat->_user_id <= _user)
+        throw UnsortedRatingsError(_name, "Ratings " + (_name.empty() ? std::string{} : "of " + _name + " ") +
+                                   "are not sorted by user: user " + std::to_string(rat->_user_id) +
+                                   " found after user " + std::to_string(_user));
+    _started = true;
+    _user = rat->_user_id;
+    _profile.clear();
+    for(; rat != nullptr && rat->_user_id == _user; rat = peek()){
+        _profile.push_back(*rat);
+        ++_pos;
+    }
+    // stable, so that the last of repeated ratings comes last
+    std::stable_sort(_profile.begin(), _profile.end(), [](const Rating &lhs, const Rating &rhs){
+        return lhs._item_id < rhs._item_id;
+    });
+    for(auto it = _profile.cbegin(); it != _profile.cend(); ++it){
+        auto next = it + 1;
+        if(next != _profile.cend() && next->_item_id == it->_item_id)
+            continue;
+        _items.push_back(it->_item_id);
+        _ratings.push_back(it->_value);
+    }
+    return true;
+}
+
+#endif // USER_PROFILES_HPP
@@ -0,0 +1,48 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include <vector>
+#include "abd_tree.hpp"
+
+// users who loved, hated or did not rate item 0, user 0 rated it twice, as hated first or last
+std::vector<Rating> duplicate_ratings(const bool loved_first){
+    std::vector<Rating> ratings;
+    if(loved_first)
+        ratings.emplace_back(0, 0, 5);
+    for(int user = 0; user < 12; ++user){
+        for(int item = user < 10 ? 0 : 1; item < 6; ++item){
+            const bool loves = user > 0 && user < 5;
+            ratings.emplace_back(user, item, item == 0 ? (loves ? 5 : 1) : 1 + (user + item) % 5);
+        }
+    }
+    if(!loved_first)
+        ratings.emplace_back(0, 0, 5);
+    return ratings;
+}
+
+TEST(ABDTreeTest, DuplicateSplitterTest){
+    // a user who rated the splitter more than once goes to a single group, the one of its lowest
+    // rating whatever the order of the ratings in the training data
+    for(const bool loved_first : {false, true}){
+        SCOPED_TRACE(loved_first ? "loved first" : "hated first");
+        std::ostringstream log;
+        ABDTree tree{7, 100, 2, 1, 0, 1, false, 10, true, IdOrder::external, BasicLogger{log}};
+        const auto ratings = duplicate_ratings(loved_first);
+        tree.init(ratings);
+        tree.build({0});
+        const auto root = tree.root();
+        ASSERT_EQ(3u, root->_children.size());
+        EXPECT_EQ(0, root->_splitter_id);
+        EXPECT_EQ(12u, root->_num_users);
+        EXPECT_EQ(ratings.size(), root->_num_ratings);
+        EXPECT_EQ(4u, root->traverse_loved()->_num_users);
+        EXPECT_EQ(6u, root->traverse_hated()->_num_users);
+        EXPECT_EQ(2u, root->traverse_unknown()->_num_users);
+        // the profile of user 0 is counted in one group only
+        std::size_t num_ratings{0u};
+        for(const auto &child : root->_children)
+            num_ratings += child->_num_ratings;
+        EXPECT_EQ(root->_num_ratings, num_ratings);
+        EXPECT_EQ(4u * 6u, root->traverse_loved()->_num_ratings);
+        EXPECT_EQ(6u * 6u + 1u, root->traverse_hated()->_num_ratings);
+    }
+}
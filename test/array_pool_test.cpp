@@ -0,0 +1,42 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdint>
+#include <set>
+#include <vector>
+#include "array_pool.hpp"
+
+TEST(ArrayPoolTest, ReuseTest){
+    // released arrays are handed out again before new ones are carved
+    ArrayPool<uint32_t> pool(1000u, false);
+    auto first = pool.acquire(), second = pool.acquire();
+    EXPECT_NE(first, second);
+    EXPECT_EQ(0u, first[999]);
+    pool.release(first);
+    EXPECT_EQ(first, pool.acquire());
+    EXPECT_EQ(2u, pool.allocated());
+    EXPECT_EQ(3u, pool.acquired());
+    EXPECT_EQ(2u, pool.in_use());
+    EXPECT_EQ(1u, pool.slabs());
+    EXPECT_EQ(2u * 1000u * sizeof(uint32_t), pool.memory_bytes());
+}
+
+TEST(ArrayPoolTest, SlabTest){
+    // arrays of 1.5 MB take a slab each, the arrays never overlap
+    for(const bool huge : {false, true}){
+        ArrayPool<uint64_t> pool(3u << 17, huge);
+        std::vector<uint64_t*> arrays;
+        for(unsigned idx{0u}; idx < 3u; ++idx){
+            arrays.push_back(pool.acquire());
+            std::fill(arrays.back(), arrays.back() + pool.length(), idx);
+        }
+        EXPECT_EQ(3u, pool.slabs());
+        EXPECT_EQ(3u, std::set<uint64_t*>(arrays.cbegin(), arrays.cend()).size());
+        for(unsigned idx{0u}; idx < 3u; ++idx){
+            EXPECT_EQ(idx, arrays[idx][0]);
+            EXPECT_EQ(idx, arrays[idx][pool.length() - 1]);
+        }
+        if(huge){
+            EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(arrays[0]) % (2u << 20));
+        }
+    }
+}
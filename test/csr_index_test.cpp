@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <vector>
+#include "csr_index.hpp"
+#include "stats.hpp"
+#include "types.hpp"
+
+using item_rows = CSRIndex<id_type, ABDStats, ItemScore>;
+
+template<typename Index>
+std::vector<ItemScore> scores_of(const Index &index, const id_type key){
+    return std::vector<ItemScore>(index[key].cbegin(), index[key].cend());
+}
+
+// rows of 0 to 9 scores, key k holding ids k, 2k, ..., in decreasing order
+item_rows make_rows(const std::size_t num_keys){
+    item_rows rows;
+    for(id_type key{0}; key < static_cast<id_type>(num_keys); ++key){
+        const std::size_t n = key * 7 % 10;
+        rows.reserve(key, n);
+        for(std::size_t i{n}; i > 0u; --i)
+            rows.insert(key, ItemScore(i * key, i % 5 + 1));
+    }
+    return rows;
+}
+
+TEST(CSRIndexTest, InsertTest){
+    // reserved keys are filled in place, the other scores are staged until the index is packed
+    item_rows rows;
+    rows.reserve(0, 2u);
+    rows.reserve(2, 1u);
+    rows.insert(0, ItemScore(4u, 1));
+    rows.insert(2, ItemScore(1u, 2));
+    rows.insert(2, ItemScore(0u, 3));
+    rows.insert(5, ItemScore(7u, 4));
+    rows.insert(0, ItemScore(3u, 5));
+    EXPECT_THROW(rows.reserve(1, 1u), std::logic_error);
+    rows.shrink_to_fit();
+    ASSERT_EQ(6u, rows.size());
+    EXPECT_EQ(5u, rows.num_scores());
+    // the scores of a key keep their order of insertion, unfilled reservations are dropped
+    EXPECT_EQ((std::vector<ItemScore>{{4u, 1}, {3u, 5}}), scores_of(rows, 0));
+    EXPECT_EQ((std::vector<ItemScore>{{1u, 2}, {0u, 3}}), scores_of(rows, 2));
+    EXPECT_EQ((std::vector<ItemScore>{{7u, 4}}), scores_of(rows, 5));
+    for(const id_type key : {1, 3, 4})
+        EXPECT_TRUE(rows[key].empty());
+    EXPECT_THROW(rows.at(6), std::out_of_range);
+
+    rows.sort_all();
+    EXPECT_EQ((std::vector<ItemScore>{{3u, 5}, {4u, 1}}), scores_of(rows, 0));
+    EXPECT_EQ((std::vector<ItemScore>{{0u, 3}, {1u, 2}}), scores_of(rows, 2));
+}
+
+TEST(CSRIndexTest, RelabelTest){
+    auto rows = make_rows(12u);
+    const auto before = rows;
+    std::vector<dense_id_t> key_perm(rows.size()), id_perm(12u * 9u + 1u);
+    for(std::size_t key{0u}; key < key_perm.size(); ++key)
+        key_perm[key] = (key * 5u) % key_perm.size();
+    for(std::size_t id{0u}; id < id_perm.size(); ++id)
+        id_perm[id] = id_perm.size() - 1u - id;
+    rows.relabel(key_perm, id_perm);
+    ASSERT_EQ(before.size(), rows.size());
+    EXPECT_EQ(before.num_scores(), rows.num_scores());
+    for(id_type key{0}; key < static_cast<id_type>(before.size()); ++key){
+        auto expected = scores_of(before, key);
+        for(auto &score : expected)
+            score._id = id_perm[score._id];
+        EXPECT_EQ(expected, scores_of(rows, key_perm[key])) << "key " << key;
+    }
+}
+
+TEST(CSRIndexTest, RetainTest){
+    auto rows = make_rows(12u);
+    const auto before = rows;
+    const std::vector<id_type> kept{1, 2, 5, 9, 11};
+    rows.retain_keys(kept.cbegin(), kept.cend());
+    // the keys stay, only the kept ones have scores
+    ASSERT_EQ(before.size(), rows.size());
+    std::size_t num_scores{0u};
+    for(id_type key{0}; key < static_cast<id_type>(before.size()); ++key){
+        if(std::binary_search(kept.cbegin(), kept.cend(), key)){
+            EXPECT_EQ(scores_of(before, key), scores_of(rows, key)) << "key " << key;
+            num_scores += before.num_scores(key);
+        }else{
+            EXPECT_TRUE(rows[key].empty()) << "key " << key;
+        }
+    }
+    EXPECT_EQ(num_scores, rows.num_scores());
+}
+
+TEST(CSRIndexTest, RearrangeTest){
+    // all the keys: the scores past the first one are sorted
+    auto rows = make_rows(12u);
+    const auto before = rows;
+    const auto range = [&rows](const id_type key){
+        return item_rows::bound_t(std::min<std::size_t>(1u, rows.num_scores(key)), rows.num_scores(key));
+    };
+    const auto sort = [](const id_type, item_rows::range_iterator first, item_rows::range_iterator last){
+        std::sort(first, last);
+    };
+    rows.rearrange(range, sort);
+    for(id_type key{0}; key < static_cast<id_type>(before.size()); ++key){
+        auto expected = scores_of(before, key);
+        if(!expected.empty())
+            std::sort(expected.begin() + 1, expected.end());
+        EXPECT_EQ(expected, scores_of(rows, key)) << "key " << key;
+    }
+
+    // some keys, on several threads: the whole rows are reversed, the others are untouched
+    rows = before;
+    const std::vector<id_type> keys{7, 1, 4, 10, 9};
+    std::vector<unsigned> calls(rows.size(), 0u);
+    rows.rearrange(keys.cbegin(), keys.cend(), [&rows](const id_type key){
+        return item_rows::bound_t(0u, rows.num_scores(key));
+    }, [&calls](const id_type key, item_rows::range_iterator first, item_rows::range_iterator last){
+        ++calls[key];
+        std::reverse(first, last);
+    }, 3u);
+    for(id_type key{0}; key < static_cast<id_type>(before.size()); ++key){
+        const bool rearranged = std::find(keys.cbegin(), keys.cend(), key) != keys.cend();
+        EXPECT_EQ(rearranged ? 1u : 0u, calls[key]);
+        auto expected = scores_of(before, key);
+        if(rearranged)
+            std::reverse(expected.begin(), expected.end());
+        EXPECT_EQ(expected, scores_of(rows, key)) << "key " << key;
+    }
+}
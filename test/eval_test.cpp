@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "abd_tree.hpp"
+#include "d_tree_eval.hpp"
+
+constexpr unsigned N = 10;
+
+// a tree trained on users whose tastes depend on their id, and answer and evaluation files of
+// other users with the same tastes
+class EvalTest : public ::testing::Test{
+protected:
+    std::string _dir;
+    std::ostringstream _log;
+    std::unique_ptr<ABDTree> _tree;
+
+    static double rating(const int user, const int item){
+        return 1 + (user % 3 == item % 3 ? 3 : 0) + (user + item) % 2;
+    }
+
+    void SetUp() override{
+        char dir[] = "/tmp/eval_test_XXXXXX";
+        ASSERT_NE(nullptr, ::mkdtemp(dir));
+        _dir = dir;
+        std::vector<Rating> training;
+        for(int user = 0; user < 300; ++user)
+            for(int item = user % 5; item < 60; item += 2)
+                training.emplace_back(user, item, rating(user, item));
+        _tree.reset(new ABDTree{7, 100, 3, 100, 0, 1, false, 10, true, IdOrder::external, BasicLogger{_log}});
+        _tree->init(training);
+        _tree->build();
+        std::ofstream ans(_dir + "/ans.txt"), eval(_dir + "/eval.txt");
+        for(int user = 1000; user < 1090; ++user)
+            for(int item = user % 4; item < 60; ++item)
+                (item % 3 == 0 ? eval : ans) << user << " " << item << " " << rating(user, item) << "\n";
+    }
+
+    void TearDown() override{
+        const auto ret = std::system(("rm -rf " + _dir).c_str());
+        (void)ret;
+    }
+};
+
+TEST_F(EvalTest, StreamingTest){
+    // the profiles read one user at a time give the metrics of the profiles loaded at once
+    std::vector<std::vector<double>> results[2];
+    for(const bool streaming : {false, true}){
+        AddedRatingsAcc<ABDTree> added(*_tree);
+        RmseAcc<ABDTree> rmse(*_tree);
+        RankingAcc<ABDTree, Precision<N>> p(*_tree);
+        RankingAcc<ABDTree, NDCG<N>> ndcg(*_tree);
+        const std::vector<LevelAccumulator<ABDTree>*> metrics{&added, &rmse, &p, &ndcg};
+        if(streaming){
+            EXPECT_EQ(90u, evaluate_users_streaming(*_tree, _dir + "/ans.txt", _dir + "/eval.txt", metrics));
+        }else{
+            user_profiles_t answers, eval;
+            build_profiles(_dir + "/ans.txt", answers);
+            build_profiles(_dir + "/eval.txt", eval);
+            evaluate_users(*_tree, answers, eval, metrics);
+        }
+        for(const auto metric : metrics)
+            results[streaming].push_back(metric->result());
+    }
+    EXPECT_EQ(results[0], results[1]);
+    // the tree has splits, and the users go down them
+    EXPECT_LT(0., results[1][1][1]);
+}
+
+TEST_F(EvalTest, UnsortedTest){
+    {
+        std::ofstream eval(_dir + "/unsorted.txt");
+        eval << "1001 3 4\n1003 6 1\n1002 9 5\n";
+    }
+    RmseAcc<ABDTree> rmse(*_tree);
+    try{
+        evaluate_users_streaming(*_tree, _dir + "/ans.txt", _dir + "/unsorted.txt", {&rmse});
+        FAIL() << "unsorted file accepted";
+    }catch(const UnsortedRatingsError &e){
+        EXPECT_EQ(_dir + "/unsorted.txt", e.filename());
+        EXPECT_NE(std::string::npos, std::string(e.what()).find("user 1002 found after user 1003"));
+    }
+}
@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "flat_hash_map.hpp"
+#include "types.hpp"
+
+using flat_map = FlatHashMap<id_type, double>;
+
+template<typename Map>
+std::vector<id_type> sorted_keys(const Map &map){
+    std::vector<id_type> keys;
+    for(const auto &entry : map)
+        keys.push_back(entry.first);
+    std::sort(keys.begin(), keys.end());
+    return keys;
+}
+
+TEST(FlatHashMapTest, LookupTest){
+    flat_map map;
+    EXPECT_TRUE(map.empty());
+    EXPECT_TRUE(map.begin() == map.end());
+    EXPECT_EQ(0u, map.count(3));
+    // no key is reserved
+    for(const id_type key : {-1, 0, 7, -2})
+        EXPECT_TRUE(map.insert(std::make_pair(key, key * .5)).second);
+    EXPECT_FALSE(map.insert(std::make_pair(7, 1.0)).second);
+    EXPECT_EQ(4u, map.size());
+    EXPECT_EQ(std::vector<id_type>({-2, -1, 0, 7}), sorted_keys(map));
+    EXPECT_DOUBLE_EQ(3.5, map.at(7));
+    EXPECT_DOUBLE_EQ(-.5, map.find(-1)->second);
+    EXPECT_TRUE(map.find(5) == map.end());
+    EXPECT_THROW(map.at(5), std::out_of_range);
+    EXPECT_DOUBLE_EQ(.0, map[5]);
+    EXPECT_EQ(5u, map.size());
+}
+
+TEST(FlatHashMapTest, InitListTest){
+    // the first entry of a repeated key wins, as with insert
+    const flat_map map{{3, 1.}, {-1, 2.}, {3, 4.}};
+    EXPECT_EQ(2u, map.size());
+    EXPECT_EQ(std::vector<id_type>({-1, 3}), sorted_keys(map));
+    EXPECT_DOUBLE_EQ(1., map.at(3));
+    EXPECT_TRUE(flat_map{}.empty());
+    EXPECT_TRUE(flat_map({}).empty());
+}
+
+TEST(FlatHashMapTest, ReserveTest){
+    flat_map map(1000u);
+    const auto capacity = map.bucket_count();
+    EXPECT_LE(1000u, capacity * 7 / 8);
+    for(id_type key{0}; key < 1000; ++key)
+        map[key * 64] = key;
+    EXPECT_EQ(capacity, map.bucket_count());
+    map.clear();
+    EXPECT_TRUE(map.empty());
+    EXPECT_TRUE(map.begin() == map.end());
+    EXPECT_EQ(capacity, map.bucket_count());
+}
+
+TEST(FlatHashMapTest, RandomTest){
+    // the same inserts and erases as a std::unordered_map, with many tombstones and rehashes
+    FlatHashMap<id_type, std::string> map;
+    std::unordered_map<id_type, std::string> expected;
+    for(id_type i{0}; i < 20000; ++i){
+        const id_type key = (i * 7919) % 3001;
+        if(i % 3 == 2){
+            EXPECT_EQ(expected.erase(key), map.erase(key));
+        }else{
+            map[key] += std::to_string(i);
+            expected[key] += std::to_string(i);
+        }
+    }
+    ASSERT_EQ(expected.size(), map.size());
+    for(const auto &entry : expected)
+        EXPECT_EQ(entry.second, map.at(entry.first));
+    // copies and moves hold the same entries
+    const auto copy = map;
+    EXPECT_EQ(sorted_keys(map), sorted_keys(copy));
+    const auto moved = std::move(map);
+    EXPECT_TRUE(map.empty());
+    EXPECT_EQ(sorted_keys(copy), sorted_keys(moved));
+}
@@ -0,0 +1,80 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <tuple>
+#include <vector>
+#include "csr_index.hpp"
+#include "id_map.hpp"
+#include "id_order.hpp"
+#include "stats.hpp"
+#include "types.hpp"
+
+using user_rows = CSRIndex<id_type, ABDStats, UserScore>;
+
+bool is_permutation_of_ids(std::vector<dense_id_t> perm){
+    std::sort(perm.begin(), perm.end());
+    for(dense_id_t id{0u}; id < perm.size(); ++id)
+        if(perm[id] != id) return false;
+    return true;
+}
+
+TEST(IdOrderTest, PopularityTest){
+    const std::vector<std::size_t> counts{3, 7, 1, 7, 0, 3};
+    const auto perm = popularity_order(counts);
+    EXPECT_EQ(std::vector<dense_id_t>({2, 0, 4, 1, 5, 3}), perm);
+}
+
+TEST(IdOrderTest, CoratingTest){
+    // items by popularity: 2, 0, 1, 3
+    const std::vector<dense_id_t> item_perm{1, 2, 0, 3};
+    user_rows rows;
+    const std::vector<std::vector<dense_id_t>> items{{3}, {0, 2}, {1, 3}, {2, 3}, {0, 1, 2}, {1}};
+    for(dense_id_t user{0u}; user < items.size(); ++user)
+        for(const auto item : items[user])
+            rows.insert(user, UserScore(item, 4, 0));
+    rows.sort_all();
+    const auto perm = corating_order(rows, item_perm);
+    ASSERT_TRUE(is_permutation_of_ids(perm));
+    // users 4, 1 and 3 rated the most popular item 2, 4 and 1 also item 0, and 4 rated more items than 1
+    EXPECT_EQ(std::vector<dense_id_t>({5, 1, 3, 2, 0, 4}), perm);
+}
+
+TEST(IdOrderTest, RelabelTest){
+    // the relabeled rows hold the same (external user, external item) ratings
+    IdMap user_ids, item_ids;
+    user_rows rows;
+    for(id_type user{10}; user < 40; ++user)
+        for(id_type item{100}; item < 100 + user % 7 + 1; ++item)
+            rows.insert(user_ids.insert(user), UserScore(item_ids.insert(item * 3 % 107), user % 5, 0));
+    rows.sort_all();
+    auto ratings = [&](const user_rows &index){
+        std::vector<std::tuple<id_type, id_type, float>> all;
+        for(dense_id_t user{0u}; user < index.size(); ++user)
+            for(const auto &score : index[user])
+                all.emplace_back(user_ids.external(user), item_ids.external(score._id), score._rating);
+        std::sort(all.begin(), all.end());
+        return all;
+    };
+    const auto before = ratings(rows);
+    std::vector<std::size_t> item_counts(item_ids.size(), 0u);
+    for(const auto &entry : rows)
+        for(const auto &score : entry.second)
+            ++item_counts[score._id];
+    const auto item_perm = popularity_order(item_counts);
+    const auto user_perm = corating_order(rows, item_perm);
+    rows.relabel(user_perm, item_perm);
+    rows.sort_all();
+    user_ids.relabel(user_perm);
+    item_ids.relabel(item_perm);
+    EXPECT_EQ(before, ratings(rows));
+}
+
+TEST(IdOrderTest, NameTest){
+    for(const auto order : {IdOrder::external, IdOrder::popularity, IdOrder::corating}){
+        IdOrder found{IdOrder::external};
+        EXPECT_TRUE(find_id_order(order_name(order), found));
+        EXPECT_EQ(order, found);
+    }
+    IdOrder found{IdOrder::corating};
+    EXPECT_FALSE(find_id_order("random", found));
+    EXPECT_EQ(IdOrder::corating, found);
+}
@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <vector>
+#include "csr_index.hpp"
+#include "external_sort.hpp"
+#include "mapped_index.hpp"
+#include "stats.hpp"
+#include "types.hpp"
+
+using item_rows = CSRIndex<id_type, ABDStats, ItemScore>;
+using item_mapped = MappedIndex<id_type, ABDStats, ItemScore>;
+using record_t = item_mapped::record_t;
+
+// unsorted records with repeated scores and some keys without any
+std::vector<record_t> make_records(const dense_id_t num_keys, const std::size_t n){
+    std::vector<record_t> records;
+    for(std::size_t i{0u}; i < n; ++i){
+        const dense_id_t key = (i * 7919u) % num_keys;
+        if(key % 10 == 3) continue;
+        records.emplace_back(key, ItemScore((i * 104729u) % 5000u, 1 + i % 5));
+    }
+    return records;
+}
+
+item_rows make_rows(const std::vector<record_t> &records, const std::size_t num_keys){
+    // keys without scores are part of the index too
+    item_rows rows;
+    rows.reserve(num_keys - 1, 0u);
+    for(const auto &record : records)
+        rows.insert(record.first, record.second);
+    rows.sort_all();
+    return rows;
+}
+
+std::vector<ItemScore> scores_of(const item_mapped &index, const id_type key){
+    std::vector<ItemScore> scores;
+    index.for_each(key, 0u, index.num_scores(key), [&scores](const ItemScore &score){scores.push_back(score);});
+    return scores;
+}
+
+TEST(ExternalSortTest, MergeTest){
+    // a buffer of min_chunk records, the records are spread over many runs
+    auto records = make_records(97u, 20000u);
+    ExternalSorter<record_t> sorter("/tmp", 0u);
+    for(const auto &record : records)
+        sorter.push(record);
+    EXPECT_EQ(records.size(), sorter.size());
+    EXPECT_LT(10u, sorter.num_runs());
+    std::vector<record_t> merged;
+    sorter.merge([&merged](const record_t &record){merged.push_back(record);});
+    std::sort(records.begin(), records.end());
+    EXPECT_EQ(records, merged);
+    EXPECT_EQ(0u, sorter.size());
+}
+
+TEST(ExternalSortTest, TransformTest){
+    // relabel the keys of the records after they have been spilled, as ABDTree::init does
+    auto records = make_records(50u, 5000u);
+    ExternalSorter<record_t> sorter("/tmp", 0u);
+    for(const auto &record : records)
+        sorter.push(record);
+    auto reverse = [](record_t &record){record.first = 49u - record.first;};
+    sorter.transform(reverse);
+    std::for_each(records.begin(), records.end(), reverse);
+    std::sort(records.begin(), records.end());
+    std::vector<record_t> merged;
+    sorter.merge([&merged](const record_t &record){merged.push_back(record);});
+    EXPECT_EQ(records, merged);
+}
+
+TEST(MappedIndexTest, BuildTest){
+    const dense_id_t num_keys{60u};
+    const auto records = make_records(num_keys, 10000u);
+    ExternalSorter<record_t> sorter("/tmp", 0u);
+    for(const auto &record : records)
+        sorter.push(record);
+    const item_mapped index(sorter, num_keys, "/tmp");
+    const auto rows = make_rows(records, num_keys);
+    ASSERT_EQ(rows.size(), index.size());
+    EXPECT_EQ(rows.num_scores(), index.num_scores());
+    EXPECT_EQ(rows.num_scores() * sizeof(ItemScore), index.mapped_bytes());
+    for(id_type key{0}; key < static_cast<id_type>(num_keys); ++key){
+        const auto entry = rows[key];
+        EXPECT_EQ(std::vector<ItemScore>(entry.begin(), entry.end()), scores_of(index, key));
+    }
+}
+
+TEST(MappedIndexTest, RearrangeTest){
+    const dense_id_t num_keys{20u};
+    const auto records = make_records(num_keys, 4000u);
+    ExternalSorter<record_t> sorter("/tmp", 1u << 20);
+    for(const auto &record : records)
+        sorter.push(record);
+    item_mapped index(sorter, num_keys, "/tmp");
+    auto rows = make_rows(records, num_keys);
+    auto range = [&rows](const id_type key){
+        const auto n = rows.num_scores(key);
+        return item_rows::bound_t(n / 4, n - n / 3);
+    };
+    auto odd_first = [](__attribute__((unused)) const id_type key, ItemScore *first, ItemScore *last){
+        std::stable_partition(first, last, [](const ItemScore &score){return score._id % 2 == 1;});
+    };
+    rows.rearrange(range, [&odd_first](const id_type key, item_rows::range_iterator first, item_rows::range_iterator last){
+        odd_first(key, &*first, &*first + (last - first));
+    });
+    index.rearrange(range, odd_first);
+    for(id_type key{0}; key < static_cast<id_type>(num_keys); ++key){
+        const auto entry = rows[key];
+        EXPECT_EQ(std::vector<ItemScore>(entry.begin(), entry.end()), scores_of(index, key));
+    }
+}
+
+TEST(MappedIndexTest, RetainTest){
+    const dense_id_t num_keys{30u};
+    const auto records = make_records(num_keys, 3000u);
+    ExternalSorter<record_t> sorter("/tmp", 0u);
+    for(const auto &record : records)
+        sorter.push(record);
+    item_mapped index(sorter, num_keys, "/tmp");
+    auto rows = make_rows(records, num_keys);
+    const std::vector<id_type> kept{0, 5, 6, 13, 29};
+    rows.retain_keys(kept.cbegin(), kept.cend());
+    index.retain_keys(kept.cbegin(), kept.cend());
+    EXPECT_EQ(rows.num_scores(), index.num_scores());
+    EXPECT_EQ(rows.num_scores() * sizeof(ItemScore), index.mapped_bytes());
+    for(id_type key{0}; key < static_cast<id_type>(num_keys); ++key){
+        const auto entry = rows[key];
+        EXPECT_EQ(std::vector<ItemScore>(entry.begin(), entry.end()), scores_of(index, key));
+    }
+}
@@ -0,0 +1,243 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <vector>
+#include "csr_index.hpp"
+#include "packed_index.hpp"
+#include "stats.hpp"
+#include "types.hpp"
+
+using item_rows = CSRIndex<id_type, ABDStats, ItemScore>;
+using user_rows = CSRIndex<id_type, ABDStats, UserScore>;
+using item_packed = PackedIndex<id_type, ABDStats, ItemScore>;
+using user_packed = PackedIndex<id_type, ABDStats, UserScore>;
+
+// rows of all sizes around the block size, with repeated ids, large gaps and an empty key
+user_rows make_rows(const std::vector<double> &shifts){
+    user_rows rows;
+    for(dense_id_t key{0u}; key < shifts.size(); ++key){
+        const std::size_t n = key == 3u ? 0u : key * 37u % 300u;
+        for(std::size_t i{0u}; i < n; ++i){
+            const dense_id_t id = i * (key + 1) + (i % 7 == 0 ? 100000u * key : 0u);
+            const double rating = 1 + (i * 3 + key) % 5 + (i % 4 == 0 ? .5 : .0);
+            rows.insert(key, UserScore(id, rating, rating - shifts[key]));
+            if(i % 11 == 0)
+                rows.insert(key, UserScore(id, rating + 1, rating + 1 - shifts[key]));
+        }
+    }
+    rows.sort_all();
+    return rows;
+}
+
+item_rows make_item_rows(const std::size_t num_keys){
+    const auto rows = make_rows(std::vector<double>(num_keys, .0));
+    item_rows items;
+    for(id_type key{0}; key < static_cast<id_type>(num_keys); ++key)
+        for(const auto &score : rows[key])
+            items.insert(key, ItemScore(score._id, score._rating));
+    items.sort_all();
+    return items;
+}
+
+template<typename Index>
+std::vector<typename Index::score_t> scores_of(const Index &index, const id_type key,
+                                               const std::size_t first, const std::size_t last){
+    std::vector<typename Index::score_t> scores;
+    index.for_each(key, first, last, [&scores](const typename Index::score_t &score){scores.push_back(score);});
+    return scores;
+}
+
+struct MemoryWriter{
+    std::vector<char> _bytes;
+    template<typename T>
+    void write(const T *data, const std::size_t n){
+        _bytes.insert(_bytes.end(), reinterpret_cast<const char*>(data), reinterpret_cast<const char*>(data + n));
+        _bytes.resize((_bytes.size() + 7u) & ~std::size_t{7u});
+    }
+};
+
+struct MemoryReader{
+    const std::vector<char> &_bytes;
+    std::size_t _pos;
+    template<typename T>
+    const T* read(const std::size_t n){
+        auto data = reinterpret_cast<const T*>(_bytes.data() + _pos);
+        _pos += (n * sizeof(T) + 7u) & ~std::size_t{7u};
+        return data;
+    }
+};
+
+TEST(PackedIndexTest, DecodeTest){
+    std::vector<double> shifts(20);
+    for(std::size_t key{0u}; key < shifts.size(); ++key)
+        shifts[key] = .1 * key - .7;
+    const auto rows = make_rows(shifts);
+    const user_packed packed(rows, shifts);
+    ASSERT_EQ(rows.size(), packed.size());
+    EXPECT_EQ(rows.num_scores(), packed.num_scores());
+    EXPECT_LT(packed.memory_bytes(), rows.memory_bytes());
+    for(id_type key{0}; key < static_cast<id_type>(rows.size()); ++key){
+        const auto n = rows.num_scores(key);
+        ASSERT_EQ(n, packed.num_scores(key));
+        EXPECT_EQ(scores_of(rows, key, 0u, n), scores_of(packed, key, 0u, n));
+        // ranges starting and ending inside blocks
+        EXPECT_EQ(scores_of(rows, key, n / 3, n - n / 4), scores_of(packed, key, n / 3, n - n / 4));
+    }
+    // the unbiased ratings, and so the stats, are the same bit for bit
+    const auto rows_stats = rows.all_stats(), packed_stats = packed.all_stats();
+    ASSERT_EQ(rows_stats.size(), packed_stats.size());
+    for(auto it = rows_stats.cbegin(), pt = packed_stats.cbegin(); it != rows_stats.cend(); ++it, ++pt){
+        EXPECT_EQ(it->first, pt->first);
+        EXPECT_EQ(it->second._sum_unbiased, pt->second._sum_unbiased);
+        EXPECT_EQ(it->second._sum2, pt->second._sum2);
+    }
+}
+
+TEST(PackedIndexTest, RearrangeTest){
+    // move the odd ids first in the middle of every entry, as ABDTree::split does with its groups
+    auto rows = make_item_rows(15u);
+    item_packed packed(rows);
+    auto range = [&rows](const id_type key){
+        const auto n = rows.num_scores(key);
+        return item_rows::bound_t(n / 5, n - n / 3);
+    };
+    auto odd_first = [](__attribute__((unused)) const id_type key, item_rows::range_iterator first, item_rows::range_iterator last){
+        std::stable_partition(first, last, [](const ItemScore &score){return score._id % 2 == 1;});
+    };
+    for(int r = 0; r < 2; ++r){
+        rows.rearrange(range, odd_first);
+        packed.rearrange(range, odd_first);
+        for(id_type key{0}; key < static_cast<id_type>(rows.size()); ++key)
+            EXPECT_EQ(scores_of(rows, key, 0u, rows.num_scores(key)), scores_of(packed, key, 0u, packed.num_scores(key)));
+    }
+}
+
+TEST(PackedIndexTest, RetainTest){
+    // rearrange some keys only, then drop the scores of the keys that are not kept
+    auto rows = make_item_rows(12u);
+    item_packed packed(rows);
+    const auto original = rows;
+    auto range = [&rows](const id_type key){return item_rows::bound_t(0u, rows.num_scores(key));};
+    auto reverse = [](__attribute__((unused)) const id_type key, item_rows::range_iterator first, item_rows::range_iterator last){
+        std::reverse(first, last);
+    };
+    const std::vector<id_type> rearranged{1, 4, 7}, kept{1, 2, 3, 4, 9};
+    rows.rearrange(rearranged.cbegin(), rearranged.cend(), range, reverse);
+    packed.rearrange(rearranged.cbegin(), rearranged.cend(), range, reverse);
+    rows.retain_keys(kept.cbegin(), kept.cend());
+    packed.retain_keys(kept.cbegin(), kept.cend());
+    ASSERT_EQ(original.size(), packed.size());
+    EXPECT_EQ(rows.num_scores(), packed.num_scores());
+    for(id_type key{0}; key < static_cast<id_type>(original.size()); ++key){
+        auto expected = scores_of(original, key, 0u, original.num_scores(key));
+        if(std::find(rearranged.cbegin(), rearranged.cend(), key) != rearranged.cend())
+            std::reverse(expected.begin(), expected.end());
+        if(std::find(kept.cbegin(), kept.cend(), key) == kept.cend())
+            expected.clear();
+        EXPECT_EQ(expected, scores_of(rows, key, 0u, rows.num_scores(key)));
+        EXPECT_EQ(expected, scores_of(packed, key, 0u, packed.num_scores(key)));
+    }
+}
+
+TEST(PackedIndexTest, ParallelRearrangeTest){
+    // the keys rearranged by several threads end up as the ones rearranged one after the other
+    auto rows = make_item_rows(40u);
+    item_packed packed(rows);
+    auto range = [&rows](const id_type key){
+        const auto n = rows.num_scores(key);
+        return item_rows::bound_t(n / 5, n - n / 3);
+    };
+    auto odd_first = [](__attribute__((unused)) const id_type key, item_rows::range_iterator first, item_rows::range_iterator last){
+        std::stable_partition(first, last, [](const ItemScore &score){return score._id % 2 == 1;});
+    };
+    std::vector<id_type> keys;
+    for(id_type key{1}; key < static_cast<id_type>(rows.size()); key += 2)
+        keys.push_back(key);
+    rows.rearrange(keys.cbegin(), keys.cend(), range, odd_first);
+    packed.rearrange(keys.cbegin(), keys.cend(), range, odd_first, 4u);
+    for(id_type key{0}; key < static_cast<id_type>(rows.size()); ++key)
+        EXPECT_EQ(scores_of(rows, key, 0u, rows.num_scores(key)), scores_of(packed, key, 0u, packed.num_scores(key)));
+}
+
+TEST(PackedIndexTest, SorterTest){
+    // the index packed from the sorted stream of shuffled records is the one packed from the rows
+    std::vector<double> shifts(25);
+    for(std::size_t key{0u}; key < shifts.size(); ++key)
+        shifts[key] = .2 * key - 1.5;
+    // no records for the last keys
+    shifts.resize(shifts.size() + 3u, .0);
+    const auto rows = make_rows(shifts);
+    std::vector<user_packed::record_t> records;
+    std::vector<user_packed::value_t> values;
+    for(id_type key{0}; key < static_cast<id_type>(rows.size()); ++key)
+        for(const auto &score : rows[key]){
+            records.emplace_back(key, score);
+            values.push_back(score._rating);
+        }
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+    std::reverse(records.begin(), records.end());
+    user_packed::sorter_t sorter("/tmp", 0u);
+    for(const auto &record : records)
+        sorter.push(record);
+    const user_packed packed(sorter, rows.size(), values, shifts);
+    const user_packed expected(rows, shifts);
+    EXPECT_EQ(0u, sorter.size());
+    ASSERT_EQ(expected.size(), packed.size());
+    EXPECT_EQ(expected.memory_bytes(), packed.memory_bytes());
+    for(id_type key{0}; key < static_cast<id_type>(rows.size()); ++key)
+        EXPECT_EQ(scores_of(expected, key, 0u, expected.num_scores(key)), scores_of(packed, key, 0u, packed.num_scores(key)));
+
+    user_packed::sorter_t unknown_value("/tmp", 0u);
+    unknown_value.push(records.front());
+    EXPECT_THROW(user_packed(unknown_value, rows.size(), std::vector<user_packed::value_t>{}), std::invalid_argument);
+}
+
+TEST(PackedIndexTest, InPlaceTest){
+    // the blocks are packed again in their slots, whatever the order of the scores
+    auto rows = make_item_rows(30u);
+    item_packed packed(rows);
+    const auto memory_bytes = packed.memory_bytes();
+    auto range = [&rows](const id_type key){return item_rows::bound_t(0u, rows.num_scores(key));};
+    auto shuffle = [](const id_type key, item_rows::range_iterator first, item_rows::range_iterator last){
+        std::reverse(first, last);
+        for(auto it = first; it + 2 < last; it += 3)
+            std::iter_swap(it, it + 1 + key % 2);
+    };
+    for(int r = 0; r < 3; ++r){
+        rows.rearrange(range, shuffle);
+        packed.rearrange(range, shuffle);
+    }
+    EXPECT_EQ(memory_bytes, packed.memory_bytes());
+    for(id_type key{0}; key < static_cast<id_type>(rows.size()); ++key)
+        EXPECT_EQ(scores_of(rows, key, 0u, rows.num_scores(key)), scores_of(packed, key, 0u, packed.num_scores(key)));
+
+    // without room the unsorted blocks do not fit, and the index is left as it was
+    const auto sorted = make_item_rows(30u);
+    item_packed tight(sorted, std::vector<double>{}, false);
+    EXPECT_LT(tight.memory_bytes(), item_packed(sorted).memory_bytes());
+    EXPECT_THROW(tight.rearrange(range, shuffle), std::runtime_error);
+    for(id_type key{0}; key < static_cast<id_type>(sorted.size()); ++key)
+        EXPECT_EQ(scores_of(sorted, key, 0u, sorted.num_scores(key)), scores_of(tight, key, 0u, tight.num_scores(key)));
+}
+
+TEST(PackedIndexTest, SnapshotTest){
+    std::vector<double> shifts(10, .25);
+    const auto rows = make_rows(shifts);
+    const user_packed packed(rows, shifts);
+    MemoryWriter writer;
+    packed.write(writer);
+    MemoryReader reader{writer._bytes, 0u};
+    user_packed read;
+    read.read(reader, packed.size(), packed.num_scores());
+    EXPECT_EQ(writer._bytes.size(), reader._pos);
+    for(id_type key{0}; key < static_cast<id_type>(rows.size()); ++key)
+        EXPECT_EQ(scores_of(packed, key, 0u, packed.num_scores(key)), scores_of(read, key, 0u, read.num_scores(key)));
+}
+
+TEST(PackedIndexTest, ValuesTest){
+    item_rows rows;
+    for(std::size_t i{0u}; i <= item_packed::max_values; ++i)
+        rows.insert(0, ItemScore(i, .5 * i));
+    rows.sort_all();
+    EXPECT_THROW(item_packed{rows}, std::runtime_error);
+}
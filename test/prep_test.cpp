@@ -0,0 +1,195 @@
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "prep.hpp"
+
+// a scratch directory with a ratings file of users with 1 to 40 ratings, not sorted by user
+class PrepTest : public ::testing::Test{
+protected:
+    std::string _dir;
+    std::vector<std::string> _lines;
+
+    void SetUp() override{
+        char dir[] = "/tmp/prep_test_XXXXXX";
+        ASSERT_NE(nullptr, ::mkdtemp(dir));
+        _dir = dir;
+        for(int user = 0; user < 60; ++user)
+            for(int r = 0; r <= user * 7 % 40; ++r)
+                _lines.push_back(std::to_string(user * 37 % 61 * 3) + "\t" + std::to_string(r * 11 % 23) + "\t" +
+                                 std::to_string(1 + (user + r) % 5));
+        std::vector<std::string> shuffled(_lines);
+        std::mt19937_64 rng(3);
+        std::shuffle(shuffled.begin(), shuffled.end(), rng);
+        write_lines(_dir + "/ratings.txt", shuffled);
+    }
+
+    void TearDown() override{
+        const auto ret = std::system(("rm -rf " + _dir).c_str());
+        (void)ret;
+    }
+
+    static void write_lines(const std::string &filename, const std::vector<std::string> &lines){
+        std::ofstream ofs(filename);
+        for(const auto &line : lines)
+            ofs << line << "\n";
+    }
+
+    static std::vector<std::string> read_lines(const std::string &filename){
+        std::ifstream ifs(filename);
+        EXPECT_TRUE(ifs.good()) << filename;
+        std::vector<std::string> lines;
+        for(std::string line; std::getline(ifs, line); )
+            lines.push_back(line);
+        return lines;
+    }
+
+    static long user_of(const std::string &line){
+        return std::stol(line.substr(0, line.find('\t')));
+    }
+
+    // the number of lines of each user, checking that the users are in increasing order
+    static std::map<long, std::size_t> users_of(const std::vector<std::string> &lines, const bool sorted = true){
+        std::map<long, std::size_t> users;
+        long last{-1};
+        for(const auto &line : lines){
+            const auto user = user_of(line);
+            if(sorted){
+                EXPECT_LE(last, user) << "the users are not sorted";
+            }
+            last = user;
+            ++users[user];
+        }
+        return users;
+    }
+
+    static std::multiset<std::string> all_of(std::initializer_list<const std::vector<std::string>*> files){
+        std::multiset<std::string> all;
+        for(const auto file : files)
+            all.insert(file->cbegin(), file->cend());
+        return all;
+    }
+};
+
+TEST_F(PrepTest, KeyOrderTest){
+    EXPECT_TRUE(key_less("9", "10"));
+    EXPECT_FALSE(key_less("10", "9"));
+    EXPECT_FALSE(key_less("10", "10"));
+    EXPECT_TRUE(key_less("abc", "abd"));
+}
+
+TEST_F(PrepTest, KFoldTest){
+    const std::size_t num_folds = 4;
+    const double split_perc = .75;
+    kfold(_dir + "/ratings.txt", _dir + "/folds", num_folds, split_perc, 0u, '\t', 5u, 3u);
+    const auto users = users_of(_lines, false);
+    const std::multiset<std::string> expected(_lines.cbegin(), _lines.cend());
+    std::set<long> test_users;
+    for(std::size_t fold{0u}; fold < num_folds; ++fold){
+        const auto name = _dir + "/folds/s" + std::to_string(fold) + "/s" + std::to_string(fold);
+        const auto train = read_lines(name + ".train"), ans = read_lines(name + ".ans"), eval = read_lines(name + ".eval");
+        // every rating is in one file of the fold
+        EXPECT_EQ(expected, all_of({&train, &ans, &eval}));
+        const auto train_users = users_of(train), ans_users = users_of(ans), eval_users = users_of(eval);
+        // the test users of the fold are not in its training file, and are split by user
+        std::set<long> fold_users;
+        for(const auto &entry : ans_users)  fold_users.insert(entry.first);
+        for(const auto &entry : eval_users) fold_users.insert(entry.first);
+        EXPECT_EQ(users.size() / num_folds + (fold + 1 == num_folds ? users.size() % num_folds : 0u), fold_users.size());
+        for(const auto user : fold_users){
+            EXPECT_EQ(0u, train_users.count(user));
+            EXPECT_TRUE(test_users.insert(user).second) << "user " << user << " is tested in two folds";
+            const auto n = users.at(user);
+            const auto num_ans = static_cast<std::size_t>(split_perc * n);
+            EXPECT_EQ(num_ans, ans_users.count(user) == 0u ? 0u : ans_users.at(user));
+            EXPECT_EQ(n - num_ans, eval_users.count(user) == 0u ? 0u : eval_users.at(user));
+        }
+    }
+    // the folds cover all the users
+    EXPECT_EQ(users.size(), test_users.size());
+
+    // the same seed gives the same folds for any number of threads
+    kfold(_dir + "/ratings.txt", _dir + "/serial", num_folds, split_perc, 0u, '\t', 5u, 1u);
+    for(const auto ext : {".train", ".ans", ".eval"})
+        EXPECT_EQ(read_lines(_dir + "/folds/s1/s1" + ext), read_lines(_dir + "/serial/s1/s1" + ext));
+
+    // no folds, and more folds than keys, are errors
+    EXPECT_THROW(kfold(_dir + "/ratings.txt", _dir + "/none", 0u, split_perc, 0u, '\t', 5u, 1u), std::runtime_error);
+    EXPECT_THROW(kfold(_dir + "/ratings.txt", _dir + "/many", users.size() + 1, split_perc, 0u, '\t', 5u, 1u),
+                 std::runtime_error);
+}
+
+TEST_F(PrepTest, RandomSplitTest){
+    rand_split(_dir + "/ratings.txt", _dir, .7, 9u, 2u);
+    const auto input = read_lines(_dir + "/ratings.txt");
+    const auto train = read_lines(_dir + "/ratings.train"), test = read_lines(_dir + "/ratings.test");
+    EXPECT_EQ(std::multiset<std::string>(input.cbegin(), input.cend()), all_of({&train, &test}));
+    EXPECT_NEAR(.7, static_cast<double>(train.size()) / input.size(), .05);
+    // the lines keep the order of the input
+    for(const auto *part : {&train, &test}){
+        auto next = input.cbegin();
+        for(const auto &line : *part)
+            next = std::find(next, input.cend(), line) + 1;
+        EXPECT_LE(next, input.cend());
+    }
+}
+
+TEST_F(PrepTest, GroupSplitTest){
+    // the test file holds ratings of the same users, and of users that are not in the training file
+    std::vector<std::string> other{"1000\t1\t3", "1000\t2\t4"};
+    for(std::size_t l{0u}; l < _lines.size(); l += 3)
+        other.push_back(_lines[l]);
+    write_lines(_dir + "/other.txt", other);
+    group_split(_dir + "/ratings.txt", _dir + "/other.txt", _dir, 0u, 1., .75, '\t', 4u, 2u);
+    const auto train = read_lines(_dir + "/ratings.txt.train"), test = read_lines(_dir + "/ratings.txt.test");
+    const auto other_train = read_lines(_dir + "/other.txt.train"), other_test = read_lines(_dir + "/other.txt.test");
+    EXPECT_EQ(std::multiset<std::string>(_lines.cbegin(), _lines.cend()), all_of({&train, &test}));
+    const auto train_users = users_of(train), test_users = users_of(test);
+    const auto other_train_users = users_of(other_train), other_test_users = users_of(other_test);
+    EXPECT_EQ(static_cast<std::size_t>(.75 * (train_users.size() + test_users.size())), train_users.size());
+    // the keys of the training part are the same in both files, and never in the test part
+    for(const auto &entry : other_train_users){
+        EXPECT_EQ(1u, train_users.count(entry.first));
+        EXPECT_EQ(0u, test_users.count(entry.first));
+    }
+    for(const auto &entry : other_test_users)
+        EXPECT_EQ(1u, test_users.count(entry.first));
+    EXPECT_EQ(other.size() - 2u, other_train.size() + other_test.size());
+}
+
+TEST_F(PrepTest, RenumberTest){
+    // ids of any form map to consecutive integers in order of appearance, and back
+    std::vector<std::string> csv{"user,item,rating"};
+    std::vector<std::string> users, items;
+    for(std::size_t r{0u}; r < 200u; ++r){
+        users.push_back("u" + std::to_string(r * 7 % 31));
+        items.push_back("item-" + std::to_string(r * 13 % 17));
+        csv.push_back(users.back() + "," + items.back() + "," + std::to_string(r % 7) + (r % 2 ? ".5" : ""));
+    }
+    write_lines(_dir + "/ratings.csv", csv);
+    renumber(_dir + "/ratings.csv", _dir + "/ratings.num", 3u);
+    const auto lines = read_lines(_dir + "/ratings.num");
+    ASSERT_EQ(users.size(), lines.size());
+    std::vector<std::string> user_names, item_names;
+    for(std::size_t r{0u}; r < lines.size(); ++r){
+        std::istringstream iss(lines[r]);
+        std::size_t user, item;
+        double rating;
+        iss >> user >> item >> rating;
+        // a new id is the next one
+        ASSERT_LE(user, user_names.size());
+        ASSERT_LE(item, item_names.size());
+        if(user == user_names.size()) user_names.push_back(users[r]);
+        if(item == item_names.size()) item_names.push_back(items[r]);
+        EXPECT_EQ(users[r], user_names[user]);
+        EXPECT_EQ(items[r], item_names[item]);
+        EXPECT_DOUBLE_EQ(std::min(5., r % 7 + (r % 2 ? .5 : .0)), rating);
+    }
+    EXPECT_EQ(31u, user_names.size());
+    EXPECT_EQ(17u, item_names.size());
+}
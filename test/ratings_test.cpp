@@ -0,0 +1,174 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <boost/iostreams/filter/bzip2.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include "ratings.hpp"
+#include "ratings_bin.hpp"
+#include "ratings_stream.hpp"
+
+std::string write_tmp(const std::string &content){
+    static unsigned counter{0u};
+    std::string filename = "ratings_test_" + std::to_string(counter++) + ".txt";
+    std::ofstream(filename) << content;
+    return filename;
+}
+
+void expect_equal(const std::vector<Rating> &expected, const std::vector<Rating> &actual){
+    ASSERT_EQ(expected.size(), actual.size());
+    for(std::size_t i{0}; i < expected.size(); ++i){
+        EXPECT_EQ(expected[i]._user_id, actual[i]._user_id);
+        EXPECT_EQ(expected[i]._item_id, actual[i]._item_id);
+        EXPECT_DOUBLE_EQ(expected[i]._value, actual[i]._value);
+    }
+}
+
+TEST(RatingsTest, SplitLinesTest){
+    const std::string text{"1 2 3\n4 5 6\n7 8 9\n"};
+    const auto bounds = split_lines(text.data(), text.data() + text.size(), 4);
+    ASSERT_EQ(5u, bounds.size());
+    EXPECT_EQ(text.data(), bounds.front());
+    EXPECT_EQ(text.data() + text.size(), bounds.back());
+    for(std::size_t c{1}; c < bounds.size()-1; ++c)
+        EXPECT_TRUE(bounds[c] == bounds.back() || *(bounds[c]-1) == '\n');
+}
+
+TEST(RatingsTest, ParallelReadTest){
+    const std::vector<Rating> expected{Rating(1, 2, 3), Rating(4, 5, 6.5), Rating(7, 8, 1), Rating(10, 11, 2)};
+    const auto filename = write_tmp("1 2 3\r\n4 5 6.5\n\n7\t8 1\n10 11 2");
+    for(unsigned num_threads : {1u, 2u, 3u, 8u})
+        expect_equal(expected, Rating::read_from(filename, num_threads));
+    std::remove(filename.c_str());
+}
+
+TEST(RatingsTest, TextSourceTest){
+    const std::vector<Rating> expected{Rating(1, 2, 3), Rating(4, 5, 6.5), Rating(7, 8, 1), Rating(10, 11, 2)};
+    const auto filename = write_tmp("1 2 3\n4 5 6.5\n\n7 8 1\n10 11 2\n");
+    for(unsigned num_threads : {1u, 3u}){
+        ParseStats stats;
+        TextRatings source(filename, num_threads, &stats);
+        EXPECT_TRUE(source.multi_pass());
+        for(int pass{0}; pass < 2; ++pass){
+            std::vector<Rating> ratings;
+            source.for_each_block([&](const Rating *first, const Rating *last){
+                ratings.insert(ratings.end(), first, last);
+            });
+            expect_equal(expected, ratings);
+            EXPECT_EQ(expected.size(), stats._ratings);
+        }
+    }
+    std::remove(filename.c_str());
+}
+
+TEST(RatingsTest, ParseErrorTest){
+    const auto filename = write_tmp("1 2 3\n4 x 6\n");
+    EXPECT_THROW(Rating::read_from(filename, 2), std::runtime_error);
+    std::remove(filename.c_str());
+    // a line that fails on its first id must not end the chunk silently, whatever the chunks
+    const auto bad_first = write_tmp("1 2 3\nx 5 6\n7 8 9\n10 11 2\n");
+    for(unsigned num_threads : {1u, 2u, 4u})
+        EXPECT_THROW(Rating::read_from(bad_first, num_threads), std::runtime_error);
+    std::remove(bad_first.c_str());
+    std::vector<Rating> ratings;
+    const std::string text{"1 2 3\n-4 5 6\n"};
+    EXPECT_THROW(parse_ratings(text.data(), text.data() + text.size(), ratings), std::runtime_error);
+}
+
+TEST(RatingsTest, BinaryRoundTripTest){
+    const std::vector<Rating> narrow{Rating(1000, 2, 3), Rating(4, 3000000000, 4.5), Rating(7, 8, 1)};
+    const std::vector<Rating> wide{Rating(-1, 2, 3.3), Rating(1ll << 40, 5, 4), Rating(7, 8, 1)};
+    // ids spanning more than the id_type range
+    const std::vector<Rating> extreme{Rating(std::numeric_limits<id_type>::min(), 2, 3),
+                                      Rating(std::numeric_limits<id_type>::max(), 5, 4)};
+    for(const auto &ratings : {narrow, wide, extreme}){
+        const std::string filename{"ratings_test.bin"};
+        write_binary_ratings(filename, ratings);
+        ASSERT_TRUE(is_binary_ratings(filename));
+        BinaryRatings loaded(filename);
+        EXPECT_EQ(ratings.size(), loaded.size());
+        expect_equal(ratings, loaded.to_vector());
+        std::vector<Rating> blocks;
+        loaded.for_each_block([&](const Rating *first, const Rating *last){
+            blocks.insert(blocks.end(), first, last);
+        });
+        expect_equal(ratings, blocks);
+        std::remove(filename.c_str());
+    }
+}
+
+TEST(RatingsTest, BinaryHeaderTest){
+    const std::string filename{"ratings_test.bin"};
+    auto header = write_binary_ratings(filename, {Rating(10, 2, 3), Rating(10, 5, 4.5), Rating(7, 2, 1)});
+    EXPECT_EQ(3u, header._num_ratings);
+    EXPECT_EQ(2u, header._num_users);
+    EXPECT_EQ(2u, header._num_items);
+    EXPECT_EQ(7, header._min_user_id);
+    EXPECT_EQ(10, header._max_user_id);
+    EXPECT_EQ(4u, header.id_bytes());
+    EXPECT_EQ(4u, header.rating_bytes());
+    std::remove(filename.c_str());
+    EXPECT_FALSE(is_binary_ratings(filename));
+}
+
+// ratings of i % 97, i % 1013 and i % 5 + 1, compressed into filename
+std::string write_compressed(const std::string &filename, const int num_ratings, std::vector<Rating> &expected){
+    namespace io = boost::iostreams;
+    std::ostringstream text;
+    for(int i{0}; i < num_ratings; ++i){
+        expected.push_back(Rating(i % 97, i % 1013, i % 5 + 1));
+        text << i % 97 << " " << i % 1013 << " " << i % 5 + 1 << "\n";
+    }
+    std::ofstream ofs(filename, std::ios::binary);
+    io::filtering_ostream out;
+    if(compression_of(filename) == Compression::GZIP)
+        out.push(io::gzip_compressor());
+    else
+        out.push(io::bzip2_compressor());
+    out.push(ofs);
+    out << text.str();
+    return text.str();
+}
+
+TEST(RatingsTest, CompressedStreamTest){
+    // about 8.8 MB of text, more than two chunks of 4 MB, and a line spans the end of the first one
+    const std::size_t chunk_size = 4u << 20;
+    for(const std::string filename : {"ratings_test.txt.gz", "ratings_test.txt.bz2"}){
+        std::vector<Rating> expected;
+        const auto text = write_compressed(filename, 1000000, expected);
+        ASSERT_LT(2 * chunk_size, text.size());
+        ASSERT_NE('\n', text[chunk_size - 1]);
+        for(unsigned num_threads : {1u, 4u}){
+            ParseStats stats;
+            std::vector<Rating> ratings;
+            CompressedRatings(filename, num_threads, &stats).for_each_block([&](const Rating *first, const Rating *last){
+                ratings.insert(ratings.end(), first, last);
+            });
+            expect_equal(expected, ratings);
+            EXPECT_EQ(expected.size(), stats._ratings);
+            EXPECT_EQ(text.size(), stats._bytes);
+        }
+        std::remove(filename.c_str());
+    }
+}
+
+TEST(RatingsTest, TruncatedStreamTest){
+    // the first half of the archives, the ratings must not just end early
+    for(const std::string filename : {"ratings_test.txt.gz", "ratings_test.txt.bz2"}){
+        std::vector<Rating> expected;
+        write_compressed(filename, 200000, expected);
+        std::string archive;
+        {
+            std::ifstream ifs(filename, std::ios::binary);
+            archive.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+        }
+        std::ofstream(filename, std::ios::binary) << archive.substr(0, archive.size() / 2);
+        for(unsigned num_threads : {1u, 4u})
+            EXPECT_THROW(CompressedRatings(filename, num_threads).for_each_block([](const Rating*, const Rating*){}),
+                         std::runtime_error);
+        std::remove(filename.c_str());
+    }
+}
@@ -0,0 +1,147 @@
+#include <gtest/gtest.h>
+#include <iterator>
+#include <map>
+#include <vector>
+#include "stats.hpp"
+#include "types.hpp"
+
+using stat_map = StatMap<id_type, ABDStats>;
+
+std::vector<id_type> keys_of(const stat_map &stats){
+    std::vector<id_type> keys;
+    for(const auto &entry : stats)
+        keys.push_back(entry.first);
+    return keys;
+}
+
+TEST(StatMapTest, SparseTest){
+    stat_map stats;
+    for(const id_type key : {7, 3, 5, 3})
+        stats.update(key, ScoreUnbiased{0, 4, 1});
+    EXPECT_FALSE(stats.is_dense());
+    EXPECT_EQ(std::vector<id_type>({3, 5, 7}), keys_of(stats));
+    EXPECT_EQ(2, stats.at(3)._n);
+    EXPECT_EQ(1u, stats.count(7));
+    EXPECT_EQ(0u, stats.count(4));
+    EXPECT_THROW(stats.at(4), std::out_of_range);
+    EXPECT_EQ(7, std::prev(stats.cend())->first);
+}
+
+TEST(StatMapTest, DenseTest){
+    // same updates as a std::map, past the dense threshold and in no particular order
+    stat_map stats;
+    std::map<id_type, ABDStats> expected;
+    for(id_type i{0}; i < 1000; ++i){
+        const id_type key = (i * 7919) % 613;
+        stats.update(key, ScoreUnbiased{0, static_cast<float>(i % 5), .5f});
+        expected[key].update(ScoreUnbiased{0, static_cast<float>(i % 5), .5f});
+    }
+    EXPECT_TRUE(stats.is_dense());
+    ASSERT_EQ(expected.size(), stats.size());
+    auto it = stats.cbegin();
+    for(const auto &entry : expected){
+        EXPECT_EQ(entry.first, it->first);
+        EXPECT_EQ(entry.second._n, it->second._n);
+        EXPECT_DOUBLE_EQ(entry.second._sum, it->second._sum);
+        ++it;
+    }
+    EXPECT_TRUE(it == stats.cend());
+    // copies are compact
+    const stat_map copy{stats};
+    EXPECT_FALSE(copy.is_dense());
+    EXPECT_EQ(keys_of(stats), keys_of(copy));
+}
+
+TEST(StatMapTest, ClearTest){
+    stat_map stats;
+    for(id_type key{0}; key < 200; ++key)
+        stats.update(key * 2, ScoreUnbiased{0, 4, 1});
+    stats.clear();
+    EXPECT_TRUE(stats.empty());
+    EXPECT_EQ(0u, stats.count(10));
+    // the reused map holds the new entries only
+    for(const id_type key : {11, 10})
+        stats.update(key, ScoreUnbiased{0, 4, 1});
+    EXPECT_EQ(std::vector<id_type>({10, 11}), keys_of(stats));
+    EXPECT_EQ(1, stats.at(10)._n);
+}
+
+TEST(StatMapTest, TakeCompactTest){
+    // the taken maps are compact and the maps are left empty, in both layouts
+    for(const id_type num_keys : {10, 300}){
+        stat_map stats;
+        for(id_type key{num_keys - 1}; key >= 0; --key)
+            stats.update(key, ScoreUnbiased{0, 4, 1});
+        EXPECT_EQ(num_keys > 64, stats.is_dense());
+        const auto keys = keys_of(stats);
+        const auto taken = stats.take_compact();
+        EXPECT_FALSE(taken.is_dense());
+        EXPECT_EQ(keys, keys_of(taken));
+        EXPECT_EQ(1, taken.at(num_keys - 1)._n);
+        EXPECT_TRUE(stats.empty());
+        stats.update(3, ScoreUnbiased{0, 4, 1});
+        EXPECT_EQ(std::vector<id_type>({3}), keys_of(stats));
+    }
+}
+
+TEST(StatMapTest, DifferenceTest){
+    // the unknown group of a split, from dense and sparse groups
+    stat_map node, loved, hated, unknown;
+    for(id_type key{0}; key < 300; ++key){
+        for(int r = 0; r < 3; ++r)
+            node.update(key, ScoreUnbiased{0, static_cast<float>(r + 1), r - 1.f});
+        loved.update(key, ScoreUnbiased{0, 1, -1});
+        if(key % 50 == 0) hated.update(key, ScoreUnbiased{0, 2, 0});
+    }
+    for(const auto dense : {false, true}){
+        stat_map whole;
+        if(dense)
+            whole.assign_dense(node);
+        else
+            whole = node;
+        std::vector<stat_map> groups{loved, hated};
+        unknown.assign_difference(whole, groups.cbegin(), groups.cend());
+        ASSERT_EQ(300u, unknown.size());
+        EXPECT_EQ(1, unknown.at(0)._n);
+        EXPECT_DOUBLE_EQ(3., unknown.at(0)._sum);
+        EXPECT_EQ(2, unknown.at(1)._n);
+        // groups taking all the ratings of a key leave it out
+        groups.push_back(unknown);
+        stat_map empty;
+        empty.assign_difference(whole, groups.cbegin(), groups.cend());
+        EXPECT_TRUE(empty.empty());
+        EXPECT_DOUBLE_EQ(.0, empty.squared_error());
+    }
+}
+
+TEST(StatsKernelsTest, LevelsTest){
+    // every level gives the same results, bit for bit
+    const std::size_t num_slots{1003u};
+    std::vector<double> sum(num_slots), sum2(num_slots);
+    std::vector<int> n(num_slots);
+    std::vector<id_type> keys;
+    for(std::size_t slot{0u}; slot < num_slots; ++slot){
+        if(slot % 3 == 0) continue;
+        n[slot] = 1 + slot % 7;
+        sum[slot] = .1 * slot;
+        sum2[slot] = .01 * slot * slot + n[slot];
+        keys.push_back(slot);
+    }
+    const auto ref_sq = stats_kernels::squared_error(sum.data(), sum2.data(), n.data(), num_slots,
+                                                     stats_kernels::SimdLevel::scalar);
+    const auto ref_keys_sq = stats_kernels::squared_error(sum.data(), sum2.data(), n.data(), keys.data(), keys.size(),
+                                                          stats_kernels::SimdLevel::scalar);
+    EXPECT_DOUBLE_EQ(ref_sq, ref_keys_sq);
+    for(const auto level : {stats_kernels::SimdLevel::avx2, stats_kernels::SimdLevel::avx512}){
+        if(level > stats_kernels::supported_level()) continue;
+        EXPECT_EQ(ref_sq, stats_kernels::squared_error(sum.data(), sum2.data(), n.data(), num_slots, level));
+        EXPECT_EQ(ref_keys_sq, stats_kernels::squared_error(sum.data(), sum2.data(), n.data(), keys.data(), keys.size(), level));
+        std::vector<id_type> nonzero(num_slots);
+        nonzero.resize(stats_kernels::nonzero_keys(n.data(), num_slots, nonzero.data(), level));
+        EXPECT_EQ(keys, nonzero);
+        auto diff = sum;
+        stats_kernels::subtract(diff.data(), sum2.data(), num_slots, level);
+        for(std::size_t slot{0u}; slot < num_slots; ++slot)
+            EXPECT_EQ(sum[slot] - sum2[slot], diff[slot]);
+    }
+}